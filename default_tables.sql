@@ -521,5 +521,35 @@ CREATE TABLE `status` (
 	  `invalid_packets` int(11) NOT NULL,
 	  `invalid_request_data` int(11) NOT NULL,
 	  `build_string` varchar(256) DEFAULT NULL,
-	  `dictionary_size` int(11) NOT NULL
+	  `dictionary_size` int(11) NOT NULL,
+	  `ring_occupancy` int(11) NOT NULL,
+	  `ring_drops` int(11) NOT NULL,
+	  `coalesced_requests` int(11) NOT NULL,
+	  `harvest_latency` int(11) NOT NULL,
+	  `tmp_pool_high_water` int(11) NOT NULL,
+	  `early_harvests` int(11) NOT NULL,
+	  `arena_memory` bigint(20) NOT NULL,
+	  `arena_memory_peak` bigint(20) NOT NULL,
+	  `arena_memory_freed` bigint(20) NOT NULL,
+	  `dictionary_memory` bigint(20) NOT NULL,
+	  `dictionary_words_freed` bigint(20) NOT NULL,
+	  `lost_timers` bigint(20) NOT NULL
 ) ENGINE=PINBA DEFAULT CHARSET=latin1 COMMENT='status';
+
+DROP TABLE IF EXISTS collectors;
+
+CREATE TABLE `collectors` (
+	  `thread` int(11) NOT NULL,
+	  `type` varchar(16) NOT NULL,
+	  `packets` bigint(20) unsigned NOT NULL,
+	  `ring_occupancy` int(11) NOT NULL,
+	  `ring_drops` bigint(20) unsigned NOT NULL,
+	  `kernel_drops` bigint(20) unsigned NOT NULL,
+	  `rcvbuf_used` int(11) NOT NULL,
+	  `rcvbuf_size` int(11) NOT NULL,
+	  `invalid_packets` bigint(20) unsigned NOT NULL,
+	  `invalid_request_data` bigint(20) unsigned NOT NULL,
+	  `busy_polls` bigint(20) unsigned NOT NULL,
+	  `cpu_time` bigint(20) unsigned NOT NULL,
+	  `recv_delay` float NOT NULL
+) ENGINE=PINBA DEFAULT CHARSET=latin1 COMMENT='collectors';
@@ -37,7 +37,7 @@ void pinba_update_tag_info_add(size_t request_id, void *rep, const pinba_stats_r
 		tag_found = 0;
 		timer = record_get_timer(&D->timer_pool, record, i);
 		for (j = 0; j < timer->tag_num; j++) {
-			if (report->tag_id[0] == timer->tag_ids[j]) {
+			if (report->tag_id[0] == timer->tags[j].id) {
 				tag_found = 1;
 				break;
 			}
@@ -47,7 +47,7 @@ void pinba_update_tag_info_add(size_t request_id, void *rep, const pinba_stats_r
 			continue;
 		}
 
-		word = (pinba_word *)timer->tag_values[j];
+		word = timer->tags[j].value;
 		data = (struct pinba_tag_info_data *)pinba_map_get(report->results, word->str);
 
 		if (UNLIKELY(!data)) {
@@ -57,9 +57,9 @@ void pinba_update_tag_info_add(size_t request_id, void *rep, const pinba_stats_r
 				continue;
 			}
 
-			data->req_count = 1;
+			data->req_count = record->data.weight;
 			data->hit_count = timer->hit_count;
-			data->timer_value = timer->value;
+			data->timer_value = usec_to_timeval(timer->value);
 			data->prev_add_request_id = request_id;
 			data->prev_del_request_id = -1;
 
@@ -68,15 +68,15 @@ void pinba_update_tag_info_add(size_t request_id, void *rep, const pinba_stats_r
 			report->std.results_cnt++;
 		} else {
 			data->hit_count += timer->hit_count;
-			timeradd(&data->timer_value, &timer->value, &data->timer_value);
+			timeval_add_usec(&data->timer_value, timer->value);
 		}
-		timeradd(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-		timeradd(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, timer->value, timer->hit_count);
+		timeval_add_usec(&data->ru_utime_value, timer->ru_utime);
+		timeval_add_usec(&data->ru_stime_value, timer->ru_stime);
+		PINBA_UPDATE_HISTOGRAM_ADD_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 
 		/* count tag values only once per request */
 		if (request_id != data->prev_add_request_id) {
-			data->req_count++;
+			data->req_count += record->data.weight;
 			data->prev_add_request_id = request_id;
 		}
 	}
@@ -98,7 +98,7 @@ void pinba_update_tag_info_delete(size_t request_id, void *rep, const pinba_stat
 		timer = record_get_timer(&D->timer_pool, record, i);
 
 		for (j = 0; j < timer->tag_num; j++) {
-			if (report->tag_id[0] == timer->tag_ids[j]) {
+			if (report->tag_id[0] == timer->tags[j].id) {
 				tag_found = 1;
 				break;
 			}
@@ -108,7 +108,7 @@ void pinba_update_tag_info_delete(size_t request_id, void *rep, const pinba_stat
 			continue;
 		}
 
-		word = (pinba_word *)timer->tag_values[j];
+		word = timer->tags[j].value;
 
 		data = (struct pinba_tag_info_data *)pinba_map_get(report->results, word->str);
 
@@ -117,7 +117,7 @@ void pinba_update_tag_info_delete(size_t request_id, void *rep, const pinba_stat
 		} else {
 			/* count tag values only once per request */
 			if (request_id != data->prev_del_request_id) {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				data->prev_del_request_id = request_id;
 			}
 
@@ -128,10 +128,10 @@ void pinba_update_tag_info_delete(size_t request_id, void *rep, const pinba_stat
 				free(data);
 			} else {
 				data->hit_count -= timer->hit_count;
-				timersub(&data->timer_value, &timer->value, &data->timer_value);
-				timersub(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-				timersub(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, timer->value, timer->hit_count);
+				timeval_sub_usec(&data->timer_value, timer->value);
+				timeval_sub_usec(&data->ru_utime_value, timer->ru_utime);
+				timeval_sub_usec(&data->ru_stime_value, timer->ru_stime);
+				PINBA_UPDATE_HISTOGRAM_DEL_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 			}
 		}
 	}
@@ -154,11 +154,11 @@ void pinba_update_tag2_info_add(size_t request_id, void *rep, const pinba_stats_
 		tag2_pos = -1;
 		timer = record_get_timer(&D->timer_pool, record, i);
 		for (j = 0; j < timer->tag_num; j++) {
-			if (report->tag_id[0] == timer->tag_ids[j]) {
+			if (report->tag_id[0] == timer->tags[j].id) {
 				tag1_pos = j;
 				continue;
 			}
-			if (report->tag_id[1] == timer->tag_ids[j]) {
+			if (report->tag_id[1] == timer->tags[j].id) {
 				tag2_pos = j;
 				continue;
 			}
@@ -168,8 +168,8 @@ void pinba_update_tag2_info_add(size_t request_id, void *rep, const pinba_stats_
 			continue;
 		}
 
-		word1 = (pinba_word *)timer->tag_values[tag1_pos];
-		word2 = (pinba_word *)timer->tag_values[tag2_pos];
+		word1 = timer->tags[tag1_pos].value;
+		word2 = timer->tags[tag2_pos].value;
 
 		memcpy_static(index_val, word1->str, word1->len, index_len);
 		index_val[index_len] = '|'; index_len++;
@@ -184,9 +184,9 @@ void pinba_update_tag2_info_add(size_t request_id, void *rep, const pinba_stats_
 				continue;
 			}
 
-			data->req_count = 1;
+			data->req_count = record->data.weight;
 			data->hit_count = timer->hit_count;
-			data->timer_value = timer->value;
+			data->timer_value = usec_to_timeval(timer->value);
 			data->prev_add_request_id = request_id;
 			data->prev_del_request_id = -1;
 
@@ -197,15 +197,15 @@ void pinba_update_tag2_info_add(size_t request_id, void *rep, const pinba_stats_
 			report->std.results_cnt++;
 		} else {
 			data->hit_count += timer->hit_count;
-			timeradd(&data->timer_value, &timer->value, &data->timer_value);
+			timeval_add_usec(&data->timer_value, timer->value);
 		}
-		timeradd(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-		timeradd(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, timer->value, timer->hit_count);
+		timeval_add_usec(&data->ru_utime_value, timer->ru_utime);
+		timeval_add_usec(&data->ru_stime_value, timer->ru_stime);
+		PINBA_UPDATE_HISTOGRAM_ADD_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 
 		/* count tag values only once per request */
 		if (request_id != data->prev_add_request_id) {
-			data->req_count++;
+			data->req_count += record->data.weight;
 			data->prev_add_request_id = request_id;
 		}
 	}
@@ -229,11 +229,11 @@ void pinba_update_tag2_info_delete(size_t request_id, void *rep, const pinba_sta
 		tag2_pos = -1;
 		timer = record_get_timer(&D->timer_pool, record, i);
 		for (j = 0; j < timer->tag_num; j++) {
-			if (report->tag_id[0] == timer->tag_ids[j]) {
+			if (report->tag_id[0] == timer->tags[j].id) {
 				tag1_pos = j;
 				continue;
 			}
-			if (report->tag_id[1] == timer->tag_ids[j]) {
+			if (report->tag_id[1] == timer->tags[j].id) {
 				tag2_pos = j;
 				continue;
 			}
@@ -243,8 +243,8 @@ void pinba_update_tag2_info_delete(size_t request_id, void *rep, const pinba_sta
 			continue;
 		}
 
-		word1 = (pinba_word *)timer->tag_values[tag1_pos];
-		word2 = (pinba_word *)timer->tag_values[tag2_pos];
+		word1 = timer->tags[tag1_pos].value;
+		word2 = timer->tags[tag2_pos].value;
 
 		memcpy_static(index_val, word1->str, word1->len, index_len);
 		index_val[index_len] = '|'; index_len++;
@@ -257,7 +257,7 @@ void pinba_update_tag2_info_delete(size_t request_id, void *rep, const pinba_sta
 		} else {
 			/* count tag values only once per request */
 			if (request_id != data->prev_del_request_id) {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				data->prev_del_request_id = request_id;
 			}
 
@@ -269,10 +269,10 @@ void pinba_update_tag2_info_delete(size_t request_id, void *rep, const pinba_sta
 				continue;
 			} else {
 				data->hit_count -= timer->hit_count;
-				timersub(&data->timer_value, &timer->value, &data->timer_value);
-				timersub(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-				timersub(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, timer->value, timer->hit_count);
+				timeval_sub_usec(&data->timer_value, timer->value);
+				timeval_sub_usec(&data->ru_utime_value, timer->ru_utime);
+				timeval_sub_usec(&data->ru_stime_value, timer->ru_stime);
+				PINBA_UPDATE_HISTOGRAM_DEL_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 			}
 		}
 	}
@@ -292,7 +292,7 @@ void pinba_update_tag_report_add(size_t request_id, void *rep, const pinba_stats
 		tag_found = 0;
 		timer = record_get_timer(&D->timer_pool, record, i);
 		for (j = 0; j < timer->tag_num; j++) {
-			if (report->tag_id[0] == timer->tag_ids[j]) {
+			if (report->tag_id[0] == timer->tags[j].id) {
 				tag_found = 1;
 				break;
 			}
@@ -302,13 +302,13 @@ void pinba_update_tag_report_add(size_t request_id, void *rep, const pinba_stats
 			continue;
 		}
 
-		word = (pinba_word *)timer->tag_values[j];
+		word = timer->tags[j].value;
 
 		if (!script_map) {
-			script_map = pinba_map_get(report->results, record->data.script_name);
+			script_map = pinba_map_get(report->results, record->data.script_name->str);
 			if (!script_map) {
 				script_map = pinba_map_create();
-				report->results = pinba_map_add(report->results, record->data.script_name, script_map);
+				report->results = pinba_map_add(report->results, record->data.script_name->str, script_map);
 			}
 		}
 
@@ -320,28 +320,28 @@ void pinba_update_tag_report_add(size_t request_id, void *rep, const pinba_stats
 				continue;
 			}
 
-			data->req_count = 1;
+			data->req_count = record->data.weight;
 			data->hit_count = timer->hit_count;
-			data->timer_value = timer->value;
+			data->timer_value = usec_to_timeval(timer->value);
 			data->prev_add_request_id = request_id;
 			data->prev_del_request_id = -1;
 
-			memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+			memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 			memcpy_static(data->tag_value, word->str, word->len, dummy);
 
 			pinba_map_add(script_map, word->str, data);
 			report->std.results_cnt++;
 		} else {
 			data->hit_count += timer->hit_count;
-			timeradd(&data->timer_value, &timer->value, &data->timer_value);
+			timeval_add_usec(&data->timer_value, timer->value);
 		}
-		timeradd(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-		timeradd(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, timer->value, timer->hit_count);
+		timeval_add_usec(&data->ru_utime_value, timer->ru_utime);
+		timeval_add_usec(&data->ru_stime_value, timer->ru_stime);
+		PINBA_UPDATE_HISTOGRAM_ADD_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 
 		/* count tag values only once per request */
 		if (request_id != data->prev_add_request_id) {
-			data->req_count++;
+			data->req_count += record->data.weight;
 			data->prev_add_request_id = request_id;
 		}
 	}
@@ -359,7 +359,7 @@ void pinba_update_tag_report_delete(size_t request_id, void *rep, const pinba_st
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
-	script_map = pinba_map_get(report->results, record->data.script_name);
+	script_map = pinba_map_get(report->results, record->data.script_name->str);
 	if (UNLIKELY(!script_map)) {
 		return;
 	}
@@ -368,7 +368,7 @@ void pinba_update_tag_report_delete(size_t request_id, void *rep, const pinba_st
 		tag_found = 0;
 		timer = record_get_timer(&D->timer_pool, record, i);
 		for (j = 0; j < timer->tag_num; j++) {
-			if (report->tag_id[0] == timer->tag_ids[j]) {
+			if (report->tag_id[0] == timer->tags[j].id) {
 				tag_found = 1;
 				break;
 			}
@@ -378,7 +378,7 @@ void pinba_update_tag_report_delete(size_t request_id, void *rep, const pinba_st
 			continue;
 		}
 
-		word = (pinba_word *)timer->tag_values[j];
+		word = timer->tags[j].value;
 
 		data = (struct pinba_tag_report_data *)pinba_map_get(script_map, word->str);
 
@@ -387,7 +387,7 @@ void pinba_update_tag_report_delete(size_t request_id, void *rep, const pinba_st
 		} else {
 			/* count tag values only once per request */
 			if (request_id != data->prev_del_request_id) {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				data->prev_del_request_id = request_id;
 			}
 
@@ -395,7 +395,7 @@ void pinba_update_tag_report_delete(size_t request_id, void *rep, const pinba_st
 
 				if (pinba_map_delete(script_map, word->str) < 0) {
 					pinba_map_destroy(script_map);
-					pinba_map_delete(report->results, record->data.script_name);
+					pinba_map_delete(report->results, record->data.script_name->str);
 					script_map = NULL;
 				}
 
@@ -405,10 +405,10 @@ void pinba_update_tag_report_delete(size_t request_id, void *rep, const pinba_st
 				continue;
 			} else {
 				data->hit_count -= timer->hit_count;
-				timersub(&data->timer_value, &timer->value, &data->timer_value);
-				timersub(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-				timersub(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, timer->value, timer->hit_count);
+				timeval_sub_usec(&data->timer_value, timer->value);
+				timeval_sub_usec(&data->ru_utime_value, timer->ru_utime);
+				timeval_sub_usec(&data->ru_stime_value, timer->ru_stime);
+				PINBA_UPDATE_HISTOGRAM_DEL_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 			}
 		}
 	}
@@ -431,11 +431,11 @@ void pinba_update_tag2_report_add(size_t request_id, void *rep, const pinba_stat
 		tag2_pos = -1;
 		timer = record_get_timer(&D->timer_pool, record, i);
 		for (j = 0; j < timer->tag_num; j++) {
-			if (report->tag_id[0] == timer->tag_ids[j]) {
+			if (report->tag_id[0] == timer->tags[j].id) {
 				tag1_pos = j;
 				continue;
 			}
-			if (report->tag_id[1] == timer->tag_ids[j]) {
+			if (report->tag_id[1] == timer->tags[j].id) {
 				tag2_pos = j;
 				continue;
 			}
@@ -445,18 +445,18 @@ void pinba_update_tag2_report_add(size_t request_id, void *rep, const pinba_stat
 			continue;
 		}
 
-		word1 = (pinba_word *)timer->tag_values[tag1_pos];
-		word2 = (pinba_word *)timer->tag_values[tag2_pos];
+		word1 = timer->tags[tag1_pos].value;
+		word2 = timer->tags[tag2_pos].value;
 
 		memcpy_static(index_val, word1->str, word1->len, index_len);
 		index_val[index_len] = '|'; index_len++;
 		memcat_static(index_val, index_len, word2->str, word2->len, index_len);
 
 		if (!script_map) {
-			script_map = pinba_map_get(report->results, record->data.script_name);
+			script_map = pinba_map_get(report->results, record->data.script_name->str);
 			if (!script_map) {
 				script_map = pinba_map_create();
-				report->results = pinba_map_add(report->results, record->data.script_name, script_map);
+				report->results = pinba_map_add(report->results, record->data.script_name->str, script_map);
 			}
 		}
 
@@ -469,13 +469,13 @@ void pinba_update_tag2_report_add(size_t request_id, void *rep, const pinba_stat
 				continue;
 			}
 
-			data->req_count = 1;
+			data->req_count = record->data.weight;
 			data->hit_count = timer->hit_count;
-			data->timer_value = timer->value;
+			data->timer_value = usec_to_timeval(timer->value);
 			data->prev_add_request_id = request_id;
 			data->prev_del_request_id = -1;
 
-			memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+			memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 			memcpy_static(data->tag1_value, word1->str, word1->len, dummy);
 			memcpy_static(data->tag2_value, word2->str, word2->len, dummy);
 
@@ -483,15 +483,15 @@ void pinba_update_tag2_report_add(size_t request_id, void *rep, const pinba_stat
 			report->std.results_cnt++;
 		} else {
 			data->hit_count += timer->hit_count;
-			timeradd(&data->timer_value, &timer->value, &data->timer_value);
+			timeval_add_usec(&data->timer_value, timer->value);
 		}
-		timeradd(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-		timeradd(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, timer->value, timer->hit_count);
+		timeval_add_usec(&data->ru_utime_value, timer->ru_utime);
+		timeval_add_usec(&data->ru_stime_value, timer->ru_stime);
+		PINBA_UPDATE_HISTOGRAM_ADD_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 
 		/* count tag values only once per request */
 		if (request_id != data->prev_add_request_id) {
-			data->req_count++;
+			data->req_count += record->data.weight;
 			data->prev_add_request_id = request_id;
 		}
 	}
@@ -511,7 +511,7 @@ void pinba_update_tag2_report_delete(size_t request_id, void *rep, const pinba_s
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
-	script_map = pinba_map_get(report->results, record->data.script_name);
+	script_map = pinba_map_get(report->results, record->data.script_name->str);
 	if (UNLIKELY(!script_map)) {
 		return;
 	}
@@ -521,11 +521,11 @@ void pinba_update_tag2_report_delete(size_t request_id, void *rep, const pinba_s
 		tag2_pos = -1;
 		timer = record_get_timer(&D->timer_pool, record, i);
 		for (j = 0; j < timer->tag_num; j++) {
-			if (report->tag_id[0] == timer->tag_ids[j]) {
+			if (report->tag_id[0] == timer->tags[j].id) {
 				tag1_pos = j;
 				continue;
 			}
-			if (report->tag_id[1] == timer->tag_ids[j]) {
+			if (report->tag_id[1] == timer->tags[j].id) {
 				tag2_pos = j;
 				continue;
 			}
@@ -535,8 +535,8 @@ void pinba_update_tag2_report_delete(size_t request_id, void *rep, const pinba_s
 			continue;
 		}
 
-		word1 = (pinba_word *)timer->tag_values[tag1_pos];
-		word2 = (pinba_word *)timer->tag_values[tag2_pos];
+		word1 = timer->tags[tag1_pos].value;
+		word2 = timer->tags[tag2_pos].value;
 
 		memcpy_static(index_val, word1->str, word1->len, index_len);
 		index_val[index_len] = '|'; index_len++;
@@ -548,7 +548,7 @@ void pinba_update_tag2_report_delete(size_t request_id, void *rep, const pinba_s
 		} else {
 			/* count tag values only once per request */
 			if (request_id != data->prev_del_request_id) {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				data->prev_del_request_id = request_id;
 			}
 
@@ -557,16 +557,16 @@ void pinba_update_tag2_report_delete(size_t request_id, void *rep, const pinba_s
 				free(data);
 				if (pinba_map_delete(script_map, index_val) < 0) {
 					pinba_map_destroy(script_map);
-					pinba_map_delete(report->results, record->data.script_name);
+					pinba_map_delete(report->results, record->data.script_name->str);
 					script_map = NULL;
 				}
 				report->std.results_cnt--;
 			} else {
 				data->hit_count -= timer->hit_count;
-				timersub(&data->timer_value, &timer->value, &data->timer_value);
-				timersub(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-				timersub(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, timer->value, timer->hit_count);
+				timeval_sub_usec(&data->timer_value, timer->value);
+				timeval_sub_usec(&data->ru_utime_value, timer->ru_utime);
+				timeval_sub_usec(&data->ru_stime_value, timer->ru_stime);
+				PINBA_UPDATE_HISTOGRAM_DEL_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 			}
 		}
 	}
@@ -587,7 +587,7 @@ void pinba_update_tag_report2_add(size_t request_id, void *rep, const pinba_stat
 		tag_found = 0;
 		timer = record_get_timer(&D->timer_pool, record, i);
 		for (j = 0; j < timer->tag_num; j++) {
-			if (report->tag_id[0] == timer->tag_ids[j]) {
+			if (report->tag_id[0] == timer->tags[j].id) {
 				tag_found = 1;
 				break;
 			}
@@ -597,19 +597,19 @@ void pinba_update_tag_report2_add(size_t request_id, void *rep, const pinba_stat
 			continue;
 		}
 
-		word = (pinba_word *)timer->tag_values[j];
+		word = timer->tags[j].value;
 
-		memcpy_static(index, record->data.hostname, (int)record->data.hostname_len, index_len);
+		memcpy_static(index, record->data.hostname->str, (int)record->data.hostname->len, index_len);
 		index[index_len] = '|'; index_len++;
-		memcat_static(index, index_len, record->data.server_name, (int)record->data.server_name_len, index_len);
+		memcat_static(index, index_len, record->data.server_name->str, (int)record->data.server_name->len, index_len);
 		index[index_len] = '|'; index_len++;
 		memcat_static(index, index_len, word->str, word->len, index_len);
 
 		if (!script_map) {
-			script_map = pinba_map_get(report->results, record->data.script_name);
+			script_map = pinba_map_get(report->results, record->data.script_name->str);
 			if (!script_map) {
 				script_map = pinba_map_create();
-				report->results = pinba_map_add(report->results, record->data.script_name, script_map);
+				report->results = pinba_map_add(report->results, record->data.script_name->str, script_map);
 			}
 		}
 
@@ -622,15 +622,15 @@ void pinba_update_tag_report2_add(size_t request_id, void *rep, const pinba_stat
 				continue;
 			}
 
-			data->req_count = 1;
+			data->req_count = record->data.weight;
 			data->hit_count = timer->hit_count;
-			data->timer_value = timer->value;
+			data->timer_value = usec_to_timeval(timer->value);
 			data->prev_add_request_id = request_id;
 			data->prev_del_request_id = -1;
 
-			memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-			memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
-			memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+			memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+			memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
+			memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 			memcpy_static(data->tag_value, word->str, word->len, dummy);
 
 			pinba_map_add(script_map, index, data);
@@ -638,15 +638,15 @@ void pinba_update_tag_report2_add(size_t request_id, void *rep, const pinba_stat
 		} else {
 
 			data->hit_count += timer->hit_count;
-			timeradd(&data->timer_value, &timer->value, &data->timer_value);
+			timeval_add_usec(&data->timer_value, timer->value);
 		}
-		timeradd(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-		timeradd(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, timer->value, timer->hit_count);
+		timeval_add_usec(&data->ru_utime_value, timer->ru_utime);
+		timeval_add_usec(&data->ru_stime_value, timer->ru_stime);
+		PINBA_UPDATE_HISTOGRAM_ADD_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 
 		/* count tag values only once per request */
 		if (request_id != data->prev_add_request_id) {
-			data->req_count++;
+			data->req_count += record->data.weight;
 			data->prev_add_request_id = request_id;
 		}
 	}
@@ -665,7 +665,7 @@ void pinba_update_tag_report2_delete(size_t request_id, void *rep, const pinba_s
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
-	script_map = pinba_map_get(report->results, record->data.script_name);
+	script_map = pinba_map_get(report->results, record->data.script_name->str);
 	if (UNLIKELY(!script_map)) {
 		return;
 	}
@@ -674,7 +674,7 @@ void pinba_update_tag_report2_delete(size_t request_id, void *rep, const pinba_s
 		tag_found = 0;
 		timer = record_get_timer(&D->timer_pool, record, i);
 		for (j = 0; j < timer->tag_num; j++) {
-			if (report->tag_id[0] == timer->tag_ids[j]) {
+			if (report->tag_id[0] == timer->tags[j].id) {
 				tag_found = 1;
 				break;
 			}
@@ -684,11 +684,11 @@ void pinba_update_tag_report2_delete(size_t request_id, void *rep, const pinba_s
 			continue;
 		}
 
-		word = (pinba_word *)timer->tag_values[j];
+		word = timer->tags[j].value;
 
-		memcpy_static(index, record->data.hostname, (int)record->data.hostname_len, index_len);
+		memcpy_static(index, record->data.hostname->str, (int)record->data.hostname->len, index_len);
 		index[index_len] = '|'; index_len++;
-		memcat_static(index, index_len, record->data.server_name, (int)record->data.server_name_len, index_len);
+		memcat_static(index, index_len, record->data.server_name->str, (int)record->data.server_name->len, index_len);
 		index[index_len] = '|'; index_len++;
 		memcat_static(index, index_len, word->str, word->len, index_len);
 
@@ -700,7 +700,7 @@ void pinba_update_tag_report2_delete(size_t request_id, void *rep, const pinba_s
 
 			/* count tag values only once per request */
 			if (request_id != data->prev_del_request_id) {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				data->prev_del_request_id = request_id;
 			}
 
@@ -709,16 +709,16 @@ void pinba_update_tag_report2_delete(size_t request_id, void *rep, const pinba_s
 				free(data);
 				if (pinba_map_delete(script_map, index) < 0) {
 					pinba_map_destroy(script_map);
-					pinba_map_delete(report->results, record->data.script_name);
+					pinba_map_delete(report->results, record->data.script_name->str);
 					script_map = NULL;
 				}
 				report->std.results_cnt--;
 			} else {
 				data->hit_count -= timer->hit_count;
-				timersub(&data->timer_value, &timer->value, &data->timer_value);
-				timersub(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-				timersub(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, timer->value, timer->hit_count);
+				timeval_sub_usec(&data->timer_value, timer->value);
+				timeval_sub_usec(&data->ru_utime_value, timer->ru_utime);
+				timeval_sub_usec(&data->ru_stime_value, timer->ru_stime);
+				PINBA_UPDATE_HISTOGRAM_DEL_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 			}
 		}
 	}
@@ -741,11 +741,11 @@ void pinba_update_tag2_report2_add(size_t request_id, void *rep, const pinba_sta
 		tag2_pos = -1;
 		timer = record_get_timer(&D->timer_pool, record, i);
 		for (j = 0; j < timer->tag_num; j++) {
-			if (report->tag_id[0] == timer->tag_ids[j]) {
+			if (report->tag_id[0] == timer->tags[j].id) {
 				tag1_pos = j;
 				continue;
 			}
-			if (report->tag_id[1] == timer->tag_ids[j]) {
+			if (report->tag_id[1] == timer->tags[j].id) {
 				tag2_pos = j;
 				continue;
 			}
@@ -755,22 +755,22 @@ void pinba_update_tag2_report2_add(size_t request_id, void *rep, const pinba_sta
 			continue;
 		}
 
-		word1 = (pinba_word *)timer->tag_values[tag1_pos];
-		word2 = (pinba_word *)timer->tag_values[tag2_pos];
+		word1 = timer->tags[tag1_pos].value;
+		word2 = timer->tags[tag2_pos].value;
 
-		memcpy_static(index_val, record->data.hostname, (int)record->data.hostname_len, index_len);
+		memcpy_static(index_val, record->data.hostname->str, (int)record->data.hostname->len, index_len);
 		index_val[index_len] = '|'; index_len++;
-		memcat_static(index_val, index_len, record->data.server_name, (int)record->data.server_name_len, index_len);
+		memcat_static(index_val, index_len, record->data.server_name->str, (int)record->data.server_name->len, index_len);
 		index_val[index_len] = '|'; index_len++;
 		memcat_static(index_val, index_len, word1->str, word1->len, index_len);
 		index_val[index_len] = '|'; index_len++;
 		memcat_static(index_val, index_len, word2->str, word2->len, index_len);
 
 		if (!script_map) {
-			script_map = pinba_map_get(report->results, record->data.script_name);
+			script_map = pinba_map_get(report->results, record->data.script_name->str);
 			if (!script_map) {
 				script_map = pinba_map_create();
-				report->results = pinba_map_add(report->results, record->data.script_name, script_map);
+				report->results = pinba_map_add(report->results, record->data.script_name->str, script_map);
 			}
 		}
 
@@ -782,15 +782,15 @@ void pinba_update_tag2_report2_add(size_t request_id, void *rep, const pinba_sta
 				continue;
 			}
 
-			data->req_count = 1;
+			data->req_count = record->data.weight;
 			data->hit_count = timer->hit_count;
-			data->timer_value = timer->value;
+			data->timer_value = usec_to_timeval(timer->value);
 			data->prev_add_request_id = request_id;
 			data->prev_del_request_id = -1;
 
-			memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-			memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
-			memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+			memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+			memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
+			memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 			memcpy_static(data->tag1_value, word1->str, word1->len, dummy);
 			memcpy_static(data->tag2_value, word2->str, word2->len, dummy);
 
@@ -798,15 +798,15 @@ void pinba_update_tag2_report2_add(size_t request_id, void *rep, const pinba_sta
 			report->std.results_cnt++;
 		} else {
 			data->hit_count += timer->hit_count;
-			timeradd(&data->timer_value, &timer->value, &data->timer_value);
+			timeval_add_usec(&data->timer_value, timer->value);
 		}
-		timeradd(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-		timeradd(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, timer->value, timer->hit_count);
+		timeval_add_usec(&data->ru_utime_value, timer->ru_utime);
+		timeval_add_usec(&data->ru_stime_value, timer->ru_stime);
+		PINBA_UPDATE_HISTOGRAM_ADD_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 
 		/* count tag values only once per request */
 		if (request_id != data->prev_add_request_id) {
-			data->req_count++;
+			data->req_count += record->data.weight;
 			data->prev_add_request_id = request_id;
 		}
 	}
@@ -826,7 +826,7 @@ void pinba_update_tag2_report2_delete(size_t request_id, void *rep, const pinba_
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
-	script_map = pinba_map_get(report->results, record->data.script_name);
+	script_map = pinba_map_get(report->results, record->data.script_name->str);
 	if (UNLIKELY(!script_map)) {
 		return;
 	}
@@ -836,11 +836,11 @@ void pinba_update_tag2_report2_delete(size_t request_id, void *rep, const pinba_
 		tag2_pos = -1;
 		timer = record_get_timer(&D->timer_pool, record, i);
 		for (j = 0; j < timer->tag_num; j++) {
-			if (report->tag_id[0] == timer->tag_ids[j]) {
+			if (report->tag_id[0] == timer->tags[j].id) {
 				tag1_pos = j;
 				continue;
 			}
-			if (report->tag_id[1] == timer->tag_ids[j]) {
+			if (report->tag_id[1] == timer->tags[j].id) {
 				tag2_pos = j;
 				continue;
 			}
@@ -850,12 +850,12 @@ void pinba_update_tag2_report2_delete(size_t request_id, void *rep, const pinba_
 			continue;
 		}
 
-		word1 = (pinba_word *)timer->tag_values[tag1_pos];
-		word2 = (pinba_word *)timer->tag_values[tag2_pos];
+		word1 = timer->tags[tag1_pos].value;
+		word2 = timer->tags[tag2_pos].value;
 
-		memcpy_static(index_val, record->data.hostname, (int)record->data.hostname_len, index_len);
+		memcpy_static(index_val, record->data.hostname->str, (int)record->data.hostname->len, index_len);
 		index_val[index_len] = '|'; index_len++;
-		memcat_static(index_val, index_len, record->data.server_name, (int)record->data.server_name_len, index_len);
+		memcat_static(index_val, index_len, record->data.server_name->str, (int)record->data.server_name->len, index_len);
 		index_val[index_len] = '|'; index_len++;
 		memcat_static(index_val, index_len, word1->str, word1->len, index_len);
 		index_val[index_len] = '|'; index_len++;
@@ -868,7 +868,7 @@ void pinba_update_tag2_report2_delete(size_t request_id, void *rep, const pinba_
 		} else {
 			/* count tag values only once per request */
 			if (request_id != data->prev_del_request_id) {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				data->prev_del_request_id = request_id;
 			}
 
@@ -877,16 +877,16 @@ void pinba_update_tag2_report2_delete(size_t request_id, void *rep, const pinba_
 				free(data);
 				if (pinba_map_delete(script_map, index_val) < 0) {
 					pinba_map_destroy(script_map);
-					pinba_map_delete(report->results, record->data.script_name);
+					pinba_map_delete(report->results, record->data.script_name->str);
 					script_map = NULL;
 				}
 				report->std.results_cnt--;
 			} else {
 				data->hit_count -= timer->hit_count;
-				timersub(&data->timer_value, &timer->value, &data->timer_value);
-				timersub(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-				timersub(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, timer->value, timer->hit_count);
+				timeval_sub_usec(&data->timer_value, timer->value);
+				timeval_sub_usec(&data->ru_utime_value, timer->ru_utime);
+				timeval_sub_usec(&data->ru_stime_value, timer->ru_stime);
+				PINBA_UPDATE_HISTOGRAM_DEL_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 			}
 		}
 	}
@@ -915,8 +915,8 @@ void pinba_update_tagN_info_add(size_t request_id, void *rep, const pinba_stats_
 			int found = 0, tag_id = report->tag_id[h];
 
 			for (j = 0; j < timer->tag_num; j++) {
-				if (tag_id == timer->tag_ids[j]) {
-					report->words[h] = (pinba_word *)timer->tag_values[j];
+				if (tag_id == timer->tags[j].id) {
+					report->words[h] = timer->tags[j].value;
 					found_tags_cnt++;
 					if (found_tags_cnt == report->tags_cnt) {
 						goto jump_ahead;
@@ -960,9 +960,9 @@ jump_ahead:
 				continue;
 			}
 
-			data->req_count = 1;
+			data->req_count = record->data.weight;
 			data->hit_count = timer->hit_count;
-			data->timer_value = timer->value;
+			data->timer_value = usec_to_timeval(timer->value);
 			data->prev_add_request_id = request_id;
 			data->prev_del_request_id = -1;
 
@@ -975,15 +975,15 @@ jump_ahead:
 			report->std.results_cnt++;
 		} else {
 			data->hit_count += timer->hit_count;
-			timeradd(&data->timer_value, &timer->value, &data->timer_value);
+			timeval_add_usec(&data->timer_value, timer->value);
 		}
-		timeradd(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-		timeradd(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, timer->value, timer->hit_count);
+		timeval_add_usec(&data->ru_utime_value, timer->ru_utime);
+		timeval_add_usec(&data->ru_stime_value, timer->ru_stime);
+		PINBA_UPDATE_HISTOGRAM_ADD_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 
 		/* count tag values only once per request */
 		if (request_id != data->prev_add_request_id) {
-			data->req_count++;
+			data->req_count += record->data.weight;
 			data->prev_add_request_id = request_id;
 		}
 	}
@@ -1014,8 +1014,8 @@ void pinba_update_tagN_info_delete(size_t request_id, void *rep, const pinba_sta
 			int found = 0, tag_id = report->tag_id[h];
 
 			for (j = 0; j < timer->tag_num; j++) {
-				if (tag_id == timer->tag_ids[j]) {
-					report->words[h] = (pinba_word *)timer->tag_values[j];
+				if (tag_id == timer->tags[j].id) {
+					report->words[h] = timer->tags[j].value;
 					found_tags_cnt++;
 					if (found_tags_cnt == report->tags_cnt) {
 						goto jump_ahead;
@@ -1051,7 +1051,7 @@ jump_ahead:
 		} else {
 			/* count tag values only once per request */
 			if (request_id != data->prev_del_request_id) {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				data->prev_del_request_id = request_id;
 			}
 
@@ -1064,10 +1064,10 @@ jump_ahead:
 				continue;
 			} else {
 				data->hit_count -= timer->hit_count;
-				timersub(&data->timer_value, &timer->value, &data->timer_value);
-				timersub(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-				timersub(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, timer->value, timer->hit_count);
+				timeval_sub_usec(&data->timer_value, timer->value);
+				timeval_sub_usec(&data->ru_utime_value, timer->ru_utime);
+				timeval_sub_usec(&data->ru_stime_value, timer->ru_stime);
+				PINBA_UPDATE_HISTOGRAM_DEL_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 			}
 		}
 	}
@@ -1093,8 +1093,8 @@ void pinba_update_tagN_report_add(size_t request_id, void *rep, const pinba_stat
 			int found = 0, tag_id = report->tag_id[h];
 
 			for (j = 0; j < timer->tag_num; j++) {
-				if (tag_id == timer->tag_ids[j]) {
-					report->words[h] = (pinba_word *)timer->tag_values[j];
+				if (tag_id == timer->tags[j].id) {
+					report->words[h] = timer->tags[j].value;
 					found_tags_cnt++;
 					if (found_tags_cnt == report->tags_cnt) {
 						goto jump_ahead;
@@ -1115,10 +1115,10 @@ void pinba_update_tagN_report_add(size_t request_id, void *rep, const pinba_stat
 jump_ahead:
 
 		if (!script_map) {
-			script_map = pinba_map_get(report->results, record->data.script_name);
+			script_map = pinba_map_get(report->results, record->data.script_name->str);
 			if (!script_map) {
 				script_map = pinba_map_create();
-				report->results = pinba_map_add(report->results, record->data.script_name, script_map);
+				report->results = pinba_map_add(report->results, record->data.script_name->str, script_map);
 			}
 		}
 
@@ -1146,13 +1146,13 @@ jump_ahead:
 				continue;
 			}
 
-			data->req_count = 1;
+			data->req_count = record->data.weight;
 			data->hit_count = timer->hit_count;
-			data->timer_value = timer->value;
+			data->timer_value = usec_to_timeval(timer->value);
 			data->prev_add_request_id = request_id;
 			data->prev_del_request_id = -1;
 
-			memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+			memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 			for (k = 0; k < report->tags_cnt; k++) {
 				word = report->words[k];
 				memcpy(data->tag_value + PINBA_TAG_VALUE_SIZE * k, word->str, word->len);
@@ -1162,15 +1162,15 @@ jump_ahead:
 			report->std.results_cnt++;
 		} else {
 			data->hit_count += timer->hit_count;
-			timeradd(&data->timer_value, &timer->value, &data->timer_value);
+			timeval_add_usec(&data->timer_value, timer->value);
 		}
-		timeradd(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-		timeradd(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, timer->value, timer->hit_count);
+		timeval_add_usec(&data->ru_utime_value, timer->ru_utime);
+		timeval_add_usec(&data->ru_stime_value, timer->ru_stime);
+		PINBA_UPDATE_HISTOGRAM_ADD_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 
 		/* count tag values only once per request */
 		if (request_id != data->prev_add_request_id) {
-			data->req_count++;
+			data->req_count += record->data.weight;
 			data->prev_add_request_id = request_id;
 		}
 	}
@@ -1189,7 +1189,7 @@ void pinba_update_tagN_report_delete(size_t request_id, void *rep, const pinba_s
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
-	script_map = pinba_map_get(report->results, record->data.script_name);
+	script_map = pinba_map_get(report->results, record->data.script_name->str);
 	if (UNLIKELY(!script_map)) {
 		return;
 	}
@@ -1204,8 +1204,8 @@ void pinba_update_tagN_report_delete(size_t request_id, void *rep, const pinba_s
 			int found = 0, tag_id = report->tag_id[h];
 
 			for (j = 0; j < timer->tag_num; j++) {
-				if (tag_id == timer->tag_ids[j]) {
-					report->words[h] = (pinba_word *)timer->tag_values[j];
+				if (tag_id == timer->tags[j].id) {
+					report->words[h] = timer->tags[j].value;
 					found_tags_cnt++;
 					if (found_tags_cnt == report->tags_cnt) {
 						goto jump_ahead;
@@ -1241,14 +1241,14 @@ jump_ahead:
 		} else {
 			/* count tag values only once per request */
 			if (request_id != data->prev_del_request_id) {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				data->prev_del_request_id = request_id;
 			}
 
 			if (UNLIKELY(data->req_count == 0)) {
 				if (pinba_map_delete(script_map, report->index) < 0) {
 					pinba_map_destroy(script_map);
-					pinba_map_delete(report->results, record->data.script_name);
+					pinba_map_delete(report->results, record->data.script_name->str);
 					script_map = NULL;
 				}
 				pinba_lmap_destroy(data->histogram_data);
@@ -1258,10 +1258,10 @@ jump_ahead:
 				continue;
 			} else {
 				data->hit_count -= timer->hit_count;
-				timersub(&data->timer_value, &timer->value, &data->timer_value);
-				timersub(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-				timersub(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, timer->value, timer->hit_count);
+				timeval_sub_usec(&data->timer_value, timer->value);
+				timeval_sub_usec(&data->ru_utime_value, timer->ru_utime);
+				timeval_sub_usec(&data->ru_stime_value, timer->ru_stime);
+				PINBA_UPDATE_HISTOGRAM_DEL_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 			}
 		}
 	}
@@ -1287,8 +1287,8 @@ void pinba_update_tagN_report2_add(size_t request_id, void *rep, const pinba_sta
 			int found = 0, tag_id = report->tag_id[h];
 
 			for (j = 0; j < timer->tag_num; j++) {
-				if (tag_id == timer->tag_ids[j]) {
-					report->words[h] = (pinba_word *)timer->tag_values[j];
+				if (tag_id == timer->tags[j].id) {
+					report->words[h] = timer->tags[j].value;
 					found_tags_cnt++;
 					if (found_tags_cnt == report->tags_cnt) {
 						goto jump_ahead;
@@ -1309,18 +1309,18 @@ void pinba_update_tagN_report2_add(size_t request_id, void *rep, const pinba_sta
 jump_ahead:
 
 		if (!script_map) {
-			script_map = pinba_map_get(report->results, record->data.script_name);
+			script_map = pinba_map_get(report->results, record->data.script_name->str);
 			if (!script_map) {
 				script_map = pinba_map_create();
-				report->results = pinba_map_add(report->results, record->data.script_name, script_map);
+				report->results = pinba_map_add(report->results, record->data.script_name->str, script_map);
 			}
 		}
 
-		memcpy(report->index, record->data.hostname, record->data.hostname_len);
-		index_len = record->data.hostname_len;
+		memcpy(report->index, record->data.hostname->str, record->data.hostname->len);
+		index_len = record->data.hostname->len;
 		report->index[index_len] = '|'; index_len++;
-		memcpy(report->index + index_len, record->data.server_name, record->data.server_name_len);
-		index_len += record->data.server_name_len;
+		memcpy(report->index + index_len, record->data.server_name->str, record->data.server_name->len);
+		index_len += record->data.server_name->len;
 		report->index[index_len] = '|'; index_len++;
 
 		for (k = 0; k < report->tags_cnt; k++) {
@@ -1346,15 +1346,15 @@ jump_ahead:
 				continue;
 			}
 
-			data->req_count = 1;
+			data->req_count = record->data.weight;
 			data->hit_count = timer->hit_count;
-			data->timer_value = timer->value;
+			data->timer_value = usec_to_timeval(timer->value);
 			data->prev_add_request_id = request_id;
 			data->prev_del_request_id = -1;
 
-			memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-			memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
-			memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+			memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+			memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
+			memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 			for (k = 0; k < report->tags_cnt; k++) {
 				word = report->words[k];
 				memcpy(data->tag_value + PINBA_TAG_VALUE_SIZE * k, word->str, word->len);
@@ -1364,15 +1364,15 @@ jump_ahead:
 			report->std.results_cnt++;
 		} else {
 			data->hit_count += timer->hit_count;
-			timeradd(&data->timer_value, &timer->value, &data->timer_value);
+			timeval_add_usec(&data->timer_value, timer->value);
 		}
-		timeradd(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-		timeradd(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, timer->value, timer->hit_count);
+		timeval_add_usec(&data->ru_utime_value, timer->ru_utime);
+		timeval_add_usec(&data->ru_stime_value, timer->ru_stime);
+		PINBA_UPDATE_HISTOGRAM_ADD_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 
 		/* count tag values only once per request */
 		if (request_id != data->prev_add_request_id) {
-			data->req_count++;
+			data->req_count += record->data.weight;
 			data->prev_add_request_id = request_id;
 		}
 	}
@@ -1391,7 +1391,7 @@ void pinba_update_tagN_report2_delete(size_t request_id, void *rep, const pinba_
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
-	script_map = pinba_map_get(report->results, record->data.script_name);
+	script_map = pinba_map_get(report->results, record->data.script_name->str);
 	if (UNLIKELY(!script_map)) {
 		return;
 	}
@@ -1406,8 +1406,8 @@ void pinba_update_tagN_report2_delete(size_t request_id, void *rep, const pinba_
 			int found = 0, tag_id = report->tag_id[h];
 
 			for (j = 0; j < timer->tag_num; j++) {
-				if (tag_id == timer->tag_ids[j]) {
-					report->words[h] = (pinba_word *)timer->tag_values[j];
+				if (tag_id == timer->tags[j].id) {
+					report->words[h] = timer->tags[j].value;
 					found_tags_cnt++;
 					if (found_tags_cnt == report->tags_cnt) {
 						goto jump_ahead;
@@ -1427,11 +1427,11 @@ void pinba_update_tagN_report2_delete(size_t request_id, void *rep, const pinba_
 
 jump_ahead:
 
-		memcpy(report->index, record->data.hostname, record->data.hostname_len);
-		index_len = record->data.hostname_len;
+		memcpy(report->index, record->data.hostname->str, record->data.hostname->len);
+		index_len = record->data.hostname->len;
 		report->index[index_len] = '|'; index_len++;
-		memcpy(report->index + index_len, record->data.server_name, record->data.server_name_len);
-		index_len += record->data.server_name_len;
+		memcpy(report->index + index_len, record->data.server_name->str, record->data.server_name->len);
+		index_len += record->data.server_name->len;
 		report->index[index_len] = '|'; index_len++;
 
 		for (k = 0; k < report->tags_cnt; k++) {
@@ -1449,14 +1449,14 @@ jump_ahead:
 		} else {
 			/* count tag values only once per request */
 			if (request_id != data->prev_del_request_id) {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				data->prev_del_request_id = request_id;
 			}
 
 			if (UNLIKELY(data->req_count == 0)) {
 				if (pinba_map_delete(script_map, report->index) < 0) {
 					pinba_map_destroy(script_map);
-					pinba_map_delete(report->results, record->data.script_name);
+					pinba_map_delete(report->results, record->data.script_name->str);
 					script_map = NULL;
 				}
 				pinba_lmap_destroy(data->histogram_data);
@@ -1466,10 +1466,10 @@ jump_ahead:
 				continue;
 			} else {
 				data->hit_count -= timer->hit_count;
-				timersub(&data->timer_value, &timer->value, &data->timer_value);
-				timersub(&data->ru_utime_value, &timer->ru_utime, &data->ru_utime_value);
-				timersub(&data->ru_stime_value, &timer->ru_stime, &data->ru_stime_value);
-				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, timer->value, timer->hit_count);
+				timeval_sub_usec(&data->timer_value, timer->value);
+				timeval_sub_usec(&data->ru_utime_value, timer->ru_utime);
+				timeval_sub_usec(&data->ru_stime_value, timer->ru_stime);
+				PINBA_UPDATE_HISTOGRAM_DEL_USEC(report, data->histogram_data, timer->value, timer->hit_count);
 			}
 		}
 	}
@@ -1512,13 +1512,13 @@ void pinba_update_rtag_info_add(size_t request_id, void *rep, const pinba_stats_
 	report->kbytes_total += record->data.doc_size;
 	report->memory_footprint += record->data.memory_footprint;
 
-	data->req_count++;
+	data->req_count += record->data.weight;
 	timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 	timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 	timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 	data->kbytes_total += record->data.doc_size;
 	data->memory_footprint += record->data.memory_footprint;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 }
 /* }}} */
 
@@ -1554,21 +1554,20 @@ void pinba_update_rtag_info_delete(size_t request_id, void *rep, const pinba_sta
 		report->kbytes_total -= record->data.doc_size;
 		report->memory_footprint -= record->data.memory_footprint;
 
-		data->req_count--;
-
-		if (UNLIKELY(data->req_count == 0)) {
+		if (UNLIKELY(data->req_count <= record->data.weight)) {
 			pinba_lmap_destroy(data->histogram_data);
 			free(data);
 			pinba_map_delete(report->results, word->str);
 			report->std.results_cnt--;
 			return;
 		} else {
+			data->req_count -= record->data.weight;
 			timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 			timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 			timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 			data->kbytes_total -= record->data.doc_size;
 			data->memory_footprint -= record->data.memory_footprint;
-			PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+			PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 		}
 	}
 }
@@ -1629,13 +1628,13 @@ void pinba_update_rtag2_info_add(size_t request_id, void *rep, const pinba_stats
 	report->kbytes_total += record->data.doc_size;
 	report->memory_footprint += record->data.memory_footprint;
 
-	data->req_count++;
+	data->req_count += record->data.weight;
 	timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 	timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 	timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 	data->kbytes_total += record->data.doc_size;
 	data->memory_footprint += record->data.memory_footprint;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 }
 /* }}} */
 
@@ -1683,21 +1682,20 @@ void pinba_update_rtag2_info_delete(size_t request_id, void *rep, const pinba_st
 		report->kbytes_total -= record->data.doc_size;
 		report->memory_footprint -= record->data.memory_footprint;
 
-		data->req_count--;
-
-		if (UNLIKELY(data->req_count == 0)) {
+		if (UNLIKELY(data->req_count <= record->data.weight)) {
 			pinba_lmap_destroy(data->histogram_data);
 			free(data);
 			pinba_map_delete(report->results, index_val);
 			report->std.results_cnt--;
 			return;
 		} else {
+			data->req_count -= record->data.weight;
 			timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 			timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 			timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 			data->kbytes_total -= record->data.doc_size;
 			data->memory_footprint -= record->data.memory_footprint;
-			PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+			PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 		}
 	}
 }
@@ -1774,13 +1772,13 @@ void pinba_update_rtagN_info_add(size_t request_id, void *rep, const pinba_stats
 	report->kbytes_total += record->data.doc_size;
 	report->memory_footprint += record->data.memory_footprint;
 
-	data->req_count++;
+	data->req_count += record->data.weight;
 	timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 	timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 	timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 	data->kbytes_total += record->data.doc_size;
 	data->memory_footprint += record->data.memory_footprint;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 }
 /* }}} */
 
@@ -1840,9 +1838,7 @@ void pinba_update_rtagN_info_delete(size_t request_id, void *rep, const pinba_st
 		report->kbytes_total -= record->data.doc_size;
 		report->memory_footprint -= record->data.memory_footprint;
 
-		data->req_count--;
-
-		if (UNLIKELY(data->req_count == 0)) {
+		if (UNLIKELY(data->req_count <= record->data.weight)) {
 			pinba_lmap_destroy(data->histogram_data);
 			free(data->tag_value);
 			free(data);
@@ -1850,12 +1846,13 @@ void pinba_update_rtagN_info_delete(size_t request_id, void *rep, const pinba_st
 			report->std.results_cnt--;
 			return;
 		} else {
+			data->req_count -= record->data.weight;
 			timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 			timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 			timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 			data->kbytes_total -= record->data.doc_size;
 			data->memory_footprint -= record->data.memory_footprint;
-			PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+			PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 		}
 	}
 }
@@ -1882,10 +1879,10 @@ void pinba_update_rtag_report_add(size_t request_id, void *rep, const pinba_stat
 
 	word = (pinba_word *)record->data.tag_values[i];
 
-	host_map = pinba_map_get(report->results, record->data.hostname);
+	host_map = pinba_map_get(report->results, record->data.hostname->str);
 	if (UNLIKELY(!host_map)) {
 		host_map = pinba_map_create();
-		report->results = pinba_map_add(report->results, record->data.hostname, host_map);
+		report->results = pinba_map_add(report->results, record->data.hostname->str, host_map);
 	}
 
 	data = (struct pinba_rtag_report_data *)pinba_map_get(host_map, word->str);
@@ -1897,7 +1894,7 @@ void pinba_update_rtag_report_add(size_t request_id, void *rep, const pinba_stat
 			return;
 		}
 
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
 		memcpy_static(data->tag_value, word->str, word->len, dummy);
 
 		pinba_map_add(host_map, word->str, data);
@@ -1910,13 +1907,13 @@ void pinba_update_rtag_report_add(size_t request_id, void *rep, const pinba_stat
 	report->kbytes_total += record->data.doc_size;
 	report->memory_footprint += record->data.memory_footprint;
 
-	data->req_count++;
+	data->req_count += record->data.weight;
 	timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 	timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 	timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 	data->kbytes_total += record->data.doc_size;
 	data->memory_footprint += record->data.memory_footprint;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 }
 /* }}} */
 
@@ -1930,7 +1927,7 @@ void pinba_update_rtag_report_delete(size_t request_id, void *rep, const pinba_s
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
-	host_map = pinba_map_get(report->results, record->data.hostname);
+	host_map = pinba_map_get(report->results, record->data.hostname->str);
 	if (UNLIKELY(!host_map)) {
 		return;
 	}
@@ -1958,23 +1955,22 @@ void pinba_update_rtag_report_delete(size_t request_id, void *rep, const pinba_s
 		report->kbytes_total -= record->data.doc_size;
 		report->memory_footprint -= record->data.memory_footprint;
 
-		data->req_count--;
-
-		if (UNLIKELY(data->req_count == 0)) {
+		if (UNLIKELY(data->req_count <= record->data.weight)) {
 			pinba_lmap_destroy(data->histogram_data);
 			free(data);
 			if (pinba_map_delete(host_map, word->str) < 0) {
 				pinba_map_destroy(host_map);
-				pinba_map_delete(report->results, record->data.hostname);
+				pinba_map_delete(report->results, record->data.hostname->str);
 			}
 			report->std.results_cnt--;
 		} else {
+			data->req_count -= record->data.weight;
 			timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 			timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 			timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 			data->kbytes_total -= record->data.doc_size;
 			data->memory_footprint -= record->data.memory_footprint;
-			PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+			PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 		}
 	}
 }
@@ -2013,10 +2009,10 @@ void pinba_update_rtag2_report_add(size_t request_id, void *rep, const pinba_sta
 	index_val[index_len] = '|'; index_len++;
 	memcat_static(index_val, index_len, word2->str, word2->len, index_len);
 
-	host_map = pinba_map_get(report->results, record->data.hostname);
+	host_map = pinba_map_get(report->results, record->data.hostname->str);
 	if (UNLIKELY(!host_map)) {
 		host_map = pinba_map_create();
-		report->results = pinba_map_add(report->results, record->data.hostname, host_map);
+		report->results = pinba_map_add(report->results, record->data.hostname->str, host_map);
 	}
 
 	data = (struct pinba_rtag2_report_data *)pinba_map_get(host_map, index_val);
@@ -2029,7 +2025,7 @@ void pinba_update_rtag2_report_add(size_t request_id, void *rep, const pinba_sta
 			return;
 		}
 
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
 		memcpy_static(data->tag1_value, word1->str, word1->len, dummy);
 		memcpy_static(data->tag2_value, word2->str, word2->len, dummy);
 
@@ -2043,13 +2039,13 @@ void pinba_update_rtag2_report_add(size_t request_id, void *rep, const pinba_sta
 	report->kbytes_total += record->data.doc_size;
 	report->memory_footprint += record->data.memory_footprint;
 
-	data->req_count++;
+	data->req_count += record->data.weight;
 	timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 	timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 	timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 	data->kbytes_total += record->data.doc_size;
 	data->memory_footprint += record->data.memory_footprint;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 }
 /* }}} */
 
@@ -2088,7 +2084,7 @@ void pinba_update_rtag2_report_delete(size_t request_id, void *rep, const pinba_
 	index_val[index_len] = '|'; index_len++;
 	memcat_static(index_val, index_len, word2->str, word2->len, index_len);
 
-	host_map = pinba_map_get(report->results, record->data.hostname);
+	host_map = pinba_map_get(report->results, record->data.hostname->str);
 	if (UNLIKELY(!host_map)) {
 		return;
 	}
@@ -2104,24 +2100,23 @@ void pinba_update_rtag2_report_delete(size_t request_id, void *rep, const pinba_
 		report->kbytes_total -= record->data.doc_size;
 		report->memory_footprint -= record->data.memory_footprint;
 
-		data->req_count--;
-
-		if (UNLIKELY(data->req_count == 0)) {
+		if (UNLIKELY(data->req_count <= record->data.weight)) {
 			pinba_lmap_destroy(data->histogram_data);
 			free(data);
 
 			if (pinba_map_delete(host_map, index_val) < 0) {
 				pinba_map_destroy(host_map);
-				pinba_map_delete(report->results, record->data.hostname);
+				pinba_map_delete(report->results, record->data.hostname->str);
 			}
 			report->std.results_cnt--;
 		} else {
+			data->req_count -= record->data.weight;
 			timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 			timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 			timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 			data->kbytes_total -= record->data.doc_size;
 			data->memory_footprint -= record->data.memory_footprint;
-			PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+			PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 		}
 	}
 }
@@ -2162,10 +2157,10 @@ void pinba_update_rtagN_report_add(size_t request_id, void *rep, const pinba_sta
 		return;
 	}
 
-	host_map = pinba_map_get(report->results, record->data.hostname);
+	host_map = pinba_map_get(report->results, record->data.hostname->str);
 	if (UNLIKELY(!host_map)) {
 		host_map = pinba_map_create();
-		report->results = pinba_map_add(report->results, record->data.hostname, host_map);
+		report->results = pinba_map_add(report->results, record->data.hostname->str, host_map);
 	}
 
 	index_len = 0;
@@ -2193,7 +2188,7 @@ void pinba_update_rtagN_report_add(size_t request_id, void *rep, const pinba_sta
 			return;
 		}
 
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
 
 		for (i = 0; i < report->tags_cnt; i++) {
 			word = report->values[i];
@@ -2210,13 +2205,13 @@ void pinba_update_rtagN_report_add(size_t request_id, void *rep, const pinba_sta
 	report->kbytes_total += record->data.doc_size;
 	report->memory_footprint += record->data.memory_footprint;
 
-	data->req_count++;
+	data->req_count += record->data.weight;
 	timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 	timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 	timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 	data->kbytes_total += record->data.doc_size;
 	data->memory_footprint += record->data.memory_footprint;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 }
 /* }}} */
 
@@ -2257,7 +2252,7 @@ void pinba_update_rtagN_report_delete(size_t request_id, void *rep, const pinba_
 		return;
 	}
 
-	host_map = pinba_map_get(report->results, record->data.hostname);
+	host_map = pinba_map_get(report->results, record->data.hostname->str);
 	if (UNLIKELY(!host_map)) {
 		return;
 	}
@@ -2282,25 +2277,24 @@ void pinba_update_rtagN_report_delete(size_t request_id, void *rep, const pinba_
 		report->kbytes_total -= record->data.doc_size;
 		report->memory_footprint -= record->data.memory_footprint;
 
-		data->req_count--;
-
-		if (UNLIKELY(data->req_count == 0)) {
+		if (UNLIKELY(data->req_count <= record->data.weight)) {
 			pinba_lmap_destroy(data->histogram_data);
 			free(data->tag_value);
 			free(data);
 
 			if (pinba_map_delete(host_map, report->index) < 0) {
 				pinba_map_destroy(host_map);
-				pinba_map_delete(report->results, record->data.hostname);
+				pinba_map_delete(report->results, record->data.hostname->str);
 			}
 			report->std.results_cnt--;
 		} else {
+			data->req_count -= record->data.weight;
 			timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 			timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 			timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 			data->kbytes_total -= record->data.doc_size;
 			data->memory_footprint -= record->data.memory_footprint;
-			PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+			PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 		}
 	}
 }
@@ -2367,6 +2361,12 @@ void pinba_std_report_dtor(void *rprt) /* {{{ */
 		pinba_lmap_destroy(std_report->histogram_data);
 	}
 
+	/* see pinba_parse_conditions() */
+	for (i = 0; i < std_report->cond.tags_cnt; i++) {
+		pinba_word_unref(std_report->cond.tag_names[i]);
+		pinba_word_unref(std_report->cond.tag_values[i]);
+	}
+
 	if (std_report->cond.tag_names) {
 		free(std_report->cond.tag_names);
 	}
@@ -2497,6 +2497,7 @@ void pinba_rtag_report_dtor(pinba_rtag_report *report, int lock) /* {{{ */
 {
 	char index[PINBA_MAX_LINE_LEN] = {0};
 	void *data;
+	unsigned int i;
 
 	if (lock) {
 		pthread_rwlock_wrlock(&D->rtag_reports_lock);
@@ -2536,6 +2537,9 @@ void pinba_rtag_report_dtor(pinba_rtag_report *report, int lock) /* {{{ */
 		free(report->index);
 	}
 
+	for (i = 0; i < report->tags_cnt; i++) {
+		pinba_word_unref(report->tags[i]);
+	}
 	free(report->tags);
 	free(report);
 }
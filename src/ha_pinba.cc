@@ -84,6 +84,14 @@ static int histogram_max_time_var = 0;
 static int histogram_size_var = 0;
 static int data_job_size_var = 0;
 static unsigned int log_level_var = P_ERROR | P_WARNING | P_NOTICE;
+static int reuseport_var = 0;
+static int udp_gro_var = 0;
+static int busy_poll_var = 0;
+static int stream_port_var = 0;
+static char *stream_socket_var = NULL;
+static int coalesce_requests_var = 0;
+static int harvest_fill_threshold_var = 0;
+static int numa_var = 0;
 
 /* global daemon struct, created once per process and used everywhere */
 pinba_daemon *D;
@@ -100,6 +108,7 @@ const char *type_names [] = /* {{{ */
 	"unknown",
 	"status",
 	"active_reports",
+	"collectors",
 	"request",
 	"timer",
 	"timertag",
@@ -205,6 +214,9 @@ static inline unsigned char pinba_get_table_type(char *str, size_t len, char *re
 			}
 			break;
 		case 10: /* sizeof("tag_report") - 1 */
+			if (!memcmp(str, "collectors", len)) {
+				table_type = PINBA_TABLE_COLLECTORS;
+			}
 			if (!memcmp(str, "rtag2_info", len)) {
 				*report_kind = PINBA_RTAG_REPORT_KIND;
 				table_type = PINBA_TABLE_RTAG2_INFO;
@@ -548,6 +560,9 @@ static inline int pinba_parse_conditions(PINBA_SHARE *share, pinba_std_report *r
 			report->cond.tag_names[report->cond.tags_cnt - 1] = pinba_dictionary_word_get_or_insert_rdlock(share->cond_names[i] + PINBA_TAG_PARAM_PREFIX_LEN, strlen(share->cond_names[i] + PINBA_TAG_PARAM_PREFIX_LEN));
 			report->cond.tag_values = (pinba_word **)realloc(report->cond.tag_values, report->cond.tags_cnt * sizeof(void *));
 			report->cond.tag_values[report->cond.tags_cnt - 1] = pinba_dictionary_word_get_or_insert_rdlock(share->cond_values[i], strlen(share->cond_values[i]));
+			/* released by pinba_std_report_dtor() */
+			pinba_word_ref(report->cond.tag_names[report->cond.tags_cnt - 1]);
+			pinba_word_ref(report->cond.tag_values[report->cond.tags_cnt - 1]);
 		}
 	}
 	pthread_rwlock_unlock(&D->words_lock);
@@ -555,6 +570,17 @@ static inline int pinba_parse_conditions(PINBA_SHARE *share, pinba_std_report *r
 }
 /* }}} */
 
+/* released by pinba_rtag_report_dtor(), the caller holds words_lock */
+static inline void pinba_rtag_report_words_ref(pinba_rtag_report *report) /* {{{ */
+{
+	unsigned int i;
+
+	for (i = 0; i < report->tags_cnt; i++) {
+		pinba_word_ref(report->tags[i]);
+	}
+}
+/* }}} */
+
 static inline float pinba_round(float num, int prec_index) /* {{{ */
 {
 	double fraction, integral;
@@ -601,6 +627,14 @@ static int pinba_engine_init(void *p) /* {{{ */
 	settings.port = port_var;
 	settings.address = address_var;
 	settings.cpu_start = cpu_start_var;
+	settings.reuseport = reuseport_var;
+	settings.udp_gro = udp_gro_var;
+	settings.busy_poll = busy_poll_var;
+	settings.stream_port = stream_port_var;
+	settings.stream_socket = stream_socket_var;
+	settings.coalesce_requests = coalesce_requests_var;
+	settings.harvest_fill_threshold = harvest_fill_threshold_var;
+	settings.numa = numa_var;
 
 	if (pinba_collector_init(settings) != P_SUCCESS) {
 		DBUG_RETURN(1);
@@ -1491,6 +1525,7 @@ static inline pinba_rtag_report *pinba_regenerate_rtag_info(PINBA_SHARE *share)
 		report->std.delete_func = pinba_update_rtag_info_delete;
 		pthread_rwlock_init(&report->std.lock, 0);
 
+		pinba_rtag_report_words_ref(report);
 		D->rtag_reports = pinba_map_add(D->rtag_reports, share->index, report);
 
 		if (pinba_array_add(&D->rtag_reports_arr, report) < 0) {
@@ -1549,11 +1584,12 @@ static inline pinba_rtag_report *pinba_regenerate_rtag2_info(PINBA_SHARE *share)
 		report->results = NULL;
 		report->tags[0] = word1;
 		report->tags[1] = word2;
-		report->tags_cnt = 1;
+		report->tags_cnt = 2;
 		report->std.add_func = pinba_update_rtag2_info_add;
 		report->std.delete_func = pinba_update_rtag2_info_delete;
 		pthread_rwlock_init(&report->std.lock, 0);
 
+		pinba_rtag_report_words_ref(report);
 		D->rtag_reports = pinba_map_add(D->rtag_reports, share->index, report);
 
 		if (pinba_array_add(&D->rtag_reports_arr, report) < 0) {
@@ -1632,6 +1668,7 @@ static inline pinba_rtag_report *pinba_regenerate_rtagN_info(PINBA_SHARE *share)
 
 		pthread_rwlock_init(&report->std.lock, 0);
 
+		pinba_rtag_report_words_ref(report);
 		D->rtag_reports = pinba_map_add(D->rtag_reports, share->index, report);
 
 		if (pinba_array_add(&D->rtag_reports_arr, report) < 0) {
@@ -1689,6 +1726,7 @@ static inline pinba_rtag_report *pinba_regenerate_rtag_report(PINBA_SHARE *share
 		report->std.delete_func = pinba_update_rtag_report_delete;
 		pthread_rwlock_init(&report->std.lock, 0);
 
+		pinba_rtag_report_words_ref(report);
 		D->rtag_reports = pinba_map_add(D->rtag_reports, share->index, report);
 
 		if (pinba_array_add(&D->rtag_reports_arr, report) < 0) {
@@ -1748,11 +1786,12 @@ static inline pinba_rtag_report *pinba_regenerate_rtag2_report(PINBA_SHARE *shar
 		report->results = NULL;
 		report->tags[0] = word1;
 		report->tags[1] = word2;
-		report->tags_cnt = 1;
+		report->tags_cnt = 2;
 		report->std.add_func = pinba_update_rtag2_report_add;
 		report->std.delete_func = pinba_update_rtag2_report_delete;
 		pthread_rwlock_init(&report->std.lock, 0);
 
+		pinba_rtag_report_words_ref(report);
 		D->rtag_reports = pinba_map_add(D->rtag_reports, share->index, report);
 
 		if (pinba_array_add(&D->rtag_reports_arr, report) < 0) {
@@ -1831,6 +1870,7 @@ static inline pinba_rtag_report *pinba_regenerate_rtagN_report(PINBA_SHARE *shar
 
 		pthread_rwlock_init(&report->std.lock, 0);
 
+		pinba_rtag_report_words_ref(report);
 		D->rtag_reports = pinba_map_add(D->rtag_reports, share->index, report);
 
 		if (pinba_array_add(&D->rtag_reports_arr, report) < 0) {
@@ -2258,7 +2298,7 @@ int ha_pinba::read_index_first(unsigned char *buf, uint active_index) /* {{{ */
 	int ret = HA_ERR_INTERNAL_ERROR;
 	size_t index_value = 0;
 	pinba_pool *p = &D->request_pool;
-	pinba_pool *timer_pool = &D->timer_pool;
+	pinba_timer_pool *timer_pool = &D->timer_pool;
 
 
 	if (active_index >= PINBA_MAX_KEYS) {
@@ -2804,7 +2844,7 @@ int ha_pinba::read_row_by_pos(unsigned char *buf, my_off_t position) /* {{{ */
 	DBUG_ENTER("ha_pinba::read_row_by_pos");
 	int ret = HA_ERR_INTERNAL_ERROR;
 	pinba_pool *p = &D->request_pool;
-	pinba_pool *timers = &D->timer_pool;
+	pinba_timer_pool *timers = &D->timer_pool;
 
 	switch(share->table_type) {
 		case PINBA_TABLE_REQUEST:
@@ -2815,11 +2855,7 @@ int ha_pinba::read_row_by_pos(unsigned char *buf, my_off_t position) /* {{{ */
 			}
 			break;
 		case PINBA_TABLE_TIMER:
-			if ((timers->out + position) < timers->size) {
-				ret = timers_fetch_row(buf, timers->out + position, NULL, 0);
-			} else {
-				ret = timers_fetch_row(buf, position - (timers->size - timers->out), NULL, 0);
-			}
+			ret = timers_fetch_row(buf, (timers->out + position) & PINBA_TIMER_ID_MASK, NULL, 0);
 			break;
 		default:
 			ret = HA_ERR_INTERNAL_ERROR;
@@ -2915,6 +2951,9 @@ int ha_pinba::read_next_row(unsigned char *buf, uint active_index, bool by_key)
 		case PINBA_TABLE_ACTIVE_REPORTS:
 			ret = active_reports_fetch_row(buf);
 			break;
+		case PINBA_TABLE_COLLECTORS:
+			ret = collectors_fetch_row(buf);
+			break;
 		case PINBA_TABLE_REPORT_INFO:
 			ret = info_fetch_row(buf);
 			break;
@@ -3253,7 +3292,7 @@ retry_again:
 					break;
 				case 1: /* hostname */
 					(*field)->set_notnull();
-					(*field)->store(record.data.hostname, strlen(record.data.hostname), &my_charset_bin);
+					(*field)->store(record.data.hostname->str, record.data.hostname->len, &my_charset_bin);
 					break;
 				case 2: /* req_count */
 					(*field)->set_notnull();
@@ -3261,11 +3300,11 @@ retry_again:
 					break;
 				case 3: /* server_name */
 					(*field)->set_notnull();
-					(*field)->store(record.data.server_name, strlen(record.data.server_name), &my_charset_bin);
+					(*field)->store(record.data.server_name->str, record.data.server_name->len, &my_charset_bin);
 					break;
 				case 4: /* script_name */
 					(*field)->set_notnull();
-					(*field)->store(record.data.script_name, strlen(record.data.script_name), &my_charset_bin);
+					(*field)->store(record.data.script_name->str, record.data.script_name->len, &my_charset_bin);
 					break;
 				case 5: /* doc_size */
 					(*field)->set_notnull();
@@ -3300,9 +3339,9 @@ retry_again:
 					(*field)->store(pinba_round((float)record.data.memory_footprint, 1000));
 					break;
 				case 13: /* schema */
-					if (record.data.schema_len) {
+					if (record.data.schema->len) {
 						(*field)->set_notnull();
-						(*field)->store(record.data.schema, strlen(record.data.schema), &my_charset_bin);
+						(*field)->store(record.data.schema->str, record.data.schema->len, &my_charset_bin);
 					}
 					break;
 				case 14: /* tags_cnt */
@@ -3340,7 +3379,7 @@ retry_again:
 	dbug_tmp_restore_column_map(table->write_set, old_map);
 
 	if (new_index) {
-		*new_index = index + 1;
+		*new_index = (index + 1) & PINBA_TIMER_ID_MASK;
 	}
 	pthread_rwlock_unlock(&D->collector_lock);
 	DBUG_RETURN(0);
@@ -3352,7 +3391,7 @@ inline int ha_pinba::timers_fetch_row(unsigned char *buf, size_t index, size_t *
 	Field **field;
 	my_bitmap_map *old_map;
 	pinba_pool *p = &D->request_pool;
-	pinba_pool *timer_pool = &D->timer_pool;
+	pinba_timer_pool *timer_pool = &D->timer_pool;
 	pinba_timer_record *timer;
 	pinba_stats_record record;
 
@@ -3370,19 +3409,15 @@ inline int ha_pinba::timers_fetch_row(unsigned char *buf, size_t index, size_t *
 
 try_next:
 
-	if (index == (timer_pool->size - 1)) {
-		index = 0;
-	}
-
-	if (index == timer_pool->in || index >= (unsigned int)timer_pool->size) {
+	if (!pinba_timer_pool_has_id(timer_pool, index)) {
 		pthread_rwlock_unlock(&D->collector_lock);
 		DBUG_RETURN(HA_ERR_KEY_NOT_FOUND);
 	}
 
-	timer = TIMER_POOL(timer_pool) + index;
+	timer = TIMER_POOL_GET(timer_pool, index);
 
 	if (!exact && REQ_POOL(p)[timer->request_id].time.tv_sec == 0) {
-		index++;
+		index = (index + 1) & PINBA_TIMER_ID_MASK;
 		goto try_next;
 	}
 
@@ -3415,7 +3450,7 @@ try_next:
 					break;
 				case 3: /* value */
 					(*field)->set_notnull();
-					(*field)->store(timeval_to_float(timer->value));
+					(*field)->store(usec_to_float(timer->value));
 					break;
 				default:
 					(*field)->set_null();
@@ -3469,7 +3504,7 @@ inline int ha_pinba::timers_fetch_row_by_request_id(unsigned char *buf, size_t i
 			switch((*field)->field_index) {
 				case 0: /* index */
 					(*field)->set_notnull();
-					(*field)->store((long)timer->index);
+					(*field)->store((long)record_get_timer_id(&D->timer_pool, record, this_index[active_index].position));
 					break;
 				case 1: /* request_id */
 					(*field)->set_notnull();
@@ -3481,7 +3516,7 @@ inline int ha_pinba::timers_fetch_row_by_request_id(unsigned char *buf, size_t i
 					break;
 				case 3: /* value */
 					(*field)->set_notnull();
-					(*field)->store(timeval_to_float(timer->value));
+					(*field)->store(usec_to_float(timer->value));
 					break;
 				default:
 					(*field)->set_null();
@@ -3596,7 +3631,7 @@ inline int ha_pinba::tag_values_fetch_next(unsigned char *buf, size_t *index, si
 {
 	Field **field;
 	my_bitmap_map *old_map;
-	pinba_pool *timer_pool = &D->timer_pool;
+	pinba_timer_pool *timer_pool = &D->timer_pool;
 	pinba_pool *p = &D->request_pool;
 	pinba_timer_record *timer;
 	pinba_stats_record *record;
@@ -3615,29 +3650,25 @@ retry_next:
 		(*position) = 0;
 	}
 
-	if (*index == (timer_pool->size - 1)) {
-		*index = 0;
-	}
-
-	if (*index == timer_pool->in || *index >= (unsigned int)timer_pool->size || timer_pool->in == timer_pool->out) {
+	if (!pinba_timer_pool_has_id(timer_pool, *index)) {
 		pthread_rwlock_unlock(&D->collector_lock);
 		DBUG_RETURN(HA_ERR_KEY_NOT_FOUND);
 	}
 
-	timer = TIMER_POOL(timer_pool) + *index;
+	timer = TIMER_POOL_GET(timer_pool, *index);
 
 	record = REQ_POOL(p) + timer->request_id;
 
 	/* XXX */
 	if (timer->num_in_request >= record->timers_cnt) {
 		(*position) = 0;
-		(*index)++;
+		*index = (*index + 1) & PINBA_TIMER_ID_MASK;
 		goto retry_next;
 	}
 
 	if ((*position) >= timer->tag_num) {
 		(*position) = 0;
-		(*index)++;
+		*index = (*index + 1) & PINBA_TIMER_ID_MASK;
 		goto retry_next;
 	}
 
@@ -3648,15 +3679,15 @@ retry_next:
 			switch((*field)->field_index) {
 				case 0: /* timer_id */
 					(*field)->set_notnull();
-					(*field)->store((long)timer->index);
+					(*field)->store((long)*index);
 					break;
 				case 1: /* tad_id */
 					(*field)->set_notnull();
-					(*field)->store((long)timer->tag_ids[*position]);
+					(*field)->store((long)timer->tags[*position].id);
 					break;
 				case 2: /* name */
 					(*field)->set_notnull();
-					(*field)->store(timer->tag_values[*position]->str, timer->tag_values[*position]->len, &my_charset_bin);
+					(*field)->store(timer->tags[*position].value->str, timer->tags[*position].value->len, &my_charset_bin);
 					break;
 				default:
 					(*field)->set_null();
@@ -3675,7 +3706,7 @@ inline int ha_pinba::tag_values_fetch_by_timer_id(unsigned char *buf) /* {{{ */
 {
 	Field **field;
 	my_bitmap_map *old_map;
-	pinba_pool *timer_pool = &D->timer_pool;
+	pinba_timer_pool *timer_pool = &D->timer_pool;
 	pinba_pool *p = &D->request_pool;
 	pinba_timer_record *timer;
 	pinba_stats_record *record;
@@ -3684,16 +3715,12 @@ inline int ha_pinba::tag_values_fetch_by_timer_id(unsigned char *buf) /* {{{ */
 
 	pthread_rwlock_rdlock(&D->collector_lock);
 
-	if (this_index[0].ival == (timer_pool->size - 1)) {
-		this_index[0].ival = 0;
-	}
-
-	if (this_index[0].ival == timer_pool->in || this_index[0].ival >= (unsigned int)timer_pool->size || timer_pool->in == timer_pool->out) {
+	if (!pinba_timer_pool_has_id(timer_pool, this_index[0].ival)) {
 		pthread_rwlock_unlock(&D->collector_lock);
 		DBUG_RETURN(HA_ERR_KEY_NOT_FOUND);
 	}
 
-	timer = TIMER_POOL(timer_pool) + this_index[0].ival;
+	timer = TIMER_POOL_GET(timer_pool, this_index[0].ival);
 
 	if (timer->tag_num == 0) {
 		pthread_rwlock_unlock(&D->collector_lock);
@@ -3714,15 +3741,15 @@ inline int ha_pinba::tag_values_fetch_by_timer_id(unsigned char *buf) /* {{{ */
 			switch((*field)->field_index) {
 				case 0: /* timer_id */
 					(*field)->set_notnull();
-					(*field)->store((long)timer->index);
+					(*field)->store((long)this_index[0].ival);
 					break;
 				case 1: /* tag_id */
 					(*field)->set_notnull();
-					(*field)->store((long)timer->tag_ids[this_index[0].position]);
+					(*field)->store((long)timer->tags[this_index[0].position].id);
 					break;
 				case 2: /* name */
 					(*field)->set_notnull();
-					(*field)->store(timer->tag_values[this_index[0].position]->str, timer->tag_values[this_index[0].position]->len, &my_charset_bin);
+					(*field)->store(timer->tags[this_index[0].position].value->str, timer->tags[this_index[0].position].value->len, &my_charset_bin);
 					break;
 				default:
 					(*field)->set_null();
@@ -5692,6 +5719,78 @@ inline int ha_pinba::status_fetch_row(unsigned char *buf) /* {{{ */
 					(*field)->store((long)pinba_map_count(D->dictionary));
 					pthread_rwlock_unlock(&D->words_lock);
 					break;
+				case 7: /* ring_occupancy */
+					(*field)->set_notnull();
+					pthread_rwlock_rdlock(&D->stats_lock);
+					(*field)->store((long)D->stats.ring_occupancy);
+					pthread_rwlock_unlock(&D->stats_lock);
+					break;
+				case 8: /* ring_drops */
+					(*field)->set_notnull();
+					pthread_rwlock_rdlock(&D->stats_lock);
+					(*field)->store((long)D->stats.ring_drops);
+					pthread_rwlock_unlock(&D->stats_lock);
+					break;
+				case 9: /* coalesced_requests */
+					(*field)->set_notnull();
+					pthread_rwlock_rdlock(&D->stats_lock);
+					(*field)->store((long)D->stats.coalesced_requests);
+					pthread_rwlock_unlock(&D->stats_lock);
+					break;
+				case 10: /* harvest_latency */
+					(*field)->set_notnull();
+					pthread_rwlock_rdlock(&D->stats_lock);
+					(*field)->store((long)D->stats.harvest_latency);
+					pthread_rwlock_unlock(&D->stats_lock);
+					break;
+				case 11: /* tmp_pool_high_water */
+					(*field)->set_notnull();
+					pthread_rwlock_rdlock(&D->stats_lock);
+					(*field)->store((long)D->stats.tmp_pool_high_water);
+					pthread_rwlock_unlock(&D->stats_lock);
+					break;
+				case 12: /* early_harvests */
+					(*field)->set_notnull();
+					pthread_rwlock_rdlock(&D->stats_lock);
+					(*field)->store((long)D->stats.early_harvests);
+					pthread_rwlock_unlock(&D->stats_lock);
+					break;
+				case 13: /* arena_memory */
+					(*field)->set_notnull();
+					pthread_rwlock_rdlock(&D->stats_lock);
+					(*field)->store((long)D->stats.arena_memory);
+					pthread_rwlock_unlock(&D->stats_lock);
+					break;
+				case 14: /* arena_memory_peak */
+					(*field)->set_notnull();
+					pthread_rwlock_rdlock(&D->stats_lock);
+					(*field)->store((long)D->stats.arena_memory_peak);
+					pthread_rwlock_unlock(&D->stats_lock);
+					break;
+				case 15: /* arena_memory_freed */
+					(*field)->set_notnull();
+					pthread_rwlock_rdlock(&D->stats_lock);
+					(*field)->store((long)D->stats.arena_memory_freed);
+					pthread_rwlock_unlock(&D->stats_lock);
+					break;
+				case 16: /* dictionary_memory */
+					(*field)->set_notnull();
+					pthread_rwlock_rdlock(&D->words_lock);
+					(*field)->store((long)(D->words_arena.allocated + pinba_map_count(D->dictionary) * sizeof(pinba_word)));
+					pthread_rwlock_unlock(&D->words_lock);
+					break;
+				case 17: /* dictionary_words_freed */
+					(*field)->set_notnull();
+					pthread_rwlock_rdlock(&D->stats_lock);
+					(*field)->store((long)D->stats.dictionary_words_freed);
+					pthread_rwlock_unlock(&D->stats_lock);
+					break;
+				case 18: /* lost_timers */
+					(*field)->set_notnull();
+					pthread_rwlock_rdlock(&D->stats_lock);
+					(*field)->store((long)D->stats.lost_timers);
+					pthread_rwlock_unlock(&D->stats_lock);
+					break;
 			}
 		}
 	}
@@ -5881,6 +5980,84 @@ repeat_with_next_report:
 }
 /* }}} */
 
+inline int ha_pinba::collectors_fetch_row(unsigned char *buf) /* {{{ */
+{
+	Field **field;
+	my_bitmap_map *old_map;
+	pinba_collector_queue *q;
+	size_t n;
+	const char *type;
+
+	DBUG_ENTER("ha_pinba::collectors_fetch_row");
+
+	n = this_index[0].position;
+	if (n >= D->collector_queues_cnt) {
+		DBUG_RETURN(HA_ERR_END_OF_FILE);
+	}
+
+	this_index[0].position++;
+
+	/* the collector threads go first, the stream listener is the last one */
+	q = D->collector_queues + n;
+	type = (D->stream && n == D->collector_queues_cnt - 1) ? "stream" : "udp";
+
+	old_map = dbug_tmp_use_all_columns(table, table->write_set);
+
+	for (field = table->field; *field; field++) {
+		if (bitmap_is_set(table->read_set, (*field)->field_index)) {
+			(*field)->set_notnull();
+			switch((*field)->field_index) {
+				case 0: /* thread */
+					(*field)->store((long)n);
+					break;
+				case 1: /* type */
+					(*field)->store(type, strlen(type), &my_charset_bin);
+					break;
+				case 2: /* packets */
+					(*field)->store((long)__atomic_load_n(&q->packets, __ATOMIC_RELAXED));
+					break;
+				case 3: /* ring_occupancy */
+					(*field)->store((long)__atomic_load_n(&q->ring_occupancy, __ATOMIC_RELAXED));
+					break;
+				case 4: /* ring_drops */
+					(*field)->store((long)__atomic_load_n(&q->drops, __ATOMIC_RELAXED));
+					break;
+				case 5: /* kernel_drops */
+					(*field)->store((long)__atomic_load_n(&q->kernel_drops, __ATOMIC_RELAXED));
+					break;
+				case 6: /* rcvbuf_used */
+					(*field)->store((long)__atomic_load_n(&q->rcvbuf_used, __ATOMIC_RELAXED));
+					break;
+				case 7: /* rcvbuf_size */
+					(*field)->store((long)__atomic_load_n(&q->rcvbuf_size, __ATOMIC_RELAXED));
+					break;
+				case 8: /* invalid_packets */
+					(*field)->store((long)__atomic_load_n(&q->invalid_packets, __ATOMIC_RELAXED));
+					break;
+				case 9: /* invalid_request_data */
+					(*field)->store((long)__atomic_load_n(&q->invalid_request_data, __ATOMIC_RELAXED));
+					break;
+				case 10: /* busy_polls */
+					(*field)->store((long)__atomic_load_n(&q->busy_polls, __ATOMIC_RELAXED));
+					break;
+				case 11: /* cpu_time */
+					(*field)->store((long)__atomic_load_n(&q->cpu_time, __ATOMIC_RELAXED));
+					break;
+				case 12: /* recv_delay */
+					{
+						size_t cnt = __atomic_load_n(&q->recv_delay_cnt, __ATOMIC_RELAXED);
+
+						(*field)->store(cnt ? (double)__atomic_load_n(&q->recv_delay, __ATOMIC_RELAXED) / cnt : 0.0);
+					}
+					break;
+			}
+		}
+	}
+	dbug_tmp_restore_column_map(table->write_set, old_map);
+	DBUG_RETURN(0);
+}
+/* }}} */
+
 #define TAG_INFO_FETCH_TOP_BLOCK(report_name, kind)						\
 	Field **field;														\
 	my_bitmap_map *old_map;												\
@@ -8346,6 +8523,7 @@ int ha_pinba::create(const char *name, TABLE *table_arg, HA_CREATE_INFO *create_
 
 int ha_pinba::delete_all_rows() /* {{{ */
 {
+	int numa_node;
 	DBUG_ENTER("ha_example::delete_all_rows");
 
 	switch (share->table_type) {
@@ -8358,8 +8536,10 @@ int ha_pinba::delete_all_rows() /* {{{ */
 
 	pthread_rwlock_wrlock(&D->collector_lock);
 	/* destroy & reinitialize the request pool */
+	numa_node = D->request_pool.numa_node;
 	pinba_pool_destroy(&D->request_pool);
 	pinba_pool_init(&D->request_pool, D->request_pool.size, D->request_pool.element_size, 0, 0, D->request_pool.dtor, (char *)"request pool");
+	pinba_pool_set_numa_node(&D->request_pool, numa_node);
 	pthread_rwlock_unlock(&D->collector_lock);
 
 	DBUG_RETURN(0);
@@ -8466,7 +8646,7 @@ int ha_pinba::info(uint flag) /* {{{ */
 			break;
 		case PINBA_TABLE_TIMER:
 			pthread_rwlock_rdlock(&D->collector_lock);
-			stats.records = pinba_pool_num_records(&D->timer_pool);
+			stats.records = pinba_timer_pool_num_records(&D->timer_pool);
 			pthread_rwlock_unlock(&D->collector_lock);
 			break;
 		case PINBA_TABLE_TAG:
@@ -8776,6 +8956,91 @@ static MYSQL_SYSVAR_UINT(log_level,
   INT_MAX,
   0);
 
+static MYSQL_SYSVAR_INT(reuseport,
+  reuseport_var,
+  PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+  "Open a separate SO_REUSEPORT socket for each collector thread",
+  NULL,
+  NULL,
+  0,
+  0,
+  1,
+  0);
+
+static MYSQL_SYSVAR_INT(udp_gro,
+  udp_gro_var,
+  PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+  "Enable UDP GRO on the collector sockets to receive coalesced datagrams",
+  NULL,
+  NULL,
+  0,
+  0,
+  1,
+  0);
+
+static MYSQL_SYSVAR_INT(busy_poll,
+  busy_poll_var,
+  PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+  "Busy poll the collector sockets for this many microseconds after each batch before blocking again (0 to disable)",
+  NULL,
+  NULL,
+  0,
+  0,
+  1000000,
+  0);
+
+static MYSQL_SYSVAR_INT(stream_port,
+  stream_port_var,
+  PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+  "TCP port to accept length-prefixed request streams at (0 to disable)",
+  NULL,
+  NULL,
+  0,
+  0,
+  65535,
+  0);
+
+static MYSQL_SYSVAR_STR(stream_socket,
+  stream_socket_var,
+  PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+  "Unix socket path to accept length-prefixed request streams at (leave it empty to disable)",
+  NULL,
+  NULL,
+  NULL);
+
+static MYSQL_SYSVAR_INT(coalesce_requests,
+  coalesce_requests_var,
+  PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+  "Merge the identical requests without timers received in one harvester cycle into one weighted record (the histograms get their average time)",
+  NULL,
+  NULL,
+  0,
+  0,
+  1,
+  0);
+
+static MYSQL_SYSVAR_INT(harvest_fill_threshold,
+  harvest_fill_threshold_var,
+  PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+  "Start a harvest before the end of the gathering period when a collector ring is this many percent full, and harvest less often when idle (0 to always use the fixed period)",
+  NULL,
+  NULL,
+  0,
+  0,
+  100,
+  0);
+
+static MYSQL_SYSVAR_INT(numa,
+  numa_var,
+  PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+  "Pin the threads node by node and keep the per-thread pools on their threads' NUMA nodes, the request and timer pools are interleaved between the nodes",
+  NULL,
+  NULL,
+  0,
+  0,
+  1,
+  0);
+
 
 static struct st_mysql_sys_var* system_variables[]= {
 	MYSQL_SYSVAR(port),
@@ -8792,6 +9057,14 @@ static struct st_mysql_sys_var* system_variables[]= {
 	MYSQL_SYSVAR(histogram_size),
 	MYSQL_SYSVAR(data_job_size),
 	MYSQL_SYSVAR(log_level),
+	MYSQL_SYSVAR(reuseport),
+	MYSQL_SYSVAR(udp_gro),
+	MYSQL_SYSVAR(busy_poll),
+	MYSQL_SYSVAR(stream_port),
+	MYSQL_SYSVAR(stream_socket),
+	MYSQL_SYSVAR(coalesce_requests),
+	MYSQL_SYSVAR(harvest_fill_threshold),
+	MYSQL_SYSVAR(numa),
 	NULL
 };
 /* }}} */
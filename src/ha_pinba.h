@@ -135,6 +135,7 @@ class ha_pinba: public handler
 	inline int rtagN_report_fetch_row_by_host(unsigned char *buf, const char *name, uint name_len);
 
 	inline int active_reports_fetch_row(unsigned char *buf);
+	inline int collectors_fetch_row(unsigned char *buf);
 
 	public:
 	ha_pinba(handlerton *hton, TABLE_SHARE *table_arg);
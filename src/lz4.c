@@ -0,0 +1,108 @@
+/*
+   LZ4 block format decoder.
+   See lz4.h and https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+
+   A block is a sequence of sequences:
+     token (4 bits of literal length, 4 bits of match length),
+     [literal length continuation bytes], literals,
+     2 bytes little-endian match offset, [match length continuation bytes]
+   The last sequence contains literals only.
+*/
+
+#include <string.h>
+#include "lz4.h"
+
+#define LZ4_MINMATCH 4
+#define LZ4_RUN_MASK 15
+
+static int lz4_read_length(const unsigned char **ip, const unsigned char *iend, size_t *length) /* {{{ */
+{
+	unsigned int s;
+
+	do {
+		if (*ip >= iend) {
+			return -1;
+		}
+		s = *(*ip)++;
+		*length += s;
+	} while (s == 255);
+	return 0;
+}
+/* }}} */
+
+int LZ4_decompress_safe(const char *src, char *dst, int compressedSize, int dstCapacity) /* {{{ */
+{
+	const unsigned char *ip = (const unsigned char *)src;
+	const unsigned char *iend = ip + compressedSize;
+	unsigned char *op = (unsigned char *)dst;
+	unsigned char *oend = op + dstCapacity;
+	const unsigned char *match;
+	unsigned int token;
+	size_t length, offset;
+
+	if (compressedSize <= 0 || dstCapacity < 0) {
+		return -1;
+	}
+
+	for (;;) {
+		token = *ip++;
+
+		/* literals */
+		length = token >> 4;
+		if (length == LZ4_RUN_MASK && lz4_read_length(&ip, iend, &length) < 0) {
+			return -1;
+		}
+
+		if (length > (size_t)(iend - ip) || length > (size_t)(oend - op)) {
+			return -1;
+		}
+
+		memcpy(op, ip, length);
+		op += length;
+		ip += length;
+
+		if (ip == iend) {
+			/* the last sequence has no match part */
+			break;
+		}
+
+		/* match */
+		if (iend - ip < 2) {
+			return -1;
+		}
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		if (offset == 0 || offset > (size_t)(op - (unsigned char *)dst)) {
+			return -1;
+		}
+
+		length = token & LZ4_RUN_MASK;
+		if (length == LZ4_RUN_MASK && lz4_read_length(&ip, iend, &length) < 0) {
+			return -1;
+		}
+		length += LZ4_MINMATCH;
+
+		if (length > (size_t)(oend - op)) {
+			return -1;
+		}
+
+		match = op - offset;
+		if (offset >= length) {
+			memcpy(op, match, length);
+			op += length;
+		} else {
+			/* overlapping match, copy byte by byte to repeat the pattern */
+			while (length--) {
+				*op++ = *match++;
+			}
+		}
+
+		if (ip >= iend) {
+			/* a block must end with literals */
+			return -1;
+		}
+	}
+	return (int)(op - (unsigned char *)dst);
+}
+/* }}} */
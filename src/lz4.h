@@ -0,0 +1,26 @@
+/*
+   LZ4 block format decoder.
+
+   Only the decompression side of the LZ4 block format is needed by the engine
+   (compression is done by the senders/relays), so this is a small standalone
+   decoder instead of the whole reference library.
+   LZ4_decompress_safe() follows the signature and the return convention of the
+   reference implementation (https://github.com/lz4/lz4), so the two can be swapped.
+*/
+
+#pragma once
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Decompresses compressedSize bytes of a raw LZ4 block from src into dst.
+ * Never reads beyond src + compressedSize and never writes beyond dst + dstCapacity.
+ * Returns the number of bytes written into dst or a negative value if the input is malformed.
+ */
+int LZ4_decompress_safe(const char *src, char *dst, int compressedSize, int dstCapacity);
+
+#if defined (__cplusplus)
+}
+#endif
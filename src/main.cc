@@ -18,8 +18,19 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#ifdef __linux__
+# include <linux/sock_diag.h>
+#endif
+#ifdef PINBA_ENGINE_HAVE_LIBNUMA
+# include <numa.h>
+#endif
 #include "pinba_map.h"
 #include "pinba_lmap.h"
+#include "pinba_envelope.h"
 
 #ifdef PINBA_ENGINE_HAVE_PTHREAD_SETAFFINITY_NP
 # ifdef __FreeBSD__
@@ -54,8 +65,10 @@ static struct pinba_version_info version_info[] __attribute__((used)) = {
 
 struct timeval null_timeval = {0, 0};
 static pthread_t data_thread;
+static pthread_t reports_thread;
 static pthread_t *collector_threads;
 static pthread_t stats_thread;
+static pthread_t stream_thread;
 
 int pinba_get_time_interval(pinba_std_report *report) /* {{{ */
 {
@@ -93,6 +106,163 @@ int pinba_get_processors_number(void) /* {{{ */
 }
 /* }}} */
 
+static void pinba_numa_init(int cpu_cnt, size_t workers_cnt) /* {{{ */
+{
+#if defined(PINBA_ENGINE_HAVE_LIBNUMA) && defined(PINBA_ENGINE_HAVE_PTHREAD_SETAFFINITY_NP)
+	int node, max_node, cpu, n = 0, nodes = 0;
+	int *cpu_nodes;
+	size_t i;
+
+	if (numa_available() < 0) {
+		pinba_error(P_WARNING, "NUMA is not available on this system, running in the usual mode");
+		return;
+	}
+
+	max_node = numa_max_node();
+	if (max_node < 1) {
+		/* a single node, nothing to place */
+		return;
+	}
+
+	if (max_node >= (int)(sizeof(unsigned long) * 8)) {
+		pinba_error(P_WARNING, "too many NUMA nodes (%d), running in the usual mode", max_node + 1);
+		return;
+	}
+
+	D->numa_cpus = (int *)malloc(sizeof(int) * cpu_cnt);
+	D->worker_nodes = (int *)malloc(sizeof(int) * workers_cnt);
+	cpu_nodes = (int *)malloc(sizeof(int) * cpu_cnt);
+	if (!D->numa_cpus || !D->worker_nodes || !cpu_nodes) {
+		pinba_error(P_WARNING, "out of memory, running in the usual mode");
+		goto cleanup;
+	}
+
+	/* the CPUs of node 0 first, then node 1 etc., so that the threads next to each other share a node */
+	for (node = 0; node <= max_node; node++) {
+		int found = 0;
+
+		for (cpu = 0; cpu < cpu_cnt; cpu++) {
+			if (numa_node_of_cpu(cpu) == node) {
+				cpu_nodes[n] = node;
+				D->numa_cpus[n++] = cpu;
+				found = 1;
+			}
+		}
+
+		if (found) {
+			D->numa_nodemask |= 1UL << node;
+			nodes++;
+		}
+	}
+
+	if (n != cpu_cnt || nodes < 2) {
+		/* some CPUs are offline or the node of a CPU is unknown */
+		D->numa_nodemask = 0;
+		goto cleanup;
+	}
+
+	for (i = 0; i < workers_cnt; i++) {
+		D->worker_nodes[i] = cpu_nodes[i % cpu_cnt];
+	}
+	free(cpu_nodes);
+
+	pinba_error(P_NOTICE, "NUMA-aware mode: %d CPUs on %d nodes", cpu_cnt, nodes);
+	return;
+
+cleanup:
+	free(cpu_nodes);
+	free(D->numa_cpus);
+	free(D->worker_nodes);
+	D->numa_cpus = NULL;
+	D->worker_nodes = NULL;
+#else
+	pinba_error(P_WARNING, "NUMA-aware mode is not supported on this platform, running in the usual mode");
+#endif
+}
+/* }}} */
+
+static int pinba_collector_timeout(void) /* {{{ */
+{
+	int timeout;
+
+	/* half of the gathering period, so that idle threads hand over their data in time for the next harvest */
+	timeout = D->settings.stats_gathering_period / 2;
+	if (timeout < PINBA_COLLECTOR_MIN_TIMEOUT) {
+		timeout = PINBA_COLLECTOR_MIN_TIMEOUT;
+	}
+	return timeout;
+}
+/* }}} */
+
+static int pinba_harvest_slot_init(pinba_harvest_slot *slot, size_t slot_num, size_t jobs_cnt) /* {{{ */
+{
+	size_t i;
+
+	slot->queues = (pinba_harvest_queue *)calloc(D->collector_queues_cnt, sizeof(pinba_harvest_queue));
+	slot->blocks = (pinba_harvest_block *)calloc(D->collector_queues_cnt * PINBA_DATA_RING_SIZE, sizeof(pinba_harvest_block));
+	slot->tmp_pools = (pinba_pool *)calloc(jobs_cnt, sizeof(pinba_pool));
+	slot->arenas = (pinba_arena *)calloc(jobs_cnt, sizeof(pinba_arena));
+	if (!slot->queues || !slot->blocks || !slot->tmp_pools || !slot->arenas) {
+		pinba_error(P_ERROR, "failed to allocate harvester slot. not enough memory?");
+		return P_FAILURE;
+	}
+
+	for (i = 0; i < D->collector_queues_cnt; i++) {
+		/* a slot can't take more blocks than a collector thread may allocate */
+		slot->queues[i].blocks = (pinba_data_block **)calloc(PINBA_DATA_RING_SIZE, sizeof(pinba_data_block *));
+		if (!slot->queues[i].blocks) {
+			pinba_error(P_ERROR, "failed to allocate harvester slot. not enough memory?");
+			return P_FAILURE;
+		}
+	}
+
+	for (i = 0; i < jobs_cnt; i++) {
+		char name[PINBA_POOL_NAME_SIZE];
+
+		/* decoded requests are allocated from the arenas, so the tmp pools don't need to free them */
+		if (pinba_arena_init(slot->arenas + i, PINBA_ARENA_CHUNK_SIZE) != P_SUCCESS) {
+			return P_FAILURE;
+		}
+
+		sprintf(name, "per_thread_tmp_pool[%zd][%zd]", slot_num, i);
+		if (pinba_pool_init(slot->tmp_pools + i, D->settings.temp_pool_size, sizeof(pinba_stats_record_ex), D->settings.temp_pool_size_limit, 0, pinba_per_thread_tmp_pool_dtor, name) != P_SUCCESS) {
+			return P_FAILURE;
+		}
+
+		if (D->worker_nodes) {
+			/* tmp pool i and arena i are used by worker i only, see data_decode_range_func(); the other arena chunks
+			   are allocated by the worker itself, so they are on its node anyway */
+			pinba_pool_set_numa_node(slot->tmp_pools + i, D->worker_nodes[i]);
+			pinba_numa_bind(slot->arenas[i].head, sizeof(pinba_arena_chunk) + slot->arenas[i].head->size, D->worker_nodes[i]);
+		}
+	}
+	return P_SUCCESS;
+}
+/* }}} */
+
+static void pinba_harvest_slot_destroy(pinba_harvest_slot *slot, size_t jobs_cnt) /* {{{ */
+{
+	size_t i, j;
+
+	for (i = 0; i < D->collector_queues_cnt; i++) {
+		/* the reports stage might have not got to the slot before the shutdown */
+		for (j = 0; j < slot->queues[i].blocks_cnt; j++) {
+			free(slot->queues[i].blocks[j]);
+		}
+		free(slot->queues[i].blocks);
+	}
+
+	for (i = 0; i < jobs_cnt; i++) {
+		pinba_pool_destroy(slot->tmp_pools + i);
+		pinba_arena_destroy(slot->arenas + i);
+	}
+	free(slot->queues);
+	free(slot->blocks);
+	free(slot->tmp_pools);
+	free(slot->arenas);
+}
+/* }}} */
+
 int pinba_collector_init(pinba_daemon_settings settings) /* {{{ */
 {
 	size_t i;
@@ -132,18 +302,21 @@ int pinba_collector_init(pinba_daemon_settings settings) /* {{{ */
 	pthread_rwlock_init(&D->data_lock, &attr);
 	pthread_rwlock_init(&D->words_lock, &attr);
 
+	if (pinba_arena_init(&D->words_arena, PINBA_DICTIONARY_ARENA_CHUNK_SIZE) != P_SUCCESS) {
+		return P_FAILURE;
+	}
+
 	pthread_rwlock_init(&D->tag_reports_lock, &attr);
 	pthread_rwlock_init(&D->rtag_reports_lock, &attr);
 	pthread_rwlock_init(&D->base_reports_lock, &attr);
 	pthread_rwlock_init(&D->stats_lock, &attr);
-	pthread_rwlock_init(&D->per_thread_pools_lock, &attr);
 
 	if (pinba_pool_init(&D->request_pool, settings.request_pool_size, sizeof(pinba_stats_record), 0, 0/* won't grow it anyway */, pinba_request_pool_dtor, (char *)"request pool") != P_SUCCESS) {
 		pinba_error(P_ERROR, "failed to initialize request pool (%d elements). not enough memory?", settings.request_pool_size);
 		return P_FAILURE;
 	}
 
-	if (pinba_pool_init(&D->timer_pool, settings.timer_pool_size, sizeof(pinba_timer_record), 0, PINBA_TIMER_POOL_GROW_SIZE, pinba_timer_pool_dtor, (char *)"timer pool") != P_SUCCESS) {
+	if (pinba_timer_pool_init(&D->timer_pool, settings.timer_pool_size) != P_SUCCESS) {
 		pinba_error(P_ERROR, "failed to initialize timer pool (%d elements). not enough memory?", settings.timer_pool_size);
 		return P_FAILURE;
 	}
@@ -158,56 +331,127 @@ int pinba_collector_init(pinba_daemon_settings settings) /* {{{ */
 	}
 	D->thread_pool = th_pool_create(cpu_cnt);
 
+	if (settings.numa) {
+		pinba_numa_init(cpu_cnt, D->thread_pool->size);
+	}
+
+	if (D->numa_nodemask) {
+		/* the records are built and read by all the workers */
+		pinba_pool_set_numa_node(&D->request_pool, PINBA_NUMA_INTERLEAVE);
+		pinba_timer_pool_set_numa_node(&D->timer_pool, PINBA_NUMA_INTERLEAVE);
+	}
+
 #ifdef PINBA_ENGINE_HAVE_PTHREAD_SETAFFINITY_NP
 	cpu_num = 0;
 	for (i = 0; i < D->thread_pool->size; i++, cpu_num = (cpu_num == (cpu_cnt-1)) ? 0 : cpu_num + 1) {
 		pinba_cpu_set_t mask;
 
 		CPU_ZERO(&mask);
-		CPU_SET(cpu_num, &mask);
+		CPU_SET(D->numa_cpus ? D->numa_cpus[cpu_num] : cpu_num, &mask);
 		pthread_setaffinity_np(D->thread_pool->threads[i], sizeof(mask), &mask);
 	}
 #endif
 
-	D->per_thread_request_pool[0] = (pinba_pool *)calloc(cpu_cnt, sizeof(pinba_pool));
-	D->per_thread_request_pool[1] = (pinba_pool *)calloc(cpu_cnt, sizeof(pinba_pool));
-	if (!D->per_thread_request_pool[0] || !D->per_thread_request_pool[1]) {
-		pinba_error(P_ERROR, "failed to allocate per_thread_request_pool structs. not enough memory?");
-		return P_FAILURE;
+	/* one queue per collector thread and one more for the stream listener */
+	D->collector_queues_cnt = cpu_cnt;
+	if (settings.stream_port > 0 || (settings.stream_socket && settings.stream_socket[0])) {
+		D->collector_queues_cnt++;
 	}
 
-	D->per_thread_tmp_pool = (pinba_pool *)calloc(cpu_cnt, sizeof(pinba_pool));
-	if (!D->per_thread_tmp_pool) {
-		pinba_error(P_ERROR, "failed to allocate per_thread_tmp_pool. not enough memory?");
+	D->collector_queues = (pinba_collector_queue *)calloc(D->collector_queues_cnt, sizeof(pinba_collector_queue));
+	if (!D->collector_queues) {
+		pinba_error(P_ERROR, "failed to allocate collector queues. not enough memory?");
 		return P_FAILURE;
 	}
 
-	for (i = 0; i < (size_t)cpu_cnt; i++) {
-		char name[PINBA_POOL_NAME_SIZE];
+	for (i = 0; i < D->collector_queues_cnt; i++) {
+		pinba_collector_queue *q = D->collector_queues + i;
+
+		/* both rings can hold all the blocks a collector thread may allocate, so the free ring never overflows */
+		if (pinba_spsc_ring_init(&q->full_ring, PINBA_DATA_RING_SIZE) != P_SUCCESS || pinba_spsc_ring_init(&q->free_ring, PINBA_DATA_RING_SIZE) != P_SUCCESS) {
+			pinba_error(P_ERROR, "failed to initialize collector queue. not enough memory?");
+			return P_FAILURE;
+		}
+	}
+
+	pthread_mutex_init(&D->harvest_mutex, NULL);
+	pthread_cond_init(&D->harvest_cond, NULL);
+	pthread_cond_init(&D->harvest_trigger_cond, NULL);
+
+	if (settings.harvest_fill_threshold > 0) {
+		D->harvest_trigger_blocks = PINBA_DATA_RING_SIZE * settings.harvest_fill_threshold / 100;
+		if (D->harvest_trigger_blocks == 0) {
+			D->harvest_trigger_blocks = 1;
+		}
+	}
 
-		sprintf(name, "per_thread_request_pool[0][%zd]", i);
-		if (pinba_pool_init(D->per_thread_request_pool[0] + i, settings.temp_pool_size, sizeof(Pinba__Request *), settings.temp_pool_size_limit, 0, pinba_per_thread_request_pool_dtor, name) != P_SUCCESS) {
+	for (i = 0; i < PINBA_HARVEST_SLOTS; i++) {
+		if (pinba_harvest_slot_init(D->harvest_slots + i, i, cpu_cnt) != P_SUCCESS) {
 			return P_FAILURE;
 		}
+	}
+
+	/* with SO_REUSEPORT each collector thread gets its own socket (and its own receive queue),
+	   otherwise all the threads share the same one */
+	D->collector_sockets_cnt = settings.reuseport ? cpu_cnt : 1;
+	D->collector_sockets = (pinba_socket **)calloc(D->collector_sockets_cnt, sizeof(pinba_socket *));
+	if (!D->collector_sockets) {
+		pinba_error(P_ERROR, "failed to allocate collector sockets. not enough memory?");
+		return P_FAILURE;
+	}
 
-		sprintf(name, "per_thread_request_pool[1][%zd]", i);
-		if (pinba_pool_init(D->per_thread_request_pool[1] + i, settings.temp_pool_size, sizeof(Pinba__Request *), settings.temp_pool_size_limit, 0, pinba_per_thread_request_pool_dtor, name) != P_SUCCESS) {
+	for (i = 0; i < D->collector_sockets_cnt; i++) {
+		struct timeval tv;
+		int timeout;
+
+		D->collector_sockets[i] = pinba_socket_open(D->settings.address, D->settings.port, settings.reuseport, settings.udp_gro);
+		if (!D->collector_sockets[i]) {
 			return P_FAILURE;
 		}
 
-		sprintf(name, "per_thread_tmp_pool[%zd]", i);
-		if (pinba_pool_init(D->per_thread_tmp_pool + i, settings.temp_pool_size, sizeof(pinba_stats_record_ex), settings.temp_pool_size_limit, 0, pinba_per_thread_tmp_pool_dtor, name) != P_SUCCESS) {
+		if (settings.busy_poll > 0) {
+#ifdef SO_BUSY_POLL
+			/* let the kernel poll the device queue in recvmmsg() too; raising it above
+			   net.core.busy_read requires CAP_NET_ADMIN, so this is not fatal */
+			if (setsockopt(D->collector_sockets[i]->listen_sock, SOL_SOCKET, SO_BUSY_POLL, &settings.busy_poll, sizeof(int)) == -1) {
+				pinba_error(P_WARNING, "setsockopt(SO_BUSY_POLL) failed: %s (%d)", strerror(errno), errno);
+			}
+#else
+			pinba_error(P_WARNING, "SO_BUSY_POLL is not supported on this platform, busy polling in userspace only");
+#endif
+		}
+
+		/* wake up the collector threads from time to time, so that they hand over
+		   partially filled blocks even if there is no traffic */
+		timeout = pinba_collector_timeout();
+		tv.tv_sec = timeout / 1000000;
+		tv.tv_usec = timeout % 1000000;
+		if (setsockopt(D->collector_sockets[i]->listen_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1) {
+			pinba_error(P_ERROR, "setsockopt(SO_RCVTIMEO) failed: %s (%d)", strerror(errno), errno);
 			return P_FAILURE;
 		}
 	}
 
-	D->pool_num = 0;
-	D->current_read_pool = D->per_thread_request_pool[D->pool_num];
-	D->current_write_pool = D->per_thread_request_pool[!D->pool_num];
+	if (D->collector_queues_cnt > (size_t)cpu_cnt) {
+		D->stream = (pinba_stream_listener *)calloc(1, sizeof(pinba_stream_listener));
+		if (!D->stream) {
+			pinba_error(P_ERROR, "out of memory");
+			return P_FAILURE;
+		}
 
-	D->collector_socket = pinba_socket_open(D->settings.address, D->settings.port);
-	if (!D->collector_socket) {
-		return P_FAILURE;
+		if (settings.stream_port > 0) {
+			D->stream->tcp_socket = pinba_stream_socket_open(D->settings.address, settings.stream_port);
+			if (!D->stream->tcp_socket) {
+				return P_FAILURE;
+			}
+		}
+
+		if (settings.stream_socket && settings.stream_socket[0]) {
+			D->stream->unix_socket = pinba_unix_socket_open(settings.stream_socket);
+			if (!D->stream->unix_socket) {
+				return P_FAILURE;
+			}
+		}
 	}
 
 	collector_threads = (pthread_t *)calloc(cpu_cnt, sizeof(pthread_t));
@@ -226,12 +470,29 @@ int pinba_collector_init(pinba_daemon_settings settings) /* {{{ */
 			pinba_cpu_set_t mask;
 
 			CPU_ZERO(&mask);
-			CPU_SET(i, &mask);
+			CPU_SET(D->numa_cpus ? D->numa_cpus[i] : i, &mask);
 			pthread_setaffinity_np(collector_threads[i], sizeof(mask), &mask);
 		}
 #endif
 	}
 
+#ifndef PINBA_ENGINE_HAVE_PTHREAD_SETAFFINITY_NP
+	if (settings.busy_poll > 0) {
+		pinba_error(P_WARNING, "collector threads cannot be pinned to CPUs on this platform, busy polling threads will compete with each other");
+	}
+#endif
+
+	if (D->stream) {
+		/* the last queue belongs to the stream listener */
+		if (pthread_create(&stream_thread, NULL, pinba_stream_main, (void *)(D->collector_queues_cnt - 1))) {
+			return P_FAILURE;
+		}
+	}
+
+	if (pthread_create(&reports_thread, NULL, pinba_reports_main, NULL)) {
+		return P_FAILURE;
+	}
+
 	if (pthread_create(&data_thread, NULL, pinba_data_main, NULL)) {
 		return P_FAILURE;
 	}
@@ -252,6 +513,10 @@ int pinba_collector_init(pinba_daemon_settings settings) /* {{{ */
 		CPU_ZERO(&mask);
 		CPU_SET(settings.cpu_start + 2, &mask);
 		pthread_setaffinity_np(stats_thread, sizeof(mask), &mask);
+
+		CPU_ZERO(&mask);
+		CPU_SET(settings.cpu_start + 3, &mask);
+		pthread_setaffinity_np(reports_thread, sizeof(mask), &mask);
 	}
 #endif
 
@@ -272,7 +537,12 @@ void pinba_collector_shutdown(void) /* {{{ */
 
 	pinba_debug("shutting down..");
 
+	/* wake up both harvester stages */
+	pthread_mutex_lock(&D->harvest_mutex);
 	D->in_shutdown = 1;
+	pthread_cond_broadcast(&D->harvest_cond);
+	pthread_cond_broadcast(&D->harvest_trigger_cond);
+	pthread_mutex_unlock(&D->harvest_mutex);
 
 	for (i = 0; i < D->thread_pool->size; i++) {
 #ifdef __FreeBSD__
@@ -282,7 +552,16 @@ void pinba_collector_shutdown(void) /* {{{ */
 		pthread_join(collector_threads[i], NULL);
 	}
 
+	if (D->stream) {
+#ifdef __FreeBSD__
+		pthread_detach(stream_thread);
+#endif
+		pthread_cancel(stream_thread);
+		pthread_join(stream_thread, NULL);
+	}
+
 	pthread_join(data_thread, NULL);
+	pthread_join(reports_thread, NULL);
 	pthread_join(stats_thread, NULL);
 
 	pthread_rwlock_wrlock(&D->collector_lock);
@@ -291,22 +570,54 @@ void pinba_collector_shutdown(void) /* {{{ */
 	thread_pool_size = D->thread_pool->size;
 	th_pool_destroy(D->thread_pool);
 
-	pinba_socket_free(D->collector_socket);
+	for (i = 0; i < D->collector_sockets_cnt; i++) {
+		pinba_socket_free(D->collector_sockets[i]);
+	}
+	free(D->collector_sockets);
+
+	if (D->stream) {
+		for (i = 0; i < D->stream->conns_cnt; i++) {
+			close(D->stream->conns[i].fd);
+			free(D->stream->conns[i].buf);
+		}
+		pinba_socket_free(D->stream->tcp_socket);
+		if (D->stream->unix_socket) {
+			unlink(D->settings.stream_socket);
+			pinba_socket_free(D->stream->unix_socket);
+		}
+		free(D->stream);
+	}
 
 	pinba_debug("shutting down with %ld (of %ld) elements in the pool", pinba_pool_num_records(&D->request_pool), D->request_pool.size);
-	pinba_debug("shutting down with %ld (of %ld) elements in the timer pool", pinba_pool_num_records(&D->timer_pool), D->timer_pool.size);
+	pinba_debug("shutting down with %ld (of %ld) elements in the timer pool", pinba_timer_pool_num_records(&D->timer_pool), D->timer_pool.size);
 
 	pinba_pool_destroy(&D->request_pool);
-	pinba_pool_destroy(&D->timer_pool);
+	pinba_timer_pool_destroy(&D->timer_pool);
+
+	for (i = 0; i < D->collector_queues_cnt; i++) {
+		pinba_collector_queue *q = D->collector_queues + i;
+		pinba_data_block *block;
+
+		while ((block = (pinba_data_block *)pinba_spsc_ring_pop(&q->full_ring)) != NULL) {
+			free(block);
+		}
+		while ((block = (pinba_data_block *)pinba_spsc_ring_pop(&q->free_ring)) != NULL) {
+			free(block);
+		}
+		free(q->current);
+		pinba_spsc_ring_destroy(&q->full_ring);
+		pinba_spsc_ring_destroy(&q->free_ring);
+	}
 
-	for (i = 0; i < thread_pool_size; i++) {
-		pinba_pool_destroy(D->per_thread_request_pool[0] + i);
-		pinba_pool_destroy(D->per_thread_request_pool[1] + i);
-		pinba_pool_destroy(D->per_thread_tmp_pool + i);
+	for (i = 0; i < PINBA_HARVEST_SLOTS; i++) {
+		pinba_harvest_slot_destroy(D->harvest_slots + i, thread_pool_size);
 	}
-	free(D->per_thread_request_pool[0]);
-	free(D->per_thread_request_pool[1]);
-	free(D->per_thread_tmp_pool);
+	free(D->collector_queues);
+	free(D->numa_cpus);
+	free(D->worker_nodes);
+	pthread_mutex_destroy(&D->harvest_mutex);
+	pthread_cond_destroy(&D->harvest_cond);
+	pthread_cond_destroy(&D->harvest_trigger_cond);
 
 	pinba_debug("shutting down with %ld elements in tag.table", pinba_lmap_count(D->tag.table));
 	pinba_debug("shutting down with %ld elements in tag.name_index", pinba_map_count(D->tag.name_index));
@@ -340,9 +651,9 @@ void pinba_collector_shutdown(void) /* {{{ */
 
 	index[0] = '\0';
 	for (word = (pinba_word *)pinba_map_first(D->dictionary, index); word != NULL; word = (pinba_word *)pinba_map_next(D->dictionary, index)) {
-		free(word->str);
 		free(word);
 	}
+	pinba_arena_destroy(&D->words_arena);
 
 	index[0] = '\0';
 	for (tables = (pinba_report_tables *)pinba_map_first(D->reports_to_tables, index); tables != NULL; tables = (pinba_report_tables *)pinba_map_next(D->reports_to_tables, index)) {
@@ -374,7 +685,7 @@ void *pinba_collector_main(void *arg) /* {{{ */
 
 	pinba_debug("starting up collector thread %zd", thread_num);
 
-	pinba_eat_udp(D->collector_socket, thread_num);
+	pinba_eat_udp(D->collector_sockets[thread_num % D->collector_sockets_cnt], thread_num);
 
 	/* unreachable */
 	return NULL;
@@ -382,27 +693,32 @@ void *pinba_collector_main(void *arg) /* {{{ */
 /* }}} */
 
 struct data_job_data {
+	pinba_harvest_slot *slot;
 	size_t start;
 	size_t end;
 	struct timeval now;
 	unsigned int thread_num;
 	size_t invalid_packets;
+	size_t invalid_request_data;
 	size_t timers_cnt;
+	size_t timer_tags_cnt;
 	size_t rtags_cnt;
 	size_t timers_prefix;
+	pinba_timer_tag *timer_tags; /* where the tags of the next timer go */
 	unsigned int timertag_cnt;
 	unsigned int res_cnt;
+	size_t coalesced;
 };
 
-pinba_word *pinba_dictionary_word_get_or_insert_rdlock(char *str, int str_len) /* {{{ */
+static pinba_word *pinba_dictionary_word_get_or_insert_ex_rdlock(const char *str, int str_len, int size) /* {{{ */
 {
 	pinba_word *word_ptr;
 	char *copy_str = NULL;
 
-	if (str_len >= PINBA_TAG_VALUE_SIZE) {
-		copy_str = strndup(str, PINBA_TAG_VALUE_SIZE - 1);
+	if (str_len >= size) {
+		copy_str = strndup(str, size - 1);
 		str = copy_str;
-		str_len = PINBA_TAG_VALUE_SIZE - 1;
+		str_len = size - 1;
 	}
 
 	word_ptr = (pinba_word *)pinba_map_get(D->dictionary, str);
@@ -417,11 +733,27 @@ pinba_word *pinba_dictionary_word_get_or_insert_rdlock(char *str, int str_len) /
 			goto race_condition;
 		}
 
-		word_ptr = (pinba_word *)malloc(sizeof(*word_ptr));
+		word_ptr = (pinba_word *)calloc(1, sizeof(*word_ptr));
+		if (word_ptr) {
+			word_ptr->str = (char *)pinba_arena_alloc(&D->words_arena, str_len + 1);
+			if (!word_ptr->str) {
+				free(word_ptr);
+				word_ptr = NULL;
+			}
+		}
+
+		if (UNLIKELY(!word_ptr)) {
+			pinba_error(P_ERROR, "out of memory when adding a word to the dictionary");
+			pthread_rwlock_unlock(&D->words_lock);
+			pthread_rwlock_rdlock(&D->words_lock);
+			goto race_condition;
+		}
 
-		/* insert */
+		/* insert, unreferenced until the caller takes a reference */
 		word_ptr->len = str_len;
-		word_ptr->str = strdup(str);
+		memcpy(word_ptr->str, str, str_len + 1);
+		D->words_arena_used += (str_len + 1 + 7) & ~7;
+		__atomic_add_fetch(&D->words_unreferenced, 1, __ATOMIC_RELAXED);
 
 		D->dictionary = pinba_map_add(D->dictionary, str, word_ptr);
 		pthread_rwlock_unlock(&D->words_lock);
@@ -437,23 +769,87 @@ race_condition:
 }
 /* }}} */
 
-static inline int request_to_record(Pinba__Request *request, pinba_stats_record_ex *record_ex) /* {{{ */
+pinba_word *pinba_dictionary_word_get_or_insert_rdlock(char *str, int str_len) /* {{{ */
 {
-	pinba_word **tag_names, **tag_values;
-	unsigned int tags_alloc_cnt, timers_cnt, dict_size;
-	double req_time, ru_utime, ru_stime, doc_size;
-	pinba_stats_record *record = &record_ex->record;
+	return pinba_dictionary_word_get_or_insert_ex_rdlock(str, str_len, PINBA_TAG_VALUE_SIZE);
+}
+/* }}} */
 
-	/* save the tags */
-	tag_names = record->data.tag_names;
-	tag_values = record->data.tag_values;
-	tags_alloc_cnt = record->data.tags_alloc_cnt;
+/* frees the words nothing refers to and moves the strings of the rest to a new arena
+   once most of the old one is taken by the freed ones; the caller holds collector_lock for writing,
+   so nobody uses a word without a reference meanwhile */
+void pinba_dictionary_compact(void) /* {{{ */
+{
+	char index[PINBA_MAX_LINE_LEN] = {0};
+	pinba_word *word, **dead;
+	size_t i, words_cnt, dead_cnt = 0;
+	pinba_arena arena;
 
-	memset(record, 0, sizeof(*record));
+	if (__atomic_load_n(&D->words_unreferenced, __ATOMIC_RELAXED) < PINBA_DICTIONARY_COMPACT_MIN) {
+		return;
+	}
 
-	record->data.tag_names = tag_names;
-	record->data.tag_values = tag_values;
-	record->data.tags_alloc_cnt = tags_alloc_cnt;
+	pthread_rwlock_wrlock(&D->words_lock);
+
+	/* a full scan, so only when a good share of the words may be dead */
+	words_cnt = pinba_map_count(D->dictionary);
+	if (__atomic_load_n(&D->words_unreferenced, __ATOMIC_RELAXED) < words_cnt / 4) {
+		pthread_rwlock_unlock(&D->words_lock);
+		return;
+	}
+	__atomic_store_n(&D->words_unreferenced, 0, __ATOMIC_RELAXED);
+
+	dead = (pinba_word **)malloc(sizeof(pinba_word *) * words_cnt);
+	if (!dead) {
+		pthread_rwlock_unlock(&D->words_lock);
+		return;
+	}
+
+	/* the map can't be changed while it's being walked */
+	for (word = (pinba_word *)pinba_map_first(D->dictionary, index); word != NULL; word = (pinba_word *)pinba_map_next(D->dictionary, index)) {
+		if (word->refcount == 0) {
+			dead[dead_cnt++] = word;
+		}
+	}
+
+	for (i = 0; i < dead_cnt; i++) {
+		word = dead[i];
+		pinba_map_delete(D->dictionary, word->str);
+		D->words_arena_used -= (word->len + 1 + 7) & ~7;
+		free(word);
+	}
+	free(dead);
+
+	/* the strings of the freed words are holes in the arena */
+	if (D->words_arena.allocated > D->words_arena_used * 2 + PINBA_DICTIONARY_ARENA_CHUNK_SIZE) {
+		/* one chunk fits all of the strings, so the copying can't fail halfway */
+		if (pinba_arena_init(&arena, D->words_arena_used + PINBA_DICTIONARY_ARENA_CHUNK_SIZE) == P_SUCCESS) {
+			arena.chunk_size = PINBA_DICTIONARY_ARENA_CHUNK_SIZE;
+
+			index[0] = '\0';
+			for (word = (pinba_word *)pinba_map_first(D->dictionary, index); word != NULL; word = (pinba_word *)pinba_map_next(D->dictionary, index)) {
+				char *str = (char *)pinba_arena_alloc(&arena, word->len + 1);
+
+				memcpy(str, word->str, word->len + 1);
+				word->str = str;
+			}
+
+			pinba_arena_destroy(&D->words_arena);
+			D->words_arena = arena;
+			D->words_arena.allocator.allocator_data = &D->words_arena;
+		}
+	}
+	pthread_rwlock_unlock(&D->words_lock);
+
+	pthread_rwlock_wrlock(&D->stats_lock);
+	D->stats.dictionary_words_freed += dead_cnt;
+	pthread_rwlock_unlock(&D->stats_lock);
+}
+/* }}} */
+
+static inline int pinba_request_validate(Pinba__Request *request) /* {{{ */
+{
+	unsigned int i, timers_cnt, dict_size;
 
 	timers_cnt = request->n_timer_hit_count;
 	if (timers_cnt != (unsigned int)request->n_timer_value || timers_cnt != (unsigned int)request->n_timer_tag_count) {
@@ -478,80 +874,117 @@ static inline int request_to_record(Pinba__Request *request, pinba_stats_record_
 		}
 	}
 
+	for (i = 0; i < request->n_tag_name; i++) {
+		if (request->tag_name[i] >= dict_size) {
+			pinba_error(P_WARNING, "malformed data: tag_name[%d] (%d) >= request->n_dictionary (%d)", i, request->tag_name[i], dict_size);
+			return -1;
+		}
+
+		if (request->tag_value[i] >= dict_size) {
+			pinba_error(P_WARNING, "malformed data: tag_value[%d] (%d) >= request->n_dictionary (%d)", i, request->tag_value[i], dict_size);
+			return -1;
+		}
+	}
+	return 0;
+}
+/* }}} */
+
+/* builds the record right in its request pool slot, the request must be validated by pinba_request_validate() */
+static inline void request_to_record(Pinba__Request *request, pinba_stats_record_ex *record_ex, pinba_stats_record *record) /* {{{ */
+{
+	pinba_word **tag_names, **tag_values;
+	unsigned int tags_alloc_cnt, i;
+	double req_time, ru_utime, ru_stime, doc_size;
+	int with_tags = 0;
+
+	/* save the tags */
+	tag_names = record->data.tag_names;
+	tag_values = record->data.tag_values;
+	tags_alloc_cnt = record->data.tags_alloc_cnt;
+
+	memset(record, 0, sizeof(*record));
+
+	record->data.tag_names = tag_names;
+	record->data.tag_values = tag_values;
+	record->data.tags_alloc_cnt = tags_alloc_cnt;
+
 	record_ex->words_cnt = 0;
 
 	if (request->n_tag_name > 0) {
-		pinba_word *word_ptr;
-		unsigned int i;
+		with_tags = 1;
 
 		if (record_ex->words_alloc < request->n_dictionary) {
-			record_ex->words = (pinba_word **)realloc(record_ex->words, sizeof(pinba_word *) * request->n_dictionary);
-			if (!record_ex->words) {
+			pinba_word **words;
+
+			words = (pinba_word **)realloc(record_ex->words, sizeof(pinba_word *) * request->n_dictionary);
+			if (!words) {
 				pinba_warning("out of memory when allocating record_ex->words");
-				return -1;
+				with_tags = 0;
+			} else {
+				record_ex->words = words;
+				record_ex->words_alloc = request->n_dictionary;
 			}
-			record_ex->words_alloc = request->n_dictionary;
-		}
-
-		pthread_rwlock_rdlock(&D->words_lock);
-		for (i = 0; i < request->n_dictionary; i++) { /* {{{ */
-			char *str;
-			int str_len;
-
-			str = request->dictionary + PINBA_DICTIONARY_ENTRY_SIZE * i;
-			str_len = strlen(str);
-
-			record_ex->words[i] = NULL;
-			record_ex->words_cnt++;
-
-			record_ex->words[i] = pinba_dictionary_word_get_or_insert_rdlock(str, str_len);
 		}
-		/* }}} */
-		pthread_rwlock_unlock(&D->words_lock);
 
-		if (record->data.tags_alloc_cnt < request->n_tag_name) {
+		if (with_tags && record->data.tags_alloc_cnt < request->n_tag_name) {
 			record->data.tag_names = (pinba_word **)realloc(record->data.tag_names, request->n_tag_name * sizeof(pinba_word *));
 			if (!record->data.tag_names) {
 				pinba_error(P_WARNING, "internal error: realloc(.., %d) returned NULL", request->n_tag_name * sizeof(pinba_word *));
 				record->data.tags_alloc_cnt = 0;
-				return -1;
+				with_tags = 0;
 			}
+		}
 
+		if (with_tags && record->data.tags_alloc_cnt < request->n_tag_name) {
 			record->data.tag_values = (pinba_word **)realloc(record->data.tag_values, request->n_tag_name * sizeof(pinba_word *));
 			if (!record->data.tag_values) {
 				pinba_error(P_WARNING, "internal error: realloc(.., %d) returned NULL", request->n_tag_name * sizeof(pinba_word *));
 				record->data.tags_alloc_cnt = 0;
-				return -1;
+				with_tags = 0;
+			} else {
+				memset(record->data.tag_names + record->data.tags_alloc_cnt, 0, sizeof(pinba_word *) * (request->n_tag_name - record->data.tags_alloc_cnt));
+				memset(record->data.tag_values + record->data.tags_alloc_cnt, 0, sizeof(pinba_word *) * (request->n_tag_name - record->data.tags_alloc_cnt));
+				record->data.tags_alloc_cnt = request->n_tag_name;
 			}
-
-			memset(record->data.tag_names + record->data.tags_alloc_cnt, 0, sizeof(pinba_word *) * (request->n_tag_name - record->data.tags_alloc_cnt));
-			memset(record->data.tag_values + record->data.tags_alloc_cnt, 0, sizeof(pinba_word *) * (request->n_tag_name - record->data.tags_alloc_cnt));
-			record->data.tags_alloc_cnt = request->n_tag_name;
 		}
+	}
 
-		for (i = 0; i < request->n_tag_name; i++) {
-			if (request->tag_name[i] >= request->n_dictionary) {
-				pinba_error(P_WARNING, "malformed data: tag_name[%d] (%d) >= request->n_dictionary (%d)", i, request->tag_name[i], request->n_dictionary);
-				return -1;
-			}
+	pthread_rwlock_rdlock(&D->words_lock);
 
-			if (request->tag_value[i] >= request->n_dictionary) {
-				pinba_error(P_WARNING, "malformed data: tag_value[%d] (%d) >= request->n_dictionary (%d)", i, request->tag_value[i], request->n_dictionary);
-				return -1;
-			}
+	/* the record keeps the words only, the strings are shared by all the records */
+	record->data.script_name = pinba_dictionary_word_get_or_insert_ex_rdlock(request->script_name, strlen(request->script_name), PINBA_SCRIPT_NAME_SIZE);
+	record->data.server_name = pinba_dictionary_word_get_or_insert_ex_rdlock(request->server_name, strlen(request->server_name), PINBA_SERVER_NAME_SIZE);
+	record->data.hostname = pinba_dictionary_word_get_or_insert_ex_rdlock(request->hostname, strlen(request->hostname), PINBA_HOSTNAME_SIZE);
+	record->data.schema = pinba_dictionary_word_get_or_insert_ex_rdlock(request->schema, strlen(request->schema), PINBA_SCHEMA_SIZE);
+	pinba_word_ref(record->data.script_name);
+	pinba_word_ref(record->data.server_name);
+	pinba_word_ref(record->data.hostname);
+	pinba_word_ref(record->data.schema);
+
+	/* the slot is taken anyway, a record without its tags is better than a hole in the pool */
+	if (with_tags) {
+		for (i = 0; i < request->n_dictionary; i++) { /* {{{ */
+			char *str;
+			int str_len;
+
+			str = request->dictionary + PINBA_DICTIONARY_ENTRY_SIZE * i;
+			str_len = strlen(str);
+
+			record_ex->words[i] = pinba_dictionary_word_get_or_insert_rdlock(str, str_len);
+			record_ex->words_cnt++;
+		}
+		/* }}} */
 
+		for (i = 0; i < request->n_tag_name; i++) {
 			record->data.tag_names[i] = record_ex->words[request->tag_name[i]];
 			record->data.tag_values[i] = record_ex->words[request->tag_value[i]];
+			pinba_word_ref(record->data.tag_names[i]);
+			pinba_word_ref(record->data.tag_values[i]);
 			record->data.tags_cnt++;
 		}
 	}
+	pthread_rwlock_unlock(&D->words_lock);
 
-	memcpy_static(record->data.script_name, request->script_name, strlen(request->script_name), record->data.script_name_len);
-	memcpy_static(record->data.server_name, request->server_name, strlen(request->server_name), record->data.server_name_len);
-	memcpy_static(record->data.hostname, request->hostname, strlen(request->hostname), record->data.hostname_len);
-	if (request->schema && request->schema[0]) {
-		memcpy_static(record->data.schema, request->schema, strlen(request->schema), record->data.schema_len);
-	}
 	req_time = (double)request->request_time;
 	ru_utime = (double)request->ru_utime;
 	ru_stime = (double)request->ru_stime;
@@ -577,6 +1010,7 @@ static inline int request_to_record(Pinba__Request *request, pinba_stats_record_
 	record->data.req_time = float_to_timeval(req_time);
 	record->data.ru_utime = float_to_timeval(ru_utime);
 	record->data.ru_stime = float_to_timeval(ru_stime);
+	record->data.weight = record_ex->weight;
 	record->data.req_count = request->request_count;
 	record->data.doc_size = (float)doc_size; /* Kbytes*/
 	record->data.mem_peak_usage = (float)request->memory_peak / 1024; /* Kbytes */
@@ -587,13 +1021,15 @@ static inline int request_to_record(Pinba__Request *request, pinba_stats_record_
 	}
 
 	record->data.status = request->has_status ? request->status : 0;
-	return 0;
+
+	/* set by _add_timers(), unless the timers are thrown away */
+	record->timers_cnt = 0;
 }
 /* }}} */
 
-inline static int _add_timers(pinba_stats_record *record, const pinba_stats_record_ex *record_ex, unsigned int *timertag_cnt, int request_id, unsigned int timers_cnt) /* {{{ */
+inline static int _add_timers(pinba_stats_record *record, const pinba_stats_record_ex *record_ex, unsigned int *timertag_cnt, int request_id, unsigned int timers_cnt, pinba_timer_tag **tags) /* {{{ */
 {
-	pinba_pool *timer_pool = &D->timer_pool;
+	pinba_timer_pool *timer_pool = &D->timer_pool;
 	pinba_timer_record *timer;
 	float timer_value;
 	unsigned int i, j, timer_tag_cnt, timer_hit_cnt;
@@ -685,29 +1121,15 @@ inline static int _add_timers(pinba_stats_record *record, const pinba_stats_reco
 		timer_tag_cnt = request->timer_tag_count[ti];
 		timer_hit_cnt = request->timer_hit_count[ti];
 
-		timer = record_get_timer(timer_pool, record, i);
-		timer->index = record_get_timer_id(timer_pool, record, i);
-		timer->request_id = request_id;
-
-		if (request->n_timer_ru_stime > i) {
-			timer->ru_stime = float_to_timeval(request->timer_ru_stime[i]);
-		} else {
-			timer->ru_stime = null_timeval;
-		}
-
-		if (request->n_timer_ru_utime > i) {
-			timer->ru_utime = float_to_timeval(request->timer_ru_utime[i]);
-		} else {
-			timer->ru_utime = null_timeval;
-		}
-
+		/* the timers skipped here are not counted by request_build_job_func() either */
 		if (!timer_hit_cnt) {
 			pinba_debug("timer.hit_count is 0");
+			tt += timer_tag_cnt;
 			continue;
 		}
 
 		if (!timer_tag_cnt) {
-			pinba_debug("timer.hit_count is 0");
+			pinba_debug("timer.tag_count is 0");
 			continue;
 		}
 
@@ -716,41 +1138,40 @@ inline static int _add_timers(pinba_stats_record *record, const pinba_stats_reco
 			timer_value = 0;
 		}
 
-		int allocate_num = 0;
-		if (timer->tag_num_allocated < timer_tag_cnt) {
-			allocate_num = timer_tag_cnt;
-			if (timer_tag_cnt < PINBA_MIN_TAG_VALUES_CNT_MAGIC_NUMBER) {
-				allocate_num = PINBA_MIN_TAG_VALUES_CNT_MAGIC_NUMBER;
-			}
-			timer->tag_ids = (int *)realloc(timer->tag_ids, sizeof(int) * allocate_num);
-			timer->tag_values = (pinba_word **)realloc(timer->tag_values, sizeof(pinba_word *) * allocate_num);
-			timer->tag_num_allocated = allocate_num;
+		timer = record_get_timer(timer_pool, record, record->timers_cnt);
+		timer->request_id = request_id;
+
+		if (request->n_timer_ru_stime > i) {
+			timer->ru_stime = float_to_usec(request->timer_ru_stime[i]);
+		} else {
+			timer->ru_stime = 0;
 		}
 
-		if (timer_value > 0.0) {
-			timer->value = float_to_timeval(timer_value);
+		if (request->n_timer_ru_utime > i) {
+			timer->ru_utime = float_to_usec(request->timer_ru_utime[i]);
 		} else {
-			timer->value = float_to_timeval(0);
+			timer->ru_utime = 0;
 		}
+
+		timer->value = float_to_usec(timer_value);
 		timer->hit_count = timer_hit_cnt;
 		timer->num_in_request = record->timers_cnt;
+		timer->tags = *tags;
+		timer->tag_num = 0;
+
+		record->timers_cnt++;
 
-		if (!timer->tag_ids || !timer->tag_values) {
-			timer->tag_num_allocated = 0;
-			pinba_warning("out of memory when allocating tag attributes (num: %ld)", allocate_num);
+		if (!timer->tags) {
+			/* no memory for the tags of this cycle */
+			tt += timer_tag_cnt;
 			continue;
 		}
 
-		record->timers_cnt++;
-		timer->tag_num = 0;
-
 		for (j = 0; j < timer_tag_cnt; j++, tt++) {
 
 			tag_value = request->timer_tag_value[tt];
 			tag_name = request->timer_tag_name[tt];
 
-			timer->tag_values[timer->tag_num] = NULL;
-
 			if (LIKELY(tag_value < dict_size && tag_name < dict_size && tag_value >= 0 && tag_name >= 0)) {
 				word_ptr = temp_words[tag_value];
 				if (!word_ptr) {
@@ -761,7 +1182,7 @@ inline static int _add_timers(pinba_stats_record *record, const pinba_stats_reco
 				continue;
 			}
 
-			timer->tag_values[timer->tag_num] = word_ptr;
+			timer->tags[timer->tag_num].value = word_ptr;
 
 			word_ptr = temp_words[tag_name];
 			tag = temp_tags[tag_name];
@@ -805,10 +1226,15 @@ inline static int _add_timers(pinba_stats_record *record, const pinba_stats_reco
 				}
 			}
 
-			timer->tag_ids[timer->tag_num] = tag->id;
+			timer->tags[timer->tag_num].id = tag->id;
+			/* only the tags that made it here are released with the tag block, see pinba_timer_tags_release() */
+			pinba_word_ref(timer->tags[timer->tag_num].value);
 			timer->tag_num++;
 			(*timertag_cnt)++;
 		}
+
+		/* the tags of the next timer follow right after these */
+		*tags += timer->tag_num;
 	}
 
 	if (temp_words_dynamic) {
@@ -826,8 +1252,7 @@ inline static int _add_timers(pinba_stats_record *record, const pinba_stats_reco
 void merge_timers_func(void *job_data) /* {{{ */
 {
 	struct data_job_data *d = (struct data_job_data *)job_data;
-	pinba_pool *timer_pool = &D->timer_pool;
-	pinba_pool *tmp_pool = &D->per_thread_tmp_pool[d->thread_num];
+	pinba_pool *tmp_pool = d->slot->tmp_pools + d->thread_num;
 	pinba_pool *request_pool = &D->request_pool;
 	Pinba__Request *request;
 	pinba_stats_record *record;
@@ -858,12 +1283,9 @@ void merge_timers_func(void *job_data) /* {{{ */
 		}
 
 		if (timers_cnt > 0) {
-			record->timers_start = d->timers_prefix + d->timers_cnt;
-			if (record->timers_start >= timer_pool->size) {
-				record->timers_start -= timer_pool->size;
-			}
+			record->timers_start = (d->timers_prefix + d->timers_cnt) & PINBA_TIMER_ID_MASK;
 
-			real_timers_cnt = _add_timers(record, record_ex, &d->timertag_cnt, record_ex->request_id, timers_cnt);
+			real_timers_cnt = _add_timers(record, record_ex, &d->timertag_cnt, record_ex->request_id, timers_cnt, &d->timer_tags);
 			d->timers_cnt += real_timers_cnt;
 		}
 		request_id++;
@@ -872,18 +1294,48 @@ void merge_timers_func(void *job_data) /* {{{ */
 }
 /* }}} */
 
-static void data_job_func(void *data) /* {{{ */
+static int pinba_envelope_unpack(pinba_arena *arena, const unsigned char **buf, size_t *len) /* {{{ */
+{
+	unsigned int size;
+	char *dst;
+
+	size = pinba_envelope_size(*buf, *len);
+	if (size == 0) {
+		pinba_debug("invalid envelope: uncompressed size out of limits, compressed size %zu", *len - PINBA_ENVELOPE_HEADER_SIZE);
+		return P_FAILURE;
+	}
+
+	/* the decompressed data lives in the arena as long as the requests decoded from it */
+	dst = (char *)pinba_arena_alloc(arena, size);
+	if (!dst) {
+		return P_FAILURE;
+	}
+
+	if (pinba_envelope_decompress(*buf, *len, dst, size) < 0) {
+		pinba_debug("invalid envelope: failed to decompress %zu bytes into %u bytes", *len - PINBA_ENVELOPE_HEADER_SIZE, size);
+		return P_FAILURE;
+	}
+
+	*buf = (const unsigned char *)dst;
+	*len = size;
+	return P_SUCCESS;
+}
+/* }}} */
+
+static int data_job_decode_block(struct data_job_data *d, pinba_data_block *block) /* {{{ */
 {
 	pinba_stats_record_ex *record_ex;
 	int sub_request_num;
 	int current_sub_request;
 	Pinba__Request *parent_request = NULL;
-	struct data_job_data *d = (struct data_job_data *)data;
-	pinba_pool *request_pool = D->current_read_pool + d->thread_num;
-	pinba_pool *tmp_pool = D->per_thread_tmp_pool + d->thread_num;
-	size_t i;
+	pinba_pool *tmp_pool = d->slot->tmp_pools + d->thread_num;
+	pinba_arena *arena = d->slot->arenas + d->thread_num;
+	pinba_data_bucket *bucket;
+	size_t offset;
+
+	for (offset = 0; offset < block->used; offset += bucket->alloc_len) {
+		bucket = (pinba_data_bucket *)(block->data + offset);
 
-	for (i = 0; i < request_pool->in; i++) {
 		sub_request_num = -1;
 		current_sub_request = -1;
 		do {
@@ -894,31 +1346,35 @@ static void data_job_func(void *data) /* {{{ */
 
 				ret = pinba_pool_grow(tmp_pool, 0);
 				if (ret != 0) {
-					/* XXX losing packets and leaking memory ! */
-					return;
+					return P_FAILURE;
 				}
 			}
 
 			record_ex = REQ_POOL_EX(tmp_pool) + tmp_pool->in;
-			if (record_ex->request && record_ex->can_free) {
-				pinba__request__free_unpacked(record_ex->request, NULL);
-				record_ex->request = NULL;
-				record_ex->can_free = 0;
-			}
 
 			if (sub_request_num == -1) {
+				/* raw packets are decoded here, in the thread pool, so that the collector threads
+				   only have to copy the data and get back to the socket */
+				const unsigned char *buf = (const unsigned char *)bucket->buf;
+				size_t len = bucket->len;
+
+				if (pinba_envelope_check(buf, len)) {
+					/* compressed batch from a relay, see pinba.proto */
+					if (pinba_envelope_unpack(arena, &buf, &len) != P_SUCCESS) {
+						d->invalid_packets++;
+						break;
+					}
+				}
 
-				request = REQ_DATA_POOL(request_pool)[request_pool->out];
-				REQ_DATA_POOL(request_pool)[request_pool->out] = NULL;
-				request_pool->out++;
+				request = pinba__request__unpack(&arena->allocator, len, buf);
 				if (UNLIKELY(request == NULL)) {
-					//d->invalid_packets++;
+					d->invalid_packets++;
 					break;
 				}
 
 				if (request->n_timer_hit_count != request->n_timer_value || request->n_timer_hit_count != request->n_timer_tag_count) {
 					pinba_debug("internal error: timer_hit_count_size (%d) != timer_value_size (%d) || timer_hit_count_size (%d) != timer_tag_count_size (%d)", request->n_timer_hit_count, request->n_timer_value, request->n_timer_hit_count, request->n_timer_tag_count);
-					//d->invalid_packets++;
+					d->invalid_request_data++;
 					break;
 				}
 
@@ -930,91 +1386,229 @@ static void data_job_func(void *data) /* {{{ */
 					sub_request_num = -1;
 				}
 				record_ex->request = request;
-				record_ex->can_free = 1;
 			} else {
 				request = parent_request->requests[current_sub_request];
 				record_ex->request = request;
-				record_ex->can_free = 0;
 				current_sub_request++;
 			}
 
-			if (!request || request_to_record(request, record_ex) < 0) {
-				//	d->invalid_packets++;
+			/* only the valid requests are queued, the records are built by the reports stage */
+			if (!request || pinba_request_validate(request) < 0) {
+				d->invalid_request_data++;
 			} else {
-				record_ex->record.time = d->now;
+				record_ex->words_cnt = 0;
+				record_ex->weight = 1;
 				tmp_pool->in++;
 			}
 		} while (current_sub_request < sub_request_num);
 	}
+	return P_SUCCESS;
 }
 /* }}} */
 
-static void request_copy_job_func(void *job_data) /* {{{ */
+static void data_decode_range_func(void *arg, size_t start, size_t end, size_t worker) /* {{{ */
 {
-	unsigned int i, tmp_id;
-	pinba_stats_record_ex *temp_record_ex;
-	pinba_stats_record *temp_record, *record;
-	struct data_job_data *d = (struct data_job_data *)job_data;
-	pinba_pool *tmp_pool = D->per_thread_tmp_pool + d->thread_num;
-	pinba_pool *request_pool = &D->request_pool;
+	struct data_job_data *d = (struct data_job_data *)arg + worker;
+	pinba_harvest_block *hb;
+	pinba_collector_queue *q;
+	size_t i, invalid_packets, invalid_request_data;
+
+	for (i = start; i < end; i++) {
+		hb = d->slot->blocks + i;
+		q = D->collector_queues + hb->queue;
+		invalid_packets = d->invalid_packets;
+		invalid_request_data = d->invalid_request_data;
+
+		if (data_job_decode_block(d, hb->block) != P_SUCCESS) {
+			/* XXX losing packets! */
+			pinba_debug("failed to decode block %zd of collector %zd", i, hb->queue);
+		}
 
-	tmp_id = request_pool->in + d->start;
-	if (tmp_id >= request_pool->size) {
-		tmp_id -= request_pool->size;
+		/* per-thread counters for the collectors table */
+		if (d->invalid_packets != invalid_packets) {
+			__atomic_add_fetch(&q->invalid_packets, d->invalid_packets - invalid_packets, __ATOMIC_RELAXED);
+		}
+		if (d->invalid_request_data != invalid_request_data) {
+			__atomic_add_fetch(&q->invalid_request_data, d->invalid_request_data - invalid_request_data, __ATOMIC_RELAXED);
+		}
 	}
+}
+/* }}} */
 
-	for (i = 0; i < d->end; i++) {
-		pinba_word **tag_names, **tag_values;
-		unsigned int tags_alloc_cnt, n;
+#define PINBA_REQUEST_TAG_NAME(request, i) ((request)->dictionary + PINBA_DICTIONARY_ENTRY_SIZE * (request)->tag_name[i])
+#define PINBA_REQUEST_TAG_VALUE(request, i) ((request)->dictionary + PINBA_DICTIONARY_ENTRY_SIZE * (request)->tag_value[i])
 
-		temp_record_ex = REQ_POOL_EX(tmp_pool) + i;
-		temp_record_ex->request_id = tmp_id;
-		temp_record = &temp_record_ex->record;
-		record = REQ_POOL(request_pool) + tmp_id;
+static inline uint64_t pinba_request_coalesce_hash(const Pinba__Request *request) /* {{{ */
+{
+	uint64_t hash;
+	const char *str;
+	unsigned int i;
+
+	hash = XXH64(request->script_name, strlen(request->script_name), request->has_status ? request->status : 0);
+	hash = XXH64(request->server_name, strlen(request->server_name), hash);
+	hash = XXH64(request->hostname, strlen(request->hostname), hash);
+	hash = XXH64(request->schema, strlen(request->schema), hash);
+
+	for (i = 0; i < request->n_tag_name; i++) {
+		str = PINBA_REQUEST_TAG_NAME(request, i);
+		hash = XXH64(str, strlen(str), hash);
+		str = PINBA_REQUEST_TAG_VALUE(request, i);
+		hash = XXH64(str, strlen(str), hash);
+	}
+	return hash;
+}
+/* }}} */
 
-		/* save the tags */
-		tag_names = record->data.tag_names;
-		tag_values = record->data.tag_values;
-		tags_alloc_cnt = record->data.tags_alloc_cnt;
+static inline int pinba_requests_coalescible(const Pinba__Request *a, const Pinba__Request *b) /* {{{ */
+{
+	unsigned int i;
 
-		memcpy(record, temp_record, sizeof(pinba_stats_record));
+	if ((a->has_status ? a->status : 0) != (b->has_status ? b->status : 0) || a->n_tag_name != b->n_tag_name) {
+		return 0;
+	}
 
-		record->counter = D->request_pool_counter + d->start + i;
-		record->data.tag_names = tag_names;
-		record->data.tag_values = tag_values;
-		record->data.tags_alloc_cnt = tags_alloc_cnt;
+	/* an unset (negative) rusage counts as zero in request_to_record() and can't be summed
+	   with a set one, the same goes for the memory footprint */
+	if ((a->ru_utime >= 0 && a->ru_stime >= 0) != (b->ru_utime >= 0 && b->ru_stime >= 0) || a->has_memory_footprint != b->has_memory_footprint) {
+		return 0;
+	}
 
-		if (record->data.tags_alloc_cnt < temp_record->data.tags_cnt) {
-			record->data.tag_names = (pinba_word **)realloc(record->data.tag_names, temp_record->data.tags_cnt * sizeof(pinba_word *));
-			if (!record->data.tag_names) {
-				pinba_error(P_WARNING, "internal error: realloc(.., %d) returned NULL", temp_record->data.tags_cnt * sizeof(pinba_word *));
-				record->data.tags_alloc_cnt = 0;
-				continue;
+	if (strcmp(a->script_name, b->script_name) != 0 || strcmp(a->server_name, b->server_name) != 0 || strcmp(a->hostname, b->hostname) != 0) {
+		return 0;
+	}
+
+	if (strcmp(a->schema, b->schema) != 0) {
+		return 0;
+	}
+
+	/* the dictionaries are per request, so the tags are compared by their strings */
+	for (i = 0; i < a->n_tag_name; i++) {
+		if (strcmp(PINBA_REQUEST_TAG_NAME(a, i), PINBA_REQUEST_TAG_NAME(b, i)) != 0 || strcmp(PINBA_REQUEST_TAG_VALUE(a, i), PINBA_REQUEST_TAG_VALUE(b, i)) != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+/* }}} */
+
+static void pinba_tmp_pool_coalesce(struct data_job_data *d) /* {{{ */
+{
+	pinba_pool *tmp_pool = d->slot->tmp_pools + d->thread_num;
+	pinba_stats_record_ex *records = REQ_POOL_EX(tmp_pool), tmp;
+	Pinba__Request *request, *first = NULL;
+	size_t i, j, kept, mask, table_size;
+	size_t *table; /* record number + 1, 0 for an empty bucket */
+
+	if (tmp_pool->in < 2) {
+		return;
+	}
+
+	for (table_size = 16; table_size < tmp_pool->in * 2; table_size <<= 1);
+
+	table = (size_t *)calloc(table_size, sizeof(size_t));
+	if (!table) {
+		return;
+	}
+	mask = table_size - 1;
+
+	kept = 0;
+	for (i = 0; i < tmp_pool->in; i++) {
+		request = records[i].request;
+
+		/* the timers are per request, so only the requests without timers are coalesced */
+		if (request->n_timer_hit_count == 0) {
+			for (j = pinba_request_coalesce_hash(request) & mask; table[j] != 0; j = (j + 1) & mask) {
+				first = records[table[j] - 1].request;
+				if (pinba_requests_coalescible(first, request)) {
+					break;
+				}
 			}
 
-			record->data.tag_values = (pinba_word **)realloc(record->data.tag_values, temp_record->data.tags_cnt * sizeof(pinba_word *));
-			if (!record->data.tag_values) {
-				pinba_error(P_WARNING, "internal error: realloc(.., %d) returned NULL", temp_record->data.tags_cnt * sizeof(pinba_word *));
-				record->data.tags_alloc_cnt = 0;
+			if (table[j] != 0) {
+				/* the sums are added to the first request (it lives in the slot's arena),
+				   the histograms use their average */
+				first->request_time += request->request_time;
+				if (first->ru_utime >= 0 && first->ru_stime >= 0) {
+					first->ru_utime += request->ru_utime;
+					first->ru_stime += request->ru_stime;
+				}
+				/* request_count is the client's own counter, it's kept for the requests table only */
+				records[table[j] - 1].weight++;
+				first->document_size += request->document_size;
+				if (first->has_memory_footprint) {
+					first->memory_footprint += request->memory_footprint;
+				}
+				if (first->memory_peak < request->memory_peak) {
+					first->memory_peak = request->memory_peak;
+				}
+				d->coalesced++;
 				continue;
 			}
-
-			memset(record->data.tag_names + record->data.tags_alloc_cnt, 0, sizeof(char *) * (temp_record->data.tags_cnt - record->data.tags_alloc_cnt));
-			memset(record->data.tag_values + record->data.tags_alloc_cnt, 0, sizeof(char *) * (temp_record->data.tags_cnt - record->data.tags_alloc_cnt));
-			record->data.tags_alloc_cnt = temp_record->data.tags_cnt;
+			table[j] = kept + 1;
 		}
 
-		record->data.tags_cnt = 0;
-		for (n = 0; n < temp_record->data.tags_cnt; n++) {
-			record->data.tag_names[n] = temp_record->data.tag_names[n];
-			record->data.tag_values[n] = temp_record->data.tag_values[n];
-			record->data.tags_cnt++;
+		/* swap instead of copying, so that every pool element keeps its own words buffer */
+		if (kept != i) {
+			tmp = records[kept];
+			records[kept] = records[i];
+			records[i] = tmp;
 		}
-		temp_record->data.tags_cnt = 0;
+		kept++;
+	}
+
+	tmp_pool->in = kept;
+	free(table);
+}
+/* }}} */
+
+static void data_coalesce_range_func(void *arg, size_t start, size_t end, size_t worker) /* {{{ */
+{
+	struct data_job_data *d = (struct data_job_data *)arg;
+	size_t i;
+
+	/* one tmp pool at a time, the pools are filled by data_decode_range_func() */
+	for (i = start; i < end; i++) {
+		pinba_tmp_pool_coalesce(d + i);
+	}
+}
+/* }}} */
+
+static void request_build_job_func(void *job_data) /* {{{ */
+{
+	unsigned int i, j, tmp_id;
+	Pinba__Request *request;
+	pinba_stats_record_ex *record_ex;
+	pinba_stats_record *record;
+	struct data_job_data *d = (struct data_job_data *)job_data;
+	pinba_pool *tmp_pool = d->slot->tmp_pools + d->thread_num;
+	pinba_pool *request_pool = &D->request_pool;
+
+	/* every thread owns a contiguous range of the request pool starting at d->start
+	   and builds its records right there, no copying */
+	tmp_id = request_pool->in + d->start;
+	if (tmp_id >= request_pool->size) {
+		tmp_id -= request_pool->size;
+	}
+
+	for (i = 0; i < d->end; i++) {
+		record_ex = REQ_POOL_EX(tmp_pool) + i;
+		record_ex->request_id = tmp_id;
+		record = REQ_POOL(request_pool) + tmp_id;
+
+		request_to_record(record_ex->request, record_ex, record);
+		record->time = d->now;
+		record->counter = D->request_pool_counter + d->start + i;
 
 		d->rtags_cnt += record->data.tags_cnt;
 
-		d->timers_cnt += temp_record_ex->request->n_timer_hit_count;
+		/* exactly the timers and at most the tags _add_timers() will keep */
+		request = record_ex->request;
+		for (j = 0; j < request->n_timer_hit_count; j++) {
+			if (request->timer_hit_count[j] > 0 && request->timer_tag_count[j] > 0) {
+				d->timers_cnt++;
+				d->timer_tags_cnt += request->timer_tag_count[j];
+			}
+		}
 		d->res_cnt++;
 
 		if (tmp_id == (request_pool->size - 1)) {
@@ -1026,64 +1620,156 @@ static void request_copy_job_func(void *job_data) /* {{{ */
 }
 /* }}} */
 
-static void free_data_func(void *job_data) /* {{{ */
+static size_t pinba_collector_queue_drain(pinba_harvest_slot *slot, size_t queue, size_t *occupancy) /* {{{ */
 {
-	struct data_job_data *d = (struct data_job_data *)job_data;
-	pinba_pool *temp_request_pool = &D->per_thread_request_pool[!D->pool_num][d->thread_num];
-	pinba_stats_record_ex *temp_record_ex;
-	unsigned int i;
+	pinba_collector_queue *q = D->collector_queues + queue;
+	pinba_harvest_queue *hq = slot->queues + queue;
+	pinba_data_block *block;
+	size_t percent;
+
+	/* can't be more than the ring size, since the blocks are not returned until the end of the cycle */
+	percent = pinba_spsc_ring_count(&q->full_ring) * 100 / PINBA_DATA_RING_SIZE;
+	if (percent > *occupancy) {
+		*occupancy = percent;
+	}
+	__atomic_store_n(&q->ring_occupancy, percent, __ATOMIC_RELAXED);
+
+	hq->blocks_cnt = 0;
+	hq->packets = 0;
+	while ((block = (pinba_data_block *)pinba_spsc_ring_pop(&q->full_ring)) != NULL) {
+		hq->blocks[hq->blocks_cnt++] = block;
+		slot->blocks[slot->blocks_cnt].block = block;
+		slot->blocks[slot->blocks_cnt].queue = queue;
+		slot->blocks_cnt++;
+		hq->packets += block->cnt;
+	}
+	__atomic_add_fetch(&q->packets, hq->packets, __ATOMIC_RELAXED);
+	return hq->packets;
+}
+/* }}} */
+
+static void pinba_collector_queue_release(pinba_collector_queue *q, pinba_harvest_queue *hq) /* {{{ */
+{
+	size_t i;
+
+	/* the free ring is as large as the number of blocks, so this can't fail */
+	for (i = 0; i < hq->blocks_cnt; i++) {
+		pinba_spsc_ring_push(&q->free_ring, hq->blocks[i]);
+	}
+	hq->blocks_cnt = 0;
+	hq->packets = 0;
+}
+/* }}} */
+
+static void pinba_harvest_slot_release(pinba_harvest_slot *slot) /* {{{ */
+{
+	size_t i;
+
+	/* the packets and the decoded requests are not needed anymore,
+	   give the blocks back to the collector threads and reset the arenas */
+	for (i = 0; i < D->collector_queues_cnt; i++) {
+		pinba_collector_queue_release(D->collector_queues + i, slot->queues + i);
+	}
+	for (i = 0; i < D->thread_pool->size; i++) {
+		slot->tmp_pools[i].in = 0;
+		pinba_arena_reset(slot->arenas + i);
+	}
+	slot->blocks_cnt = 0;
+	slot->records = 0;
+
+	/* the slot can be filled again while the reports stage is still busy with the pools */
+	pthread_mutex_lock(&D->harvest_mutex);
+	slot->ready = 0;
+	pthread_cond_broadcast(&D->harvest_cond);
+	pthread_mutex_unlock(&D->harvest_mutex);
+}
+/* }}} */
+
+static void pinba_harvest_slot_trim(pinba_harvest_slot *slot) /* {{{ */
+{
+	size_t i, j, freed = 0, allocated = 0;
+	int ready;
+
+	pthread_mutex_lock(&D->harvest_mutex);
+	ready = slot->ready;
+	pthread_mutex_unlock(&D->harvest_mutex);
+
+	/* the arenas of a released slot belong to the decoding stage,
+	   which is also the only one to allocate from them */
+	if (!ready) {
+		for (i = 0; i < D->thread_pool->size; i++) {
+			freed += pinba_arena_trim(slot->arenas + i);
+		}
+	}
+
+	for (i = 0; i < PINBA_HARVEST_SLOTS; i++) {
+		for (j = 0; j < D->thread_pool->size; j++) {
+			allocated += D->harvest_slots[i].arenas[j].allocated;
+		}
+	}
+
+	pthread_rwlock_wrlock(&D->stats_lock);
+	D->stats.arena_memory = allocated;
+	D->stats.arena_memory_freed += freed;
+	pthread_rwlock_unlock(&D->stats_lock);
+}
+/* }}} */
 
-	for (i = 0; i < temp_request_pool->in; i++) {
-		temp_record_ex = REQ_POOL_EX(temp_request_pool) + i;
+/* the harvester is split into two stages running in separate threads, so that the next cycle's
+   packets are decoded while the previous cycle's requests are being added to the reports:
+   pinba_data_main() takes the packets from the collector threads and decodes them into a free slot,
+   pinba_reports_main() builds the records from the decoded requests right in the request pool
+   and updates the reports */
 
-		if (temp_record_ex->request && temp_record_ex->can_free) {
-			pinba__request__free_unpacked(temp_record_ex->request, NULL);
-			temp_record_ex->words_cnt = 0;
-			temp_record_ex->request = NULL;
-			temp_record_ex->can_free = 0;
+static int pinba_harvest_wait(struct timeval *until) /* {{{ */
+{
+	struct timespec ts;
+	int triggered;
+
+	ts.tv_sec = until->tv_sec;
+	ts.tv_nsec = until->tv_usec * 1000;
+
+	/* returns 1 if a collector thread has asked for an early harvest */
+	pthread_mutex_lock(&D->harvest_mutex);
+	while (!D->harvest_triggered && !D->in_shutdown) {
+		if (pthread_cond_timedwait(&D->harvest_trigger_cond, &D->harvest_mutex, &ts) == ETIMEDOUT) {
+			break;
 		}
 	}
-	temp_request_pool->in = 0;
+	triggered = D->harvest_triggered;
+	pthread_mutex_unlock(&D->harvest_mutex);
+	return triggered;
 }
 /* }}} */
 
 void *pinba_data_main(void *arg) /* {{{ */
 {
-	struct timeval launch, tv1;
+	struct timeval launch, tv1, last_harvest;
 	struct data_job_data *job_data_arr;
-	pinba_pool *request_pool = &D->request_pool;
-	thread_pool_barrier_t *barrier1, *barrier2, *barrier3, *barrier4, *barrier5, *barrier6, *barrier7;
-	struct reports_job_data *rep_job_data_arr = NULL;
-	struct reports_job_data *tag_rep_job_data_arr = NULL;
-	struct reports_job_data *rtag_rep_job_data_arr = NULL;
-	unsigned int base_reports_alloc = 0, rtag_reports_alloc = 0;
-
-	barrier1 = (thread_pool_barrier_t *)malloc(sizeof(*barrier1));
-	barrier2 = (thread_pool_barrier_t *)malloc(sizeof(*barrier2));
-	barrier3 = (thread_pool_barrier_t *)malloc(sizeof(*barrier3));
-	barrier4 = (thread_pool_barrier_t *)malloc(sizeof(*barrier4));
-	barrier5 = (thread_pool_barrier_t *)malloc(sizeof(*barrier5));
-	barrier6 = (thread_pool_barrier_t *)malloc(sizeof(*barrier6));
-	barrier7 = (thread_pool_barrier_t *)malloc(sizeof(*barrier7));
-	th_pool_barrier_init(barrier1);
-	th_pool_barrier_init(barrier2);
-	th_pool_barrier_init(barrier3);
-	th_pool_barrier_init(barrier4);
-	th_pool_barrier_init(barrier5);
-	th_pool_barrier_init(barrier6);
-	th_pool_barrier_init(barrier7);
+	pinba_harvest_slot *slot;
+	size_t slot_num = 0;
+	unsigned int backoff = 1;
 
 	pinba_debug("starting up data harvester thread");
 
 	/* yes, it's a minor memleak. once per process start. */
 	job_data_arr = (struct data_job_data *)malloc(sizeof(struct data_job_data) * D->thread_pool->size);
-	tag_rep_job_data_arr = (struct reports_job_data *)malloc(sizeof(struct reports_job_data) * D->thread_pool->size);
 
 	gettimeofday(&launch, NULL);
+	last_harvest = launch;
 	for (;;) {
-		size_t stats_records, records_to_copy, timers_added, free_slots, records_created;
-		size_t accounted, job_size, invalid_packets = 0, lost_tmp_records = 0, rtags_found;
-		size_t i;
+		size_t packets, records, invalid_packets = 0, invalid_request_data = 0, coalesced = 0;
+		size_t ring_occupancy = 0, ring_drops = 0, tmp_pool_high_water = 0, harvest_latency;
+		size_t arena_memory, i, j;
+
+		slot = D->harvest_slots + slot_num % PINBA_HARVEST_SLOTS;
+
+		/* wait for the reports stage to finish with the slot */
+		pthread_mutex_lock(&D->harvest_mutex);
+		while (slot->ready && !D->in_shutdown) {
+			pthread_cond_wait(&D->harvest_cond, &D->harvest_mutex);
+		}
+		pthread_mutex_unlock(&D->harvest_mutex);
 
 		if (D->in_shutdown) {
 			return NULL;
@@ -1095,81 +1781,224 @@ void *pinba_data_main(void *arg) /* {{{ */
 
 		/* Step 1: harvest the data and put the decoded packets to per-thread temp pools */
 
-		/* swap the pools and free the lock */
-		pthread_rwlock_wrlock(&D->per_thread_pools_lock);
-		D->current_read_pool = D->per_thread_request_pool[D->pool_num];
-		D->current_write_pool = D->per_thread_request_pool[!D->pool_num];
-		D->pool_num = !D->pool_num;
-		pthread_rwlock_unlock(&D->per_thread_pools_lock);
+		if (D->harvest_trigger_blocks > 0) {
+			/* the rings are about to be drained, the next trigger is for the new blocks */
+			pthread_mutex_lock(&D->harvest_mutex);
+			D->harvest_triggered = 0;
+			pthread_mutex_unlock(&D->harvest_mutex);
+		}
 
-		records_to_copy = 0;
-		for (i = 0; i < D->thread_pool->size; i++) {
-			pinba_pool *temp_request_pool = D->current_read_pool + i;
-			records_to_copy += temp_request_pool->in;
+		/* the time between two harvests is how old the freshest data may be */
+		gettimeofday(&tv1, NULL);
+		timersub(&tv1, &last_harvest, &last_harvest);
+		harvest_latency = last_harvest.tv_sec * 1000000 + last_harvest.tv_usec;
+		last_harvest = tv1;
+
+		/* take all the blocks the collector threads have handed over so far */
+		packets = 0;
+		for (i = 0; i < D->collector_queues_cnt; i++) {
+			packets += pinba_collector_queue_drain(slot, i, &ring_occupancy);
+			ring_drops += __atomic_load_n(&D->collector_queues[i].drops, __ATOMIC_RELAXED);
 		}
 
-		if (!records_to_copy) {
+		pthread_rwlock_wrlock(&D->stats_lock);
+		D->stats.ring_occupancy = ring_occupancy;
+		D->stats.ring_drops = ring_drops;
+		D->stats.harvest_latency = harvest_latency;
+		pthread_rwlock_unlock(&D->stats_lock);
+
+		if (!packets) {
 			goto sleep;
 		}
 
 		memset(job_data_arr, 0, sizeof(struct data_job_data) * D->thread_pool->size);
-
-		th_pool_barrier_start(barrier1);
-		accounted = 0;
 		for (i = 0; i < D->thread_pool->size; i++) {
-			pinba_pool *request_pool = D->current_read_pool + i;
-			if (request_pool->in == 0) {
-				continue;
-			}
+			job_data_arr[i].slot = slot;
 			job_data_arr[i].thread_num = i;
 			job_data_arr[i].now = launch;
-			th_pool_dispatch(D->thread_pool, barrier1, data_job_func, &(job_data_arr[i]));
 		}
-		th_pool_barrier_wait(barrier1);
 
-		records_to_copy = 0;
+		/* one block at a time, so that a busy collector's blocks are spread over all threads;
+		   a thread decodes into its own tmp pool */
+		th_pool_parallel_for(D->thread_pool, 0, slot->blocks_cnt, 1, data_decode_range_func, job_data_arr);
+
+		if (D->settings.coalesce_requests) {
+			/* merge the identical requests into one weighted record before they're added to the request pool */
+			th_pool_parallel_for(D->thread_pool, 0, D->thread_pool->size, 1, data_coalesce_range_func, job_data_arr);
+		}
+
+		records = 0;
 		for (i = 0; i < D->thread_pool->size; i++) {
-			pinba_pool *tmp_pool = D->per_thread_tmp_pool + i;
-			records_to_copy += tmp_pool->in;
+			records += slot->tmp_pools[i].in;
+			invalid_packets += job_data_arr[i].invalid_packets;
+			invalid_request_data += job_data_arr[i].invalid_request_data;
+			coalesced += job_data_arr[i].coalesced;
+			if (tmp_pool_high_water < slot->tmp_pools[i].in) {
+				tmp_pool_high_water = slot->tmp_pools[i].in;
+			}
 		}
 
-		if (!records_to_copy) {
-			goto sleep;
+		arena_memory = 0;
+		for (i = 0; i < PINBA_HARVEST_SLOTS; i++) {
+			for (j = 0; j < D->thread_pool->size; j++) {
+				arena_memory += D->harvest_slots[i].arenas[j].allocated;
+			}
+		}
+
+		pthread_rwlock_wrlock(&D->stats_lock);
+		if (D->stats.arena_memory_peak < arena_memory) {
+			D->stats.arena_memory_peak = arena_memory;
+		}
+		D->stats.invalid_packets += invalid_packets;
+		D->stats.invalid_request_data += invalid_request_data;
+		D->stats.coalesced_requests += coalesced;
+		if (D->stats.tmp_pool_high_water < tmp_pool_high_water) {
+			D->stats.tmp_pool_high_water = tmp_pool_high_water;
+		}
+		pthread_rwlock_unlock(&D->stats_lock);
+
+		/* hand the slot over to the reports stage, which also gives the blocks back
+		   to the collector threads (only one thread may push to the free rings) */
+		pthread_mutex_lock(&D->harvest_mutex);
+		slot->records = records;
+		slot->time = launch;
+		slot->ready = 1;
+		pthread_cond_broadcast(&D->harvest_cond);
+		pthread_mutex_unlock(&D->harvest_mutex);
+		slot_num++;
+
+sleep:
+		/* give the memory of a burst back while there's nothing else to do */
+		pinba_harvest_slot_trim(D->harvest_slots + slot_num % PINBA_HARVEST_SLOTS);
+
+		/* tell the collector threads to hand over their current blocks before the next harvest */
+		__atomic_add_fetch(&D->collector_gen, 1, __ATOMIC_RELEASE);
+
+		/* adaptive mode: the quieter it is, the longer the harvester sleeps */
+		if (D->harvest_trigger_blocks > 0) {
+			if (packets) {
+				backoff = 1;
+			} else if (backoff < PINBA_HARVEST_MAX_BACKOFF) {
+				backoff *= 2;
+			}
+		}
+
+		launch.tv_sec += (D->settings.stats_gathering_period * backoff) / 1000000;
+		launch.tv_usec += (D->settings.stats_gathering_period * backoff) % 1000000;
+
+		if (launch.tv_usec > 1000000) {
+			launch.tv_usec -= 1000000;
+			launch.tv_sec++;
+		}
+
+		gettimeofday(&tv1, 0);
+		timersub(&launch, &tv1, &tv1);
+
+		if (LIKELY(tv1.tv_sec >= 0 && tv1.tv_usec >= 0)) {
+			if (D->harvest_trigger_blocks == 0) {
+				usleep(tv1.tv_sec * 1000000 + tv1.tv_usec);
+			} else if (pinba_harvest_wait(&launch)) {
+				/* the rings are filling up: run right now and count the next period from now */
+				gettimeofday(&launch, 0);
+				backoff = 1;
+
+				pthread_rwlock_wrlock(&D->stats_lock);
+				D->stats.early_harvests++;
+				pthread_rwlock_unlock(&D->stats_lock);
+			}
+		} else { /* we were locked too long: run right now, but re-schedule next launch */
+			gettimeofday(&launch, 0);
+			tv1.tv_sec = D->settings.stats_gathering_period / 1000000;
+			tv1.tv_usec = D->settings.stats_gathering_period % 1000000;
+			timeradd(&launch, &tv1, &launch);
+		}
+	}
+	/* not reachable */
+	return NULL;
+}
+/* }}} */
+
+void *pinba_reports_main(void *arg) /* {{{ */
+{
+	struct data_job_data *job_data_arr;
+	pinba_pool *request_pool = &D->request_pool;
+	thread_pool_barrier_t *barrier2, *barrier3;
+	struct reports_range_data range_data;
+	pinba_harvest_slot *slot;
+	size_t slot_num = 0;
+
+	barrier2 = (thread_pool_barrier_t *)malloc(sizeof(*barrier2));
+	barrier3 = (thread_pool_barrier_t *)malloc(sizeof(*barrier3));
+	th_pool_barrier_init(barrier2);
+	th_pool_barrier_init(barrier3);
+
+	pinba_debug("starting up reports thread");
+
+	/* yes, it's a minor memleak. once per process start. */
+	job_data_arr = (struct data_job_data *)malloc(sizeof(struct data_job_data) * D->thread_pool->size);
+	memset(&range_data, 0, sizeof(range_data));
+
+	for (;;) {
+		size_t records_to_add, timers_added, free_slots, records_created;
+		size_t accounted, lost_tmp_records = 0, lost_timers = 0, rtags_found;
+		size_t i;
+		int released = 0;
+
+		slot = D->harvest_slots + slot_num % PINBA_HARVEST_SLOTS;
+
+		/* wait for the decoding stage to fill the slot */
+		pthread_mutex_lock(&D->harvest_mutex);
+		while (!slot->ready && !D->in_shutdown) {
+			pthread_cond_wait(&D->harvest_cond, &D->harvest_mutex);
+		}
+		pthread_mutex_unlock(&D->harvest_mutex);
+
+		if (D->in_shutdown) {
+			return NULL;
 		}
 
+		/* Step 2: build the decoded requests right in the request pool and update the reports */
+
+		records_to_add = slot->records;
+		if (!records_to_add) {
+			goto release;
+		}
+
+		memset(job_data_arr, 0, sizeof(struct data_job_data) * D->thread_pool->size);
+
 		pthread_rwlock_wrlock(&D->collector_lock);
 
 		/* determine how much free slots we have in the request pool */
 		free_slots = request_pool->size - pinba_pool_num_records(request_pool) - 1;
-		if (free_slots < records_to_copy) {
-			lost_tmp_records = records_to_copy - free_slots;
+		if (free_slots < records_to_add) {
+			lost_tmp_records = records_to_add - free_slots;
 			pinba_error(P_WARNING, "%d free slots found in the request pool, throwing away %d new requests! increase your request pool size accordingly", free_slots, lost_tmp_records);
-			records_to_copy = free_slots;
+			records_to_add = free_slots;
 		}
 
-		stats_records = records_to_copy;
-
 		/* process new stats data and update base reports */
 		accounted = 0;
 		th_pool_barrier_start(barrier2);
 		for (i = 0; i < D->thread_pool->size; i++) {
-			pinba_pool *tmp_pool = D->per_thread_tmp_pool + i;
+			pinba_pool *tmp_pool = slot->tmp_pools + i;
 
 			if (tmp_pool->in == 0) {
 				continue;
 			}
 
+			job_data_arr[i].slot = slot;
+			job_data_arr[i].now = slot->time;
 			job_data_arr[i].start = accounted;
 			job_data_arr[i].thread_num = i;
 			job_data_arr[i].res_cnt = 0;
 			job_data_arr[i].timers_cnt = 0;
 			job_data_arr[i].end = tmp_pool->in;
-			if (tmp_pool->in > records_to_copy) {
-				job_data_arr[i].end = records_to_copy;
+			if (tmp_pool->in > records_to_add) {
+				job_data_arr[i].end = records_to_add;
 			}
 			accounted += job_data_arr[i].end;
-			records_to_copy -= job_data_arr[i].end;
-			th_pool_dispatch(D->thread_pool, barrier2, request_copy_job_func, &(job_data_arr[i]));
+			records_to_add -= job_data_arr[i].end;
+			th_pool_dispatch(D->thread_pool, barrier2, request_build_job_func, &(job_data_arr[i]));
 		}
 		th_pool_barrier_wait(barrier2);
 
@@ -1178,7 +2007,7 @@ void *pinba_data_main(void *arg) /* {{{ */
 		rtags_found = 0;
 		for (i = 0; i < D->thread_pool->size; i++) {
 			struct data_job_data *data = &job_data_arr[i];
-			pinba_pool *tmp_pool = D->per_thread_tmp_pool + i;
+			pinba_pool *tmp_pool = slot->tmp_pools + i;
 
 			records_created += data->res_cnt;
 			timers_added += data->timers_cnt;
@@ -1186,15 +2015,20 @@ void *pinba_data_main(void *arg) /* {{{ */
 			tmp_pool->in = 0;
 		}
 
+		if (timers_added == 0) {
+			/* the records are built, the decoded requests are not needed anymore */
+			pinba_harvest_slot_release(slot);
+			released = 1;
+		}
+
 		D->request_pool_counter += records_created;
 
-		if (records_created < (D->thread_pool->size * PINBA_THREAD_POOL_THRESHOLD_AMOUNT)) {
-			job_size = records_created;
-		} else {
-			job_size = records_created/D->thread_pool->size;
-		}
+		range_data.prefix = request_pool->in;
+		range_data.count = records_created;
+		range_data.add = 1;
+		range_data.timertag_cnt = NULL;
 
-		/* update base reports - one report per thread */
+		/* update base reports - a group of reports or shards of the large ones per thread */
 		pthread_rwlock_rdlock(&D->base_reports_lock);
 
 		for (i = 0; i < D->base_reports_arr.size; i++) {
@@ -1209,26 +2043,12 @@ void *pinba_data_main(void *arg) /* {{{ */
 			pthread_rwlock_unlock(&report->lock);
 		}
 
-		if (base_reports_alloc < D->base_reports_arr.size) {
-			base_reports_alloc = D->base_reports_arr.size * 2;
-			rep_job_data_arr = (struct reports_job_data *)realloc(rep_job_data_arr, sizeof(struct reports_job_data) * base_reports_alloc);
-		}
-
-		memset(rep_job_data_arr, 0, sizeof(struct reports_job_data) * base_reports_alloc);
-
-		th_pool_barrier_start(barrier4);
-		for (i= 0; i < D->base_reports_arr.size; i++) {
-			rep_job_data_arr[i].prefix = request_pool->in;
-			rep_job_data_arr[i].count = records_created;
-			rep_job_data_arr[i].report = D->base_reports_arr.data[i];
-			rep_job_data_arr[i].add = 1;
-			th_pool_dispatch(D->thread_pool, barrier4, update_reports_func, &(rep_job_data_arr[i]));
-		}
-		th_pool_barrier_wait(barrier4);
+		range_data.reports = &D->base_reports_arr;
+		pinba_update_base_reports(&range_data);
 		pthread_rwlock_unlock(&D->base_reports_lock);
 
 		if (rtags_found) {
-			/* update rtag reports - one report per thread */
+			/* update rtag reports - a group of reports per thread */
 			pthread_rwlock_rdlock(&D->rtag_reports_lock);
 
 			for (i = 0; i < D->rtag_reports_arr.size; i++) {
@@ -1243,43 +2063,46 @@ void *pinba_data_main(void *arg) /* {{{ */
 				pthread_rwlock_unlock(&report->lock);
 			}
 
-			if (rtag_reports_alloc < D->rtag_reports_arr.size) {
-				rtag_reports_alloc = D->rtag_reports_arr.size * 2;
-				rtag_rep_job_data_arr = (struct reports_job_data *)realloc(rtag_rep_job_data_arr, sizeof(struct reports_job_data) * rtag_reports_alloc);
-			}
-
-			memset(rtag_rep_job_data_arr, 0, sizeof(struct reports_job_data) * rtag_reports_alloc);
-
-			th_pool_barrier_start(barrier7);
-			for (i= 0; i < D->rtag_reports_arr.size; i++) {
-				rtag_rep_job_data_arr[i].prefix = request_pool->in;
-				rtag_rep_job_data_arr[i].count = records_created;
-				rtag_rep_job_data_arr[i].report = D->rtag_reports_arr.data[i];
-				rtag_rep_job_data_arr[i].add = 1;
-				th_pool_dispatch(D->thread_pool, barrier7, update_reports_func, &(rtag_rep_job_data_arr[i]));
-			}
-			th_pool_barrier_wait(barrier7);
+			range_data.reports = &D->rtag_reports_arr;
+			pinba_update_reports(&range_data);
 			pthread_rwlock_unlock(&D->rtag_reports_lock);
 		}
 
 		if (timers_added > 0) {
-			unsigned int timer_pool_in;
+			size_t timer_pool_in, timer_tags_added;
+			pinba_timer_tag *timer_tags;
 
 			/* create timers and update timer reports */
 			pthread_rwlock_wrlock(&D->timer_lock);
 
-			timer_pool_in = timer_pool_add(timers_added);
+			if (timer_pool_add(timers_added, &timer_pool_in) != P_SUCCESS) {
+				/* no room for the timers, the records are added without them */
+				pinba_error(P_WARNING, "failed to grow the timer pool, throwing away %zd new timers", timers_added);
+				lost_timers = timers_added;
+				pthread_rwlock_unlock(&D->timer_lock);
+				goto timers_lost;
+			}
+
+			timer_tags_added = 0;
+			for (i = 0; i < D->thread_pool->size; i++) {
+				timer_tags_added += job_data_arr[i].timer_tags_cnt;
+			}
+
+			/* one block for the tags of all the new timers, each job fills its own part of it in the order of the timers */
+			timer_tags = pinba_timer_tags_add(&D->timer_pool, timer_tags_added);
 
 			th_pool_barrier_start(barrier3);
 
 			timers_added = 0;
+			timer_tags_added = 0;
 			for (i = 0; i < D->thread_pool->size; i++) {
-				pinba_pool *temp_request_pool = D->current_read_pool + i;
-				if (temp_request_pool->in == 0) {
+				if (job_data_arr[i].end == 0) {
 					continue;
 				}
 				job_data_arr[i].timers_prefix = timers_added + timer_pool_in;
+				job_data_arr[i].timer_tags = timer_tags ? timer_tags + timer_tags_added : NULL;
 				timers_added += job_data_arr[i].timers_cnt;
+				timer_tags_added += job_data_arr[i].timer_tags_cnt;
 			}
 
 			pthread_rwlock_rdlock(&D->tag_reports_lock);
@@ -1296,53 +2119,32 @@ void *pinba_data_main(void *arg) /* {{{ */
 				pthread_rwlock_unlock(&report->lock);
 			}
 
-			records_to_copy = stats_records;
 			for (i = 0; i < D->thread_pool->size; i++) {
-				pinba_pool *temp_request_pool = D->current_read_pool + i;
-
-				if (temp_request_pool->in == 0) {
+				/* each job merges the timers of the records its copy job has moved to the request pool */
+				if (job_data_arr[i].end == 0) {
 					continue;
 				}
-
-				job_data_arr[i].thread_num = i;
-				job_data_arr[i].end = temp_request_pool->in;
-				if (temp_request_pool->in > records_to_copy) {
-					job_data_arr[i].end = records_to_copy;
-				}
-				records_to_copy -= job_data_arr[i].end;
 				th_pool_dispatch(D->thread_pool, barrier3, merge_timers_func, &(job_data_arr[i]));
 			}
 			th_pool_barrier_wait(barrier3);
 
+			/* the timers are merged, the decoded requests are not needed anymore */
+			pinba_harvest_slot_release(slot);
+			released = 1;
+
 			for (i = 0; i < D->thread_pool->size; i++) {
 				D->timertags_cnt += job_data_arr[i].timertag_cnt;
 			}
 
-			/* update tag reports - all threads share the reports */
-			accounted = 0;
-			th_pool_barrier_start(barrier5);
-			for (i= 0; i < D->thread_pool->size; i++) {
-				if (i == D->thread_pool->size - 1) {
-					job_size = stats_records - accounted;
-				}
-
-				tag_rep_job_data_arr[i].prefix = request_pool->in + accounted;
-				tag_rep_job_data_arr[i].count = job_size;
-				tag_rep_job_data_arr[i].add = 1;
-				accounted += job_size;
-
-				th_pool_dispatch(D->thread_pool, barrier5, update_tag_reports_func, &(tag_rep_job_data_arr[i]));
-
-				if (accounted == stats_records) {
-					break;
-				}
-			}
-			th_pool_barrier_wait(barrier5);
+			/* update tag reports - thread-local copies merged once per report */
+			range_data.reports = &D->tag_reports_arr;
+			pinba_update_tag_reports(&range_data);
 
 			pthread_rwlock_unlock(&D->tag_reports_lock);
 			pthread_rwlock_unlock(&D->timer_lock);
 		}
 
+timers_lost:
 		if ((request_pool->in + records_created) >= request_pool->size) {
 			request_pool->in = (request_pool->in + records_created) - request_pool->size;
 		} else {
@@ -1351,52 +2153,18 @@ void *pinba_data_main(void *arg) /* {{{ */
 
 		pthread_rwlock_unlock(&D->collector_lock);
 
-		for (i = 0; i < D->thread_pool->size; i++) {
-			pinba_pool *temp_request_pool = D->current_read_pool + i;
-			temp_request_pool->in = 0;
-			temp_request_pool->out = 0;
-		}
-/*
-		th_pool_barrier_start(barrier6);
-		for (i = 0; i < D->thread_pool->size; i++) {
-			pinba_pool *temp_request_pool = D->per_thread_request_pool[!D->pool_num] + i;
-
-			if (temp_request_pool->in == 0) {
-				break;
-			}
-			job_data_arr[i].thread_num = i;
-			th_pool_dispatch(D->thread_pool, barrier6, free_data_func, &(job_data_arr[i]));
-		}
-		th_pool_barrier_wait(barrier6);
-*/
-		if (invalid_packets > 0 || lost_tmp_records > 0) {
+		if (lost_tmp_records > 0 || lost_timers > 0) {
 			pthread_rwlock_wrlock(&D->stats_lock);
-			D->stats.invalid_packets += invalid_packets;
 			D->stats.lost_tmp_records += lost_tmp_records;
+			D->stats.lost_timers += lost_timers;
 			pthread_rwlock_unlock(&D->stats_lock);
 		}
 
-sleep:
-
-		launch.tv_sec += D->settings.stats_gathering_period / 1000000;
-		launch.tv_usec += D->settings.stats_gathering_period % 1000000;
-
-		if (launch.tv_usec > 1000000) {
-			launch.tv_usec -= 1000000;
-			launch.tv_sec++;
-		}
-
-		gettimeofday(&tv1, 0);
-		timersub(&launch, &tv1, &tv1);
-
-		if (LIKELY(tv1.tv_sec >= 0 && tv1.tv_usec >= 0)) {
-			usleep(tv1.tv_sec * 1000000 + tv1.tv_usec);
-		} else { /* we were locked too long: run right now, but re-schedule next launch */
-			gettimeofday(&launch, 0);
-			tv1.tv_sec = D->settings.stats_gathering_period / 1000000;
-			tv1.tv_usec = D->settings.stats_gathering_period % 1000000;
-			timeradd(&launch, &tv1, &launch);
+release:
+		if (!released) {
+			pinba_harvest_slot_release(slot);
 		}
+		slot_num++;
 	}
 	/* not reachable */
 	return NULL;
@@ -1479,6 +2247,266 @@ char *pinba_error_ex(int return_error, int type, const char *file, int line, con
 }
 /* }}} */
 
+static inline pinba_data_block *pinba_collector_block_get(pinba_collector_queue *q, size_t size) /* {{{ */
+{
+	pinba_data_block *block;
+
+	/* a stream frame larger than a block gets a block of its own */
+	if (size < PINBA_DATA_BLOCK_SIZE) {
+		size = PINBA_DATA_BLOCK_SIZE;
+	}
+
+	block = (pinba_data_block *)pinba_spsc_ring_pop(&q->free_ring);
+	if (block && block->size != size) {
+		/* don't keep the oversized blocks around */
+		free(block);
+		q->blocks_cnt--;
+		block = NULL;
+	}
+
+	if (!block) {
+		if (q->blocks_cnt == PINBA_DATA_RING_SIZE) {
+			/* all the blocks are waiting for the harvester */
+			return NULL;
+		}
+
+		block = (pinba_data_block *)malloc(sizeof(pinba_data_block) + size);
+		if (UNLIKELY(block == NULL)) {
+			return NULL;
+		}
+		block->data = (char *)(block + 1);
+		block->size = size;
+		q->blocks_cnt++;
+	}
+
+	block->used = 0;
+	block->cnt = 0;
+	block->gen = __atomic_load_n(&D->collector_gen, __ATOMIC_ACQUIRE);
+	return block;
+}
+/* }}} */
+
+static void pinba_harvest_trigger(void) /* {{{ */
+{
+	pthread_mutex_lock(&D->harvest_mutex);
+	D->harvest_triggered = 1;
+	pthread_cond_signal(&D->harvest_trigger_cond);
+	pthread_mutex_unlock(&D->harvest_mutex);
+}
+/* }}} */
+
+static inline int pinba_collector_block_flush(pinba_collector_queue *q) /* {{{ */
+{
+	if (pinba_spsc_ring_push(&q->full_ring, q->current) != P_SUCCESS) {
+		return P_FAILURE;
+	}
+	q->current = NULL;
+
+	/* adaptive mode: don't wait for the end of the period when the ring is filling up */
+	if (D->harvest_trigger_blocks > 0 && pinba_spsc_ring_count(&q->full_ring) >= D->harvest_trigger_blocks && !__atomic_load_n(&D->harvest_triggered, __ATOMIC_RELAXED)) {
+		pinba_harvest_trigger();
+	}
+	return P_SUCCESS;
+}
+/* }}} */
+
+static inline void pinba_collector_flush_stale(pinba_collector_queue *q) /* {{{ */
+{
+	/* the harvester has finished a cycle since the block was started,
+	   hand it over instead of waiting for it to fill up */
+	if (q->current && q->current->cnt > 0 && q->current->gen != __atomic_load_n(&D->collector_gen, __ATOMIC_ACQUIRE)) {
+		pinba_collector_block_flush(q);
+	}
+}
+/* }}} */
+
+static inline int pinba_data_bucket_copy(pinba_collector_queue *q, char *buf, size_t len) /* {{{ */
+{
+	pinba_data_bucket *bucket;
+	size_t size;
+
+	/* the bucket and the packet data go to the block one after another */
+	size = (sizeof(pinba_data_bucket) + len + 7) & ~(size_t)7;
+
+	if (q->current && q->current->used + size > q->current->size) {
+		if (pinba_collector_block_flush(q) != P_SUCCESS) {
+			goto drop;
+		}
+	}
+
+	if (!q->current) {
+		q->current = pinba_collector_block_get(q, size);
+		if (!q->current) {
+			goto drop;
+		}
+	}
+
+	bucket = (pinba_data_bucket *)(q->current->data + q->current->used);
+	bucket->buf = (char *)(bucket + 1);
+	bucket->len = len;
+	bucket->alloc_len = size;
+	memcpy(bucket->buf, buf, len);
+
+	q->current->used += size;
+	q->current->cnt++;
+	return P_SUCCESS;
+
+drop:
+	/* the ring is full, the harvester can't keep up */
+	__atomic_fetch_add(&q->drops, 1, __ATOMIC_RELAXED);
+	return P_FAILURE;
+}
+/* }}} */
+
+static inline unsigned long long pinba_monotonic_usec(void) /* {{{ */
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+/* }}} */
+
+/* with busy polling enabled the collector threads keep polling the socket without blocking
+   for busy_poll usec after the last received batch, and only then go to sleep in the kernel */
+static inline unsigned long long pinba_busy_poll_deadline(unsigned long long deadline) /* {{{ */
+{
+	if (D->settings.busy_poll <= 0) {
+		return 0;
+	}
+
+	if (deadline == 0) {
+		/* just woke up or got packets while spinning, (re)start the budget */
+		return pinba_monotonic_usec() + D->settings.busy_poll;
+	}
+
+	if (pinba_monotonic_usec() >= deadline) {
+		/* nothing arrived, block again */
+		return 0;
+	}
+	return deadline;
+}
+/* }}} */
+
+static inline void pinba_collector_tick(pinba_collector_queue *q, int sock) /* {{{ */
+{
+	unsigned int gen = __atomic_load_n(&D->collector_gen, __ATOMIC_ACQUIRE);
+
+	pinba_collector_flush_stale(q);
+
+	/* sample the socket receive buffer once per harvester cycle */
+	if (q->sample_gen == gen) {
+		return;
+	}
+	q->sample_gen = gen;
+
+	{
+		struct timespec ts;
+
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+			__atomic_store_n(&q->cpu_time, (size_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000, __ATOMIC_RELAXED);
+		}
+	}
+
+#ifdef SO_MEMINFO
+	{
+		uint32_t meminfo[SK_MEMINFO_VARS];
+		socklen_t len = sizeof(meminfo);
+
+		if (getsockopt(sock, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0) {
+			__atomic_store_n(&q->rcvbuf_used, (size_t)meminfo[SK_MEMINFO_RMEM_ALLOC], __ATOMIC_RELAXED);
+			__atomic_store_n(&q->rcvbuf_size, (size_t)meminfo[SK_MEMINFO_RCVBUF], __ATOMIC_RELAXED);
+			/* SO_RXQ_OVFL only reports the drops with the next queued packet */
+			if (meminfo[SK_MEMINFO_DROPS] > q->kernel_drops) {
+				__atomic_store_n(&q->kernel_drops, meminfo[SK_MEMINFO_DROPS], __ATOMIC_RELAXED);
+			}
+		}
+	}
+#else
+	{
+		int rcvbuf;
+		socklen_t len = sizeof(rcvbuf);
+
+		/* only the size is available here */
+		if (getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &len) == 0) {
+			__atomic_store_n(&q->rcvbuf_size, (size_t)rcvbuf, __ATOMIC_RELAXED);
+		}
+	}
+#endif
+}
+/* }}} */
+
+/* room for the UDP_GRO, SO_RXQ_OVFL and SO_TIMESTAMPNS control messages */
+#define PINBA_CMSG_SIZE (CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(struct timespec)))
+
+/* returns the UDP GRO segment size, saves the kernel drop counter of the socket
+   and adds the time the packet has spent in the socket until now to the receive delay */
+static inline size_t pinba_cmsg_parse(pinba_collector_queue *q, struct msghdr *msg, const struct timespec *now) /* {{{ */
+{
+	struct cmsghdr *cmsg;
+	size_t gso_size = 0;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+#ifdef UDP_GRO
+		if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+			int size;
+
+			memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+			gso_size = size > 0 ? size : 0;
+			continue;
+		}
+#endif
+#ifdef SO_RXQ_OVFL
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+			uint32_t drops;
+
+			/* the total number of packets dropped by the socket so far,
+			   only sent when it's not zero */
+			memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+			__atomic_store_n(&q->kernel_drops, drops, __ATOMIC_RELAXED);
+			continue;
+		}
+#endif
+#ifdef SO_TIMESTAMPNS
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			struct timespec ts;
+			long long delay;
+
+			memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+			delay = (long long)(now->tv_sec - ts.tv_sec) * 1000000 + (now->tv_nsec - ts.tv_nsec) / 1000;
+			if (delay >= 0) {
+				__atomic_store_n(&q->recv_delay, q->recv_delay + delay, __ATOMIC_RELAXED);
+				__atomic_store_n(&q->recv_delay_cnt, q->recv_delay_cnt + 1, __ATOMIC_RELAXED);
+			}
+		}
+#endif
+	}
+	return gso_size;
+}
+/* }}} */
+
+/* with UDP GRO the kernel may coalesce several datagrams from the same sender into one buffer,
+   all of them gso_size bytes long except for the last one, so we split them back here */
+static inline void pinba_data_push(pinba_collector_queue *q, char *buf, size_t len, size_t gso_size) /* {{{ */
+{
+	size_t seg_len;
+
+	if (gso_size == 0) {
+		gso_size = len;
+	}
+
+	while (len > 0) {
+		seg_len = len < gso_size ? len : gso_size;
+
+		/* dropped packets are counted, keep going */
+		pinba_data_bucket_copy(q, buf, seg_len);
+
+		buf += seg_len;
+		len -= seg_len;
+	}
+}
+/* }}} */
+
 #if PINBA_ENGINE_HAVE_RECVMMSG
 
 #define PINBA_VLEN 64
@@ -1492,15 +2520,18 @@ char *pinba_error_ex(int return_error, int type, const char *file, int line, con
 void pinba_eat_udp(pinba_socket *sock, size_t thread_num) /* {{{ */
 {
 	int i;
+	pinba_collector_queue *q = D->collector_queues + thread_num;
 	struct mmsghdr *msgs;
 	struct iovec *iovecs;
-	char *bufs;
+	char *bufs, *cmsgs;
+	unsigned long long spin_until = 0;
 
 	msgs = (struct mmsghdr *)calloc(PINBA_VLEN, sizeof(struct mmsghdr));
 	iovecs = (struct iovec *)calloc(PINBA_VLEN, sizeof(struct iovec));
 	bufs = (char *)calloc(PINBA_VLEN, PINBA_UDP_BUFFER_SIZE);
+	cmsgs = (char *)calloc(PINBA_VLEN, PINBA_CMSG_SIZE);
 
-	if (!msgs || !iovecs || !bufs) {
+	if (!msgs || !iovecs || !bufs || !cmsgs) {
 		pinba_error(P_ERROR, "out of memory");
 		return;
 	}
@@ -1510,40 +2541,43 @@ void pinba_eat_udp(pinba_socket *sock, size_t thread_num) /* {{{ */
 		iovecs[i].iov_len = PINBA_UDP_BUFFER_SIZE;
 		msgs[i].msg_hdr.msg_iov = &iovecs[i];
 		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = cmsgs + PINBA_CMSG_SIZE * i;
 	}
 
 	for (;;) {
 		int num;
 
-		num = recvmmsg(sock->listen_sock, msgs, PINBA_VLEN, PINBA_RECVMMSG_FLAGS, NULL);
+		/* the kernel overwrites it with the length of the received control data */
+		for (i = 0; i < PINBA_VLEN; i++) {
+			msgs[i].msg_hdr.msg_controllen = PINBA_CMSG_SIZE;
+		}
+
+		num = recvmmsg(sock->listen_sock, msgs, PINBA_VLEN, PINBA_RECVMMSG_FLAGS | (spin_until ? MSG_DONTWAIT : 0), NULL);
 
 		if (num > 0) {
-			pinba_pool *req_pool;
+			struct timespec now;
 
-			pthread_rwlock_rdlock(&D->per_thread_pools_lock);
-			req_pool = D->current_write_pool + thread_num;
+			if (spin_until) {
+				__atomic_store_n(&q->busy_polls, q->busy_polls + 1, __ATOMIC_RELAXED);
+			}
 
+			clock_gettime(CLOCK_REALTIME, &now);
 			for (i = 0; i < num; i++) {
 				if (msgs[i].msg_len > 0) {
-					Pinba__Request *request;
-					int ret;
-
-					request = pinba__request__unpack(NULL, msgs[i].msg_len, (const unsigned char *)bufs + PINBA_UDP_BUFFER_SIZE * i);
-					if (UNLIKELY(request == NULL)) {
-						//d->invalid_packets++;
-						continue;
-					}
-
-					ret = pinba_pool_push(req_pool, 0, request);
-					if (ret != P_SUCCESS) {
-						pinba__request__free_unpacked(request, NULL); /* XXX */
-						break; /* XXX */
-					}
+					pinba_data_push(q, bufs + PINBA_UDP_BUFFER_SIZE * i, msgs[i].msg_len, pinba_cmsg_parse(q, &msgs[i].msg_hdr, &now));
 				}
 			}
-
-			pthread_rwlock_unlock(&D->per_thread_pools_lock);
+			pinba_collector_tick(q, sock->listen_sock);
+			spin_until = pinba_busy_poll_deadline(0);
 		} else if (num < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				/* SO_RCVTIMEO expired or nothing to read while busy polling */
+				pinba_collector_tick(q, sock->listen_sock);
+				if (spin_until) {
+					spin_until = pinba_busy_poll_deadline(spin_until);
+				}
+				continue;
+			}
 			if (errno == EINTR) {
 				continue;
 			}
@@ -1557,44 +2591,216 @@ void pinba_eat_udp(pinba_socket *sock, size_t thread_num) /* {{{ */
 #else
 void pinba_eat_udp(pinba_socket *sock, size_t thread_num) /* {{{ */
 {
+	pinba_collector_queue *q = D->collector_queues + thread_num;
+	unsigned long long spin_until = 0;
+
 	for (;;) {
 		int ret;
-		unsigned char buf[PINBA_UDP_BUFFER_SIZE];
+		char buf[PINBA_UDP_BUFFER_SIZE];
+		char cmsg[PINBA_CMSG_SIZE];
+		struct iovec iov;
+		struct msghdr msg;
 
-		ret = recv(sock->listen_sock, buf, PINBA_UDP_BUFFER_SIZE, 0);
+		iov.iov_base = buf;
+		iov.iov_len = PINBA_UDP_BUFFER_SIZE;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cmsg;
+		msg.msg_controllen = PINBA_CMSG_SIZE;
 
-		if (ret > 0) {
-			pinba_pool *req_pool;
-			Pinba__Request *request;
+		ret = recvmsg(sock->listen_sock, &msg, spin_until ? MSG_DONTWAIT : 0);
 
-			pthread_rwlock_rdlock(&D->per_thread_pools_lock);
-			req_pool = D->current_write_pool + thread_num;
+		if (ret > 0) {
+			struct timespec now;
 
-			request = pinba__request__unpack(NULL, ret, (const unsigned char *)buf);
-			if (LIKELY(request != NULL)) {
-				int ret;
+			if (spin_until) {
+				__atomic_store_n(&q->busy_polls, q->busy_polls + 1, __ATOMIC_RELAXED);
+			}
 
-				ret = pinba_pool_push(req_pool, 0, request);
-				if (ret != P_SUCCESS) {
-					pinba__request__free_unpacked(request, NULL); /* XXX */
+			clock_gettime(CLOCK_REALTIME, &now);
+			pinba_data_push(q, buf, ret, pinba_cmsg_parse(q, &msg, &now));
+			pinba_collector_tick(q, sock->listen_sock);
+			spin_until = pinba_busy_poll_deadline(0);
+		} else if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				/* SO_RCVTIMEO expired or nothing to read while busy polling */
+				pinba_collector_tick(q, sock->listen_sock);
+				if (spin_until) {
+					spin_until = pinba_busy_poll_deadline(spin_until);
 				}
-			} else {
-				//d->invalid_packets++;
+				continue;
 			}
-			pthread_rwlock_unlock(&D->per_thread_pools_lock);
-		} else if (ret < 0) {
 			if (errno == EINTR) {
 				continue;
 			}
-			pinba_error(P_WARNING, "recv() failed: %s (%d)", strerror(errno), errno);
+			pinba_error(P_WARNING, "recvmsg() failed: %s (%d)", strerror(errno), errno);
 		} else {
-			pinba_error(P_WARNING, "recv() returned 0");
+			pinba_error(P_WARNING, "recvmsg() returned 0");
 		}
 	}
 }
 /* }}} */
 #endif
 
+static void pinba_stream_conn_close(pinba_stream_listener *l, size_t n) /* {{{ */
+{
+	close(l->conns[n].fd);
+	free(l->conns[n].buf);
+
+	/* move the last connection to the free slot */
+	l->conns_cnt--;
+	l->conns[n] = l->conns[l->conns_cnt];
+}
+/* }}} */
+
+static void pinba_stream_accept(pinba_stream_listener *l, int listen_fd) /* {{{ */
+{
+	pinba_stream_conn *c;
+	int fd;
+
+	fd = accept(listen_fd, NULL, NULL);
+	if (fd < 0) {
+		if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED) {
+			pinba_error(P_WARNING, "accept() failed: %s (%d)", strerror(errno), errno);
+		}
+		return;
+	}
+
+	if (l->conns_cnt == PINBA_STREAM_MAX_CONNECTIONS) {
+		pinba_error(P_WARNING, "too many stream connections (%d), closing the new one", PINBA_STREAM_MAX_CONNECTIONS);
+		close(fd);
+		return;
+	}
+
+	c = l->conns + l->conns_cnt;
+	c->buf = (char *)malloc(PINBA_STREAM_BUFFER_SIZE);
+	if (!c->buf) {
+		pinba_error(P_WARNING, "out of memory");
+		close(fd);
+		return;
+	}
+	c->fd = fd;
+	c->len = 0;
+	l->conns_cnt++;
+}
+/* }}} */
+
+static int pinba_stream_read(pinba_collector_queue *q, pinba_stream_conn *c) /* {{{ */
+{
+	size_t offset = 0;
+	ssize_t ret;
+
+	ret = read(c->fd, c->buf + c->len, PINBA_STREAM_BUFFER_SIZE - c->len);
+	if (ret == 0) {
+		/* the peer has closed the connection */
+		return P_FAILURE;
+	} else if (ret < 0) {
+		if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+			return P_SUCCESS;
+		}
+		pinba_error(P_WARNING, "read() failed: %s (%d)", strerror(errno), errno);
+		return P_FAILURE;
+	}
+	c->len += ret;
+
+	/* each frame is a 4-byte message length in network byte order followed by a Pinba.Request message */
+	while (c->len - offset >= sizeof(uint32_t)) {
+		uint32_t frame_len;
+
+		memcpy(&frame_len, c->buf + offset, sizeof(uint32_t));
+		frame_len = ntohl(frame_len);
+
+		if (frame_len == 0 || frame_len > PINBA_STREAM_MAX_FRAME_SIZE) {
+			pinba_error(P_WARNING, "invalid stream frame length %u, closing the connection", frame_len);
+			return P_FAILURE;
+		}
+
+		if (c->len - offset - sizeof(uint32_t) < frame_len) {
+			break;
+		}
+
+		pinba_data_push(q, c->buf + offset + sizeof(uint32_t), frame_len, 0);
+		offset += sizeof(uint32_t) + frame_len;
+	}
+
+	/* keep the incomplete frame for the next read */
+	if (offset > 0) {
+		memmove(c->buf, c->buf + offset, c->len - offset);
+		c->len -= offset;
+	}
+	return P_SUCCESS;
+}
+/* }}} */
+
+void *pinba_stream_main(void *arg) /* {{{ */
+{
+	pinba_collector_queue *q = D->collector_queues + (size_t)arg;
+	pinba_stream_listener *l = D->stream;
+	struct pollfd fds[PINBA_STREAM_MAX_CONNECTIONS + 2];
+	int timeout;
+
+	pinba_debug("starting up stream listener thread");
+
+	/* wake up from time to time to hand over partially filled blocks, see pinba_collector_timeout() */
+	timeout = pinba_collector_timeout() / 1000;
+
+	for (;;) {
+		size_t i, listeners_cnt, nfds = 0;
+		int ret;
+
+		if (l->tcp_socket) {
+			fds[nfds].fd = l->tcp_socket->listen_sock;
+			fds[nfds].events = POLLIN;
+			nfds++;
+		}
+
+		if (l->unix_socket) {
+			fds[nfds].fd = l->unix_socket->listen_sock;
+			fds[nfds].events = POLLIN;
+			nfds++;
+		}
+		listeners_cnt = nfds;
+
+		for (i = 0; i < l->conns_cnt; i++) {
+			fds[nfds].fd = l->conns[i].fd;
+			fds[nfds].events = POLLIN;
+			nfds++;
+		}
+
+		ret = poll(fds, nfds, timeout);
+		if (ret < 0) {
+			if (errno != EINTR) {
+				pinba_error(P_WARNING, "poll() failed: %s (%d)", strerror(errno), errno);
+			}
+			continue;
+		}
+
+		if (ret > 0) {
+			/* go backwards, closing a connection moves the last one in its place */
+			for (i = l->conns_cnt; i > 0; i--) {
+				if (fds[listeners_cnt + i - 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+					if (pinba_stream_read(q, l->conns + i - 1) != P_SUCCESS) {
+						pinba_stream_conn_close(l, i - 1);
+					}
+				}
+			}
+
+			for (i = 0; i < listeners_cnt; i++) {
+				if (fds[i].revents & POLLIN) {
+					pinba_stream_accept(l, fds[i].fd);
+				}
+			}
+		}
+
+		pinba_collector_flush_stale(q);
+	}
+
+	/* unreachable */
+	return NULL;
+}
+/* }}} */
+
 void pinba_socket_free(pinba_socket *socket) /* {{{ */
 {
 	if (!socket) {
@@ -1610,7 +2816,7 @@ void pinba_socket_free(pinba_socket *socket) /* {{{ */
 }
 /* }}} */
 
-pinba_socket *pinba_socket_open(char *ip, int listen_port) /* {{{ */
+pinba_socket *pinba_socket_open(char *ip, int listen_port, int reuseport, int udp_gro) /* {{{ */
 {
 	struct sockaddr_in addr;
 	pinba_socket *s;
@@ -1626,8 +2832,99 @@ pinba_socket *pinba_socket_open(char *ip, int listen_port) /* {{{ */
 		return NULL;
 	}
 
+	if (reuseport) {
+#ifdef SO_REUSEPORT
+		if (setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) == -1) {
+			pinba_error(P_ERROR, "setsockopt(SO_REUSEPORT) failed: %s (%d)", strerror(errno), errno);
+			close(sfd);
+			return NULL;
+		}
+#else
+		pinba_error(P_ERROR, "SO_REUSEPORT is not supported on this platform");
+		close(sfd);
+		return NULL;
+#endif
+	}
+
+#ifdef SO_RXQ_OVFL
+	/* kernel drop counter, see pinba_cmsg_parse() */
+	if (setsockopt(sfd, SOL_SOCKET, SO_RXQ_OVFL, &yes, sizeof(int)) == -1) {
+		pinba_error(P_WARNING, "setsockopt(SO_RXQ_OVFL) failed: %s (%d)", strerror(errno), errno);
+	}
+#endif
+
+#ifdef SO_TIMESTAMPNS
+	/* arrival time of the packets, for the receive delay */
+	if (setsockopt(sfd, SOL_SOCKET, SO_TIMESTAMPNS, &yes, sizeof(int)) == -1) {
+		pinba_error(P_WARNING, "setsockopt(SO_TIMESTAMPNS) failed: %s (%d)", strerror(errno), errno);
+	}
+#endif
+
+	if (udp_gro) {
+#ifdef UDP_GRO
+		if (setsockopt(sfd, SOL_UDP, UDP_GRO, &yes, sizeof(int)) == -1) {
+			pinba_error(P_ERROR, "setsockopt(UDP_GRO) failed: %s (%d)", strerror(errno), errno);
+			close(sfd);
+			return NULL;
+		}
+#else
+		pinba_error(P_ERROR, "UDP_GRO is not supported on this platform");
+		close(sfd);
+		return NULL;
+#endif
+	}
+
+	s = (pinba_socket *)calloc(1, sizeof(pinba_socket));
+	if (!s) {
+		return NULL;
+	}
+	s->listen_sock = sfd;
+
+	memset(&addr, 0, sizeof(addr));
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(listen_port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (ip && *ip) {
+		struct in_addr tmp;
+
+		if (inet_aton(ip, &tmp)) {
+			addr.sin_addr.s_addr = tmp.s_addr;
+		} else {
+			pinba_error(P_WARNING, "inet_aton(%s) failed, listening on ANY IP-address", ip);
+		}
+	}
+
+	if (bind(s->listen_sock, (struct sockaddr *)&addr, sizeof(addr))) {
+		pinba_socket_free(s);
+		pinba_error(P_ERROR, "bind() failed: %s (%d)", strerror(errno), errno);
+		return NULL;
+	}
+
+	return s;
+}
+/* }}} */
+
+pinba_socket *pinba_stream_socket_open(char *ip, int listen_port) /* {{{ */
+{
+	struct sockaddr_in addr;
+	pinba_socket *s;
+	int sfd, yes = 1;
+
+	if ((sfd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+		pinba_error(P_ERROR, "socket() failed: %s (%d)", strerror(errno), errno);
+		return NULL;
+	}
+
+	if(setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1) {
+		close(sfd);
+		return NULL;
+	}
+
 	s = (pinba_socket *)calloc(1, sizeof(pinba_socket));
 	if (!s) {
+		close(sfd);
 		return NULL;
 	}
 	s->listen_sock = sfd;
@@ -1654,6 +2951,72 @@ pinba_socket *pinba_socket_open(char *ip, int listen_port) /* {{{ */
 		return NULL;
 	}
 
+	/* poll() may report a connection that is gone by the time we accept() it */
+	fcntl(s->listen_sock, F_SETFL, fcntl(s->listen_sock, F_GETFL) | O_NONBLOCK);
+
+	if (listen(s->listen_sock, PINBA_STREAM_BACKLOG)) {
+		pinba_socket_free(s);
+		pinba_error(P_ERROR, "listen() failed: %s (%d)", strerror(errno), errno);
+		return NULL;
+	}
+
+	return s;
+}
+/* }}} */
+
+pinba_socket *pinba_unix_socket_open(char *path) /* {{{ */
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	pinba_socket *s;
+	int sfd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		pinba_error(P_ERROR, "unix socket path is too long: %s", path);
+		return NULL;
+	}
+
+	/* remove the socket left by the previous run, but nothing else */
+	if (lstat(path, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			pinba_error(P_ERROR, "%s exists and is not a socket", path);
+			return NULL;
+		}
+		unlink(path);
+	}
+
+	if ((sfd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		pinba_error(P_ERROR, "socket() failed: %s (%d)", strerror(errno), errno);
+		return NULL;
+	}
+
+	s = (pinba_socket *)calloc(1, sizeof(pinba_socket));
+	if (!s) {
+		close(sfd);
+		return NULL;
+	}
+	s->listen_sock = sfd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (bind(s->listen_sock, (struct sockaddr *)&addr, sizeof(addr))) {
+		pinba_socket_free(s);
+		pinba_error(P_ERROR, "bind(%s) failed: %s (%d)", path, strerror(errno), errno);
+		return NULL;
+	}
+
+	/* poll() may report a connection that is gone by the time we accept() it */
+	fcntl(s->listen_sock, F_SETFL, fcntl(s->listen_sock, F_GETFL) | O_NONBLOCK);
+
+	if (listen(s->listen_sock, PINBA_STREAM_BACKLOG)) {
+		pinba_socket_free(s);
+		unlink(path);
+		pinba_error(P_ERROR, "listen() failed: %s (%d)", strerror(errno), errno);
+		return NULL;
+	}
+
 	return s;
 }
 /* }}} */
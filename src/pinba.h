@@ -78,7 +78,9 @@ extern pinba_daemon *D;
 #endif
 
 void *pinba_data_main(void *arg);
+void *pinba_reports_main(void *arg);
 void *pinba_collector_main(void *arg);
+void *pinba_stream_main(void *arg);
 void *pinba_stats_main(void *arg);
 int pinba_collector_init(pinba_daemon_settings settings);
 void pinba_collector_shutdown();
@@ -89,7 +91,9 @@ int pinba_process_stats_packet(const unsigned char *buffer, int buffer_len);
 
 void pinba_eat_udp(pinba_socket *socket, size_t thread_num);
 void pinba_socket_free(pinba_socket *socket);
-pinba_socket *pinba_socket_open(char *ip, int listen_port);
+pinba_socket *pinba_socket_open(char *ip, int listen_port, int reuseport, int udp_gro);
+pinba_socket *pinba_stream_socket_open(char *ip, int listen_port);
+pinba_socket *pinba_unix_socket_open(char *path);
 
 void pinba_tag_dtor(pinba_tag *tag);
 int pinba_tag_put(const unsigned char *name);
@@ -159,10 +163,9 @@ int pinba_delete_report_tables(char *index);
                  i = (i == 0) ? ((pool)->size - 1) : i - 1)
 
 #define TMP_POOL(pool) ((pinba_tmp_stats_record *)((pool)->data))
-#define REQ_DATA_POOL(pool) ((Pinba__Request **)((pool)->data))
 #define REQ_POOL(pool) ((pinba_stats_record *)((pool)->data))
 #define REQ_POOL_EX(pool) ((pinba_stats_record_ex *)((pool)->data))
-#define TIMER_POOL(pool) ((pinba_timer_record *)((pool)->data))
+#define TIMER_POOL_GET(pool, id) ((pool)->segments[((id) >> PINBA_TIMER_SEGMENT_SHIFT) & (pool)->segments_mask] + ((id) & (PINBA_TIMER_SEGMENT_SIZE - 1)))
 #define POOL_DATA(pool) ((void **)((pool)->data))
 
 #define memcpy_static(buf, str, str_len, result_len)	\
@@ -202,9 +205,23 @@ do {										\
 size_t pinba_pool_num_records(pinba_pool *p);
 int pinba_pool_init(pinba_pool *p, size_t size, size_t element_size, size_t limit_size, size_t grow_size, pool_dtor_func_t dtor, char *pool_name);
 int pinba_pool_grow(pinba_pool *p, size_t more);
+void pinba_pool_set_numa_node(pinba_pool *p, int node);
+void pinba_numa_bind(void *ptr, size_t size, int node);
 void pinba_pool_destroy(pinba_pool *p);
 int pinba_pool_push(pinba_pool *p, size_t grow_size, void *data);
 
+int pinba_arena_init(pinba_arena *a, size_t chunk_size);
+void *pinba_arena_alloc(pinba_arena *a, size_t size);
+void pinba_arena_reset(pinba_arena *a);
+size_t pinba_arena_trim(pinba_arena *a);
+void pinba_arena_destroy(pinba_arena *a);
+
+int pinba_spsc_ring_init(pinba_spsc_ring *r, size_t size);
+int pinba_spsc_ring_push(pinba_spsc_ring *r, void *data);
+void *pinba_spsc_ring_pop(pinba_spsc_ring *r);
+size_t pinba_spsc_ring_count(pinba_spsc_ring *r);
+void pinba_spsc_ring_destroy(pinba_spsc_ring *r);
+
 /* utility macros */
 
 #define timeval_to_float(tv) ((float)(tv).tv_sec + ((float)(tv).tv_usec / 1000000.0))
@@ -221,10 +238,43 @@ static inline struct timeval float_to_timeval(double f) /* {{{ */
 }
 /* }}} */
 
+/* the timer values are kept in microseconds */
+#define float_to_usec(f) ((int64_t)((f) * 1000000.0))
+#define usec_to_float(usec) ((float)(usec) / 1000000.0)
+
+static inline struct timeval usec_to_timeval(int64_t usec) /* {{{ */
+{
+	struct timeval t;
+
+	t.tv_sec = usec / 1000000;
+	t.tv_usec = usec % 1000000;
+	return t;
+}
+/* }}} */
+
+static inline void timeval_add_usec(struct timeval *tv, int64_t usec) /* {{{ */
+{
+	struct timeval t = usec_to_timeval(usec);
+
+	timeradd(tv, &t, tv);
+}
+/* }}} */
+
+static inline void timeval_sub_usec(struct timeval *tv, int64_t usec) /* {{{ */
+{
+	struct timeval t = usec_to_timeval(usec);
+
+	timersub(tv, &t, tv);
+}
+/* }}} */
+
 #define pinba_pool_is_full(pool) ((pool->in < pool->out) ? pool->size - (pool->out - pool->in) : (pool->in - pool->out)) == (pool->size - 1)
 
-#define record_get_timer(pool, record, i) (((record->timers_start + i) >= (pool)->size) ? (TIMER_POOL((pool)) + (record->timers_start + i - (pool)->size)) : (TIMER_POOL((pool)) + (record->timers_start + i)))
-#define record_get_timer_id(pool, record, i) ((record->timers_start + i) >= (pool)->size) ? ((record->timers_start + i) - (pool)->size) : ((record->timers_start + i))
+#define record_get_timer(pool, record, i) TIMER_POOL_GET((pool), (record)->timers_start + (i))
+#define record_get_timer_id(pool, record, i) (((record)->timers_start + (i)) & PINBA_TIMER_ID_MASK)
+#define pinba_timer_pool_num_records(pool) (((pool)->in - (pool)->out) & PINBA_TIMER_ID_MASK)
+/* the id is between out and in */
+#define pinba_timer_pool_has_id(pool, id) ((((id) - (pool)->out) & PINBA_TIMER_ID_MASK) < pinba_timer_pool_num_records(pool))
 
 #define CHECK_REPORT_CONDITIONS_CONTINUE(report, record)																\
 	if (report->flags & PINBA_REPORT_CONDITIONAL) {																		\
@@ -266,27 +316,50 @@ static inline struct timeval float_to_timeval(double f) /* {{{ */
 int pinba_timer_mutex_lock();
 int pinba_timer_mutex_unlock();
 
-void pinba_per_thread_request_pool_dtor(void *pool);
 void pinba_per_thread_tmp_pool_dtor(void *pool);
 
 void pinba_data_pool_dtor(void *pool);
 void pinba_temp_pool_dtor(void *pool);
 void pinba_request_pool_dtor(void *pool);
-void pinba_timer_pool_dtor(void *pool);
 
-int timer_pool_add(int timers_cnt);
+int pinba_timer_pool_init(pinba_timer_pool *p, size_t size);
+void pinba_timer_pool_set_numa_node(pinba_timer_pool *p, int node);
+void pinba_timer_pool_destroy(pinba_timer_pool *p);
+pinba_timer_tag *pinba_timer_tags_add(pinba_timer_pool *p, size_t tags_cnt);
+void pinba_timer_tags_release(pinba_timer_pool *p);
+int timer_pool_add(size_t timers_cnt, size_t *first_id);
 
 void update_reports_func(void *job_data);
-void update_tag_reports_func(void *job_data);
+void update_reports_range_func(void *arg, size_t start, size_t end, size_t worker);
+void pinba_update_reports(struct reports_range_data *r);
+void pinba_update_base_reports(struct reports_range_data *r);
+void pinba_update_tag_reports(struct reports_range_data *r);
+void update_tag_reports_range_func(void *arg, size_t start, size_t end, size_t worker);
+void clear_record_timers_range_func(void *arg, size_t start, size_t end, size_t worker);
 
 void pinba_get_rusage(struct rusage *data);
 void pinba_report_add_rusage(void *report, struct rusage *start_rusage);
 pinba_word *pinba_dictionary_word_get_or_insert_rdlock(char *str, int str_len);
+void pinba_dictionary_compact(void);
 
-static inline void pinba_update_histogram(pinba_std_report *report, void **histogram_data, const struct timeval *time, const int add) /* {{{ */
+/* a new reference must be taken under words_lock, so that pinba_dictionary_compact() doesn't free the word meanwhile */
+static inline void pinba_word_ref(pinba_word *word) /* {{{ */
+{
+	__atomic_add_fetch(&word->refcount, 1, __ATOMIC_RELAXED);
+}
+/* }}} */
+
+static inline void pinba_word_unref(pinba_word *word) /* {{{ */
+{
+	if (__atomic_sub_fetch(&word->refcount, 1, __ATOMIC_RELAXED) == 0) {
+		__atomic_add_fetch(&D->words_unreferenced, 1, __ATOMIC_RELAXED);
+	}
+}
+/* }}} */
+
+static inline void pinba_update_histogram_value(pinba_std_report *report, void **histogram_data, float time_value, const int add) /* {{{ */
 {
 	unsigned int slot_num;
-	float time_value = timeval_to_float(*time);
 	size_t value;
 
 	if (add > 1) {
@@ -314,10 +387,18 @@ static inline void pinba_update_histogram(pinba_std_report *report, void **histo
 }
 /* }}} */
 
+static inline void pinba_update_histogram(pinba_std_report *report, void **histogram_data, const struct timeval *time, const int add) /* {{{ */
+{
+	pinba_update_histogram_value(report, histogram_data, timeval_to_float(*time), add);
+}
+/* }}} */
+
 #define PINBA_UPDATE_HISTOGRAM_ADD(report, data, value) pinba_update_histogram((pinba_std_report *)(report), &(data), &(value), 1);
 #define PINBA_UPDATE_HISTOGRAM_DEL(report, data, value) pinba_update_histogram((pinba_std_report *)(report), &(data), &(value), -1);
 #define PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data, value, cnt) pinba_update_histogram((pinba_std_report *)(report), &(data), &(value), (cnt));
 #define PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data, value, cnt) pinba_update_histogram((pinba_std_report *)(report), &(data), &(value), -(cnt));
+#define PINBA_UPDATE_HISTOGRAM_ADD_USEC(report, data, usec, cnt) pinba_update_histogram_value((pinba_std_report *)(report), &(data), usec_to_float(usec), (cnt));
+#define PINBA_UPDATE_HISTOGRAM_DEL_USEC(report, data, usec, cnt) pinba_update_histogram_value((pinba_std_report *)(report), &(data), usec_to_float(usec), -(cnt));
 
 #define PINBA_REPORT_DELETE_CHECK(report, record) if (timercmp(&(report)->std.start, &(record)->time, >) || (timercmp(&(report)->std.start, &(record)->time, ==) && (report)->std.request_pool_start_id > (record)->counter)) { return; }
 
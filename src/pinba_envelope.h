@@ -0,0 +1,57 @@
+/*
+   Compressed batch envelope, see pinba.proto:
+     PINBA_ENVELOPE_MAGIC, 4 bytes big-endian uncompressed size, raw LZ4 block.
+   The uncompressed data is a regular Pinba.Request with the batch in its nested requests.
+
+   The functions only look at the given buffer, so they are shared by the decoding
+   stage (see pinba_envelope_unpack() in main.cc) and tests/envelope_test.c.
+*/
+
+#ifndef PINBA_ENVELOPE_H
+# define PINBA_ENVELOPE_H
+
+#include <string.h>
+#include "pinba_limits.h"
+#include "lz4.h"
+
+/* a Pinba.Request can't start with a zero byte, so everything else is left to the protobuf decoder */
+static inline int pinba_envelope_check(const unsigned char *buf, size_t len) /* {{{ */
+{
+	return len > PINBA_ENVELOPE_HEADER_SIZE && memcmp(buf, PINBA_ENVELOPE_MAGIC, PINBA_ENVELOPE_MAGIC_SIZE) == 0;
+}
+/* }}} */
+
+/* the uncompressed size of an envelope accepted by pinba_envelope_check(), 0 if it's out of the limits */
+static inline unsigned int pinba_envelope_size(const unsigned char *buf, size_t len) /* {{{ */
+{
+	unsigned int size;
+
+	if (len <= PINBA_ENVELOPE_HEADER_SIZE) {
+		return 0;
+	}
+
+	size = ((unsigned int)buf[4] << 24) | ((unsigned int)buf[5] << 16) | ((unsigned int)buf[6] << 8) | buf[7];
+	if (size > PINBA_ENVELOPE_MAX_SIZE) {
+		return 0;
+	}
+	return size;
+}
+/* }}} */
+
+/* fills dst with exactly size bytes, any other outcome (truncated, overlong or malformed block) is an error */
+static inline int pinba_envelope_decompress(const unsigned char *buf, size_t len, char *dst, unsigned int size) /* {{{ */
+{
+	size_t src_len = len - PINBA_ENVELOPE_HEADER_SIZE;
+
+	if (src_len > PINBA_ENVELOPE_MAX_SIZE) {
+		return -1;
+	}
+
+	if (LZ4_decompress_safe((const char *)buf + PINBA_ENVELOPE_HEADER_SIZE, dst, (int)src_len, (int)size) != (int)size) {
+		return -1;
+	}
+	return 0;
+}
+/* }}} */
+
+#endif
@@ -8,19 +8,19 @@ $REPORTS = array(
 	array( /* report by script name */
 		'id' => 1,
 		'index_d' => 'const char *index',
-		'create_index' => 'index = (const char *)record->data.script_name',
+		'create_index' => 'index = (const char *)record->data.script_name->str',
 		'assign_data' => ''
 	),
 	array( /* report by server name (domain name) */
 		'id' => 2,
 		'index_d' => 'const char *index',
-		'create_index' => 'index = (const char *)record->data.server_name',
+		'create_index' => 'index = (const char *)record->data.server_name->str',
 		'assign_data' => ''
 	),
 	array( /* report by hostname */
 		'id' => 3,
 		'index_d' => 'const char *index',
-		'create_index' => 'index = (const char *)record->data.hostname',
+		'create_index' => 'index = (const char *)record->data.hostname->str',
 		'assign_data' => ''
 	),
 	array( /* report by server name and script name */
@@ -28,14 +28,14 @@ $REPORTS = array(
 		'index_d' => 'char index[PINBA_SERVER_NAME_SIZE + PINBA_SCRIPT_NAME_SIZE + 1] = {0}',
 		'create_index' =>
 		"
-		memcpy_static(index, record->data.server_name, record->data.server_name_len, index_len);
+		memcpy_static(index, record->data.server_name->str, record->data.server_name->len, index_len);
 		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
 		",
 		'assign_data' =>
 		"
-		memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		"
 	),
 	array( /* report by hostname and script name */
@@ -43,14 +43,14 @@ $REPORTS = array(
 		'index_d' => 'char index[PINBA_HOSTNAME_SIZE + PINBA_SCRIPT_NAME_SIZE + 1] = {0}',
 		'create_index' =>
 		"
-		memcpy_static(index, record->data.hostname, record->data.hostname_len, index_len);
+		memcpy_static(index, record->data.hostname->str, record->data.hostname->len, index_len);
 		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
 		",
 		'assign_data' =>
 		"
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		"
 	),
 	array( /* report by hostname and server name */
@@ -58,14 +58,14 @@ $REPORTS = array(
 		'index_d' => 'char index[PINBA_HOSTNAME_SIZE + PINBA_SERVER_NAME_SIZE + 1] = {0}',
 		'create_index' =>
 		"
-		memcpy_static(index, record->data.hostname, record->data.hostname_len, index_len);
+		memcpy_static(index, record->data.hostname->str, record->data.hostname->len, index_len);
 		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.server_name, record->data.server_name_len, index_len);
+		memcat_static(index, index_len, record->data.server_name->str, record->data.server_name->len, index_len);
 		",
 		'assign_data' =>
 		"
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-		memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+		memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
 		"
 	),
 	array( /* report by hostname, server name and script name */
@@ -73,17 +73,17 @@ $REPORTS = array(
 		'index_d' => 'char index[PINBA_HOSTNAME_SIZE + 1 + PINBA_SERVER_NAME_SIZE + 1 + PINBA_SCRIPT_NAME_SIZE] = {0}',
 		'create_index' =>
 		"
-		memcpy_static(index, record->data.hostname, record->data.hostname_len, index_len);
+		memcpy_static(index, record->data.hostname->str, record->data.hostname->len, index_len);
 		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
-		memcat_static(index, index_len, record->data.server_name, record->data.server_name_len, index_len);
+		memcat_static(index, index_len, record->data.server_name->str, record->data.server_name->len, index_len);
 		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
 		",
 		'assign_data' =>
 		"
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-		memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+		memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		"
 	),
 	array( /* report by HTTP status */
@@ -104,12 +104,12 @@ $REPORTS = array(
 		'create_index' =>
 		'
         index_len = sprintf((char *)index, "%u:", record->data.status);
-        memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
+        memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
 		',
 		'assign_data' =>
 		"
 		data->status = record->data.status;
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		"
 	),
 	array( /* report by HTTP status and server name */
@@ -118,12 +118,12 @@ $REPORTS = array(
 		'create_index' =>
 		'
 		index_len = sprintf((char *)index, "%u", record->data.status);
-		memcat_static(index, index_len, record->data.server_name, record->data.server_name_len, index_len);
+		memcat_static(index, index_len, record->data.server_name->str, record->data.server_name->len, index_len);
 		',
 		'assign_data' =>
 		"
 		data->status = record->data.status;
-		memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
+		memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
 		"
 	),
 	array( /* report by HTTP status and hostname */
@@ -132,12 +132,12 @@ $REPORTS = array(
 		'create_index' =>
 		'
 		index_len = sprintf((char *)index, "%u", record->data.status);
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
 		',
 		'assign_data' =>
 		"
 		data->status = record->data.status;
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
 		"
 	),
 	array( /* report by HTTP status, hostname and script name */
@@ -145,22 +145,22 @@ $REPORTS = array(
 		'index_d' => 'char index[PINBA_STATUS_SIZE + 1 + PINBA_HOSTNAME_SIZE + 1 + PINBA_SCRIPT_NAME_SIZE] = {0}',
 		'create_index' => <<<C
 		index_len = sprintf((char *)index, "%u", record->data.status);
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
 		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
 C
 		,
 		'assign_data' =>
 		"
 		data->status = record->data.status;
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		"
 	),
 	array( /* report by schema */
 		'id' => 13,
 		'index_d' => 'const char *index',
-		'create_index' => 'index = (const char *)record->data.schema',
+		'create_index' => 'index = (const char *)record->data.schema->str',
 		'assign_data' =>
 		''
 	),
@@ -169,14 +169,14 @@ C
 		'index_d' => 'char index[PINBA_SCHEMA_SIZE + PINBA_SCRIPT_NAME_SIZE + 1] = {0}',
 		'create_index' =>
 		"
-		memcpy_static(index, record->data.schema, record->data.schema_len, index_len);
+		memcpy_static(index, record->data.schema->str, record->data.schema->len, index_len);
 		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
 		",
 		'assign_data' =>
 		"
-		memcpy_static(data->schema, record->data.schema, record->data.schema_len, dummy);
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->schema, record->data.schema->str, record->data.schema->len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		"
 	),
 	array( /* report by schema and server name */
@@ -184,14 +184,14 @@ C
 		'index_d' => 'char index[PINBA_SCHEMA_SIZE + PINBA_SERVER_NAME_SIZE + 1] = {0}',
 		'create_index' =>
 		"
-		memcpy_static(index, record->data.schema, record->data.schema_len, index_len);
+		memcpy_static(index, record->data.schema->str, record->data.schema->len, index_len);
 		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
-		memcat_static(index, index_len, record->data.server_name, record->data.server_name_len, index_len);
+		memcat_static(index, index_len, record->data.server_name->str, record->data.server_name->len, index_len);
 		",
 		'assign_data' =>
 		"
-		memcpy_static(data->schema, record->data.schema, record->data.schema_len, dummy);
-		memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
+		memcpy_static(data->schema, record->data.schema->str, record->data.schema->len, dummy);
+		memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
 		"
 	),
 	array( /* report by schema and hostname */
@@ -199,14 +199,14 @@ C
 		'index_d' => 'char index[PINBA_SCHEMA_SIZE + PINBA_HOSTNAME_SIZE + 1] = {0}',
 		'create_index' =>
 		"
-		memcpy_static(index, record->data.schema, record->data.schema_len, index_len);
+		memcpy_static(index, record->data.schema->str, record->data.schema->len, index_len);
 		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
 		",
 		'assign_data' =>
 		"
-		memcpy_static(data->schema, record->data.schema, record->data.schema_len, dummy);
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
+		memcpy_static(data->schema, record->data.schema->str, record->data.schema->len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
 		"
 	),
 	array( /* report by schema, hostname and script name */
@@ -214,17 +214,17 @@ C
 		'index_d' => 'char index[PINBA_SCHEMA_SIZE + 1 + PINBA_HOSTNAME_SIZE + 1 + PINBA_SCRIPT_NAME_SIZE] = {0}',
 		'create_index' =>
 		"
-		memcpy_static(index, record->data.schema, record->data.schema_len, index_len);
+		memcpy_static(index, record->data.schema->str, record->data.schema->len, index_len);
 		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
 		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
 		",
 		'assign_data' =>
 		"
-		memcpy_static(data->schema, record->data.schema, record->data.schema_len, dummy);
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->schema, record->data.schema->str, record->data.schema->len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		"
 	),
 	array( /* report by schema, hostname and status */
@@ -232,16 +232,16 @@ C
 		'index_d' => 'char index[PINBA_SCHEMA_SIZE + 1 + PINBA_HOSTNAME_SIZE + 1 + PINBA_STATUS_SIZE] = {0}',
 		'create_index' => <<<C
 		index_len = sprintf((char *)index, "%u:", record->data.status);
-		memcat_static(index, index_len, record->data.schema, record->data.schema_len, index_len);
+		memcat_static(index, index_len, record->data.schema->str, record->data.schema->len, index_len);
 		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
 C
 		,
 		'assign_data' =>
 		"
 		data->status = record->data.status;
-		memcpy_static(data->schema, record->data.schema, record->data.schema_len, dummy);
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
+		memcpy_static(data->schema, record->data.schema->str, record->data.schema->len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
 		"
 	),
 );
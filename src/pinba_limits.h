@@ -22,13 +22,36 @@
 #define PINBA_UDP_BUFFER_SIZE 65536
 
 #define PINBA_DICTIONARY_GROW_SIZE 32
+#define PINBA_DICTIONARY_ARENA_CHUNK_SIZE 1048576
+#define PINBA_DICTIONARY_COMPACT_MIN 4096 /* unreferenced words to look for the dead ones */
 #define PINBA_TIMER_POOL_GROW_SIZE 2621440
 #define PINBA_TIMER_POOL_SHRINK_SIZE PINBA_TIMER_POOL_GROW_SIZE*5
+#define PINBA_TIMER_SEGMENT_SHIFT 16 /* 65536 timers per timer pool segment */
+#define PINBA_TIMER_SEGMENT_SIZE (1 << PINBA_TIMER_SEGMENT_SHIFT)
+#define PINBA_TIMER_ID_MASK 0x7fffffff /* timer ids are shown in the int(11) columns */
+#define PINBA_TIMER_SEGMENT_NUM_MASK (PINBA_TIMER_ID_MASK >> PINBA_TIMER_SEGMENT_SHIFT)
 
 #define PINBA_THREAD_POOL_DEFAULT_SIZE 8
-#define PINBA_THREAD_POOL_THRESHOLD_AMOUNT 16
-#define PINBA_MIN_TAG_VALUES_CNT_MAGIC_NUMBER 8
+#define PINBA_THREAD_POOL_RECORDS_GRAIN 1024 /* records per th_pool_parallel_for() part */
+#define PINBA_REPORT_SHARD_MIN_RESULTS 4096 /* larger base reports are split between the threads by the hash of the index */
+#define PINBA_FUSED_RECORDS_BLOCK 256 /* records applied to all reports of a group before moving on to the next ones, see tests/ingest_bench -R */
+#define PINBA_FUSED_REPORTS_MAX 64 /* max reports updated by one thread in one pass over the records */
 #define PINBA_PER_THREAD_POOL_GROW_SIZE 1024
 #define PINBA_TEMP_DICTIONARY_SIZE 1024
+#define PINBA_ARENA_CHUNK_SIZE 1048576
+#define PINBA_CACHE_LINE_SIZE 64
+#define PINBA_DATA_BLOCK_SIZE 262144 /* must fit PINBA_UDP_BUFFER_SIZE, larger stream frames get blocks of their own */
+#define PINBA_DATA_RING_SIZE 128 /* blocks per collector thread, must be a power of 2 */
+#define PINBA_COLLECTOR_MIN_TIMEOUT 1000 /* usec */
+#define PINBA_HARVEST_MAX_BACKOFF 8 /* max idle harvester period, in stats gathering periods, must be a power of 2 */
+#define PINBA_HARVEST_SLOTS 2 /* harvester cycles in flight: one being decoded, one being added to the reports */
+#define PINBA_STREAM_MAX_CONNECTIONS 64
+#define PINBA_STREAM_BUFFER_SIZE 1048576
+#define PINBA_STREAM_MAX_FRAME_SIZE (PINBA_STREAM_BUFFER_SIZE - 4) /* a whole frame and its 4-byte length must fit the connection buffer */
+#define PINBA_STREAM_BACKLOG 128
+#define PINBA_ENVELOPE_MAGIC "\0PZ4" /* a protobuf message can't start with a zero byte */
+#define PINBA_ENVELOPE_MAGIC_SIZE 4
+#define PINBA_ENVELOPE_HEADER_SIZE 8 /* magic + big-endian uncompressed size */
+#define PINBA_ENVELOPE_MAX_SIZE 16777216
 
 #endif
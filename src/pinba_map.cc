@@ -20,14 +20,26 @@ struct xxhash {
 typedef  google::dense_hash_map<const char*, const void*, xxhash, eqstr> dense_hash_t;
 //typedef  std::unordered_map<const char*, const void*, xxhash, eqstr> dense_hash_t;
 
+/* a sharded map keeps its data in sub-maps chosen by the hash of the index,
+   so that the sub-maps can be updated by different threads at the same time */
 class pinba_map {
 	public:
 		dense_hash_t hash_map;
+		pinba_map **shards; /* sub-maps of a sharded map, NULL otherwise */
+		size_t shards_cnt; /* number of sub-maps of the sharded map this map is part of */
+		size_t shard_num;
 		~pinba_map() {};
-		pinba_map() {
+		pinba_map() : shards(NULL), shards_cnt(1), shard_num(0) {
 			hash_map.set_empty_key(NULL);
 			hash_map.set_deleted_key("");
 		}
+		size_t shard_of(const char *index) {
+			/* the low bits of the hash are used by the sub-maps themselves */
+			return (XXH64(index, strlen(index), 2001) >> 32) % shards_cnt;
+		}
+		pinba_map *route(const char *index) {
+			return shards ? shards[shard_of(index)] : this;
+		}
 		int data_add(const char *index, const void *report);
 		int data_delete(const char *index);
 		void *data_first(char *first_index);
@@ -40,7 +52,7 @@ class pinba_map {
 
 
 int pinba_map::is_empty() {
-	return hash_map.empty();
+	return size() == 0;
 }
 
 int pinba_map::data_add(const char *index, const void *report) /* {{{ */
@@ -64,6 +76,19 @@ int pinba_map::data_delete(const char *index) /* {{{ */
 
 void *pinba_map::data_first(char *index_to_fill) /* {{{ */
 {
+	if (shards) {
+		void *data;
+		size_t i;
+
+		for (i = 0; i < shards_cnt; i++) {
+			data = shards[i]->data_first(index_to_fill);
+			if (data) {
+				return data;
+			}
+		}
+		return NULL;
+	}
+
 	dense_hash_t::iterator it = hash_map.begin();
 	if (it == hash_map.end()) {
 		return NULL;
@@ -75,6 +100,17 @@ void *pinba_map::data_first(char *index_to_fill) /* {{{ */
 
 void *pinba_map::data_next(char *index_to_fill) /* {{{ */
 {
+	if (shards) {
+		void *data;
+		size_t i = shard_of(index_to_fill);
+
+		data = shards[i]->data_next(index_to_fill);
+		/* continue with the next non-empty sub-map */
+		for (i++; !data && i < shards_cnt; i++) {
+			data = shards[i]->data_first(index_to_fill);
+		}
+		return data;
+	}
 
 	dense_hash_t::iterator it = hash_map.find(index_to_fill);
 	if (it == hash_map.end()) {
@@ -95,6 +131,15 @@ void pinba_map::clear()  /* {{{ */
 {
 	dense_hash_t::iterator old_it, it = hash_map.begin();
 
+	if (shards) {
+		size_t i;
+
+		for (i = 0; i < shards_cnt; i++) {
+			shards[i]->clear();
+		}
+		return;
+	}
+
 	while (it != hash_map.end()) {
 		char *key = (char *)it->first;
 
@@ -119,6 +164,14 @@ void *pinba_map::data_get(const char *index) /* {{{ */
 
 size_t pinba_map::size() /* {{{ */
 {
+	if (shards) {
+		size_t i, res = 0;
+
+		for (i = 0; i < shards_cnt; i++) {
+			res += shards[i]->size();
+		}
+		return res;
+	}
 	return hash_map.size();
 }
 /* }}} */
@@ -153,7 +206,7 @@ void *pinba_map_get(void *map_report, const char *index) /* {{{ */
 	}
 	pinba_map *map = static_cast<pinba_map*>(map_report);
 
-	return map->data_get(index);
+	return map->route(index)->data_get(index);
 }
 /* }}} */
 
@@ -165,7 +218,7 @@ void *pinba_map_add(void *map_report, const char *index, const void *data) /* {{
 	} else {
 		map = static_cast<pinba_map*>(map_report);
 	}
-	map->data_add(index, data);
+	map->route(index)->data_add(index, data);
 
 	return map;
 }
@@ -184,7 +237,7 @@ int pinba_map_delete(void *map_report, const char *index) /* {{{ */
 	}
 
 	pinba_map *map  = static_cast<pinba_map*>(map_report);
-	map->data_delete(index);
+	map->route(index)->data_delete(index);
 
 	if (map->is_empty()) {
 		return -1;
@@ -202,6 +255,14 @@ void pinba_map_destroy(void *data) /* {{{ */
 
 	pinba_map *map  = static_cast<pinba_map*>(data);
 	map->clear();
+	if (map->shards) {
+		size_t i;
+
+		for (i = 0; i < map->shards_cnt; i++) {
+			delete map->shards[i];
+		}
+		free(map->shards);
+	}
 	delete map;
 }
 /* }}} */
@@ -217,3 +278,67 @@ size_t pinba_map_count(void *map_report) /* {{{ */
 }
 /* }}} */
 
+
+void *pinba_map_reshard(void *map_report, size_t shards_cnt) /* {{{ */
+{
+	pinba_map *map, *old_map = static_cast<pinba_map *>(map_report);
+	dense_hash_t::iterator it;
+	size_t i;
+
+	if (old_map && old_map->shards) {
+		return old_map;
+	}
+
+	map = new pinba_map();
+	map->shards = (pinba_map **)calloc(shards_cnt, sizeof(pinba_map *));
+	map->shards_cnt = shards_cnt;
+	for (i = 0; i < shards_cnt; i++) {
+		map->shards[i] = new pinba_map();
+		map->shards[i]->shards_cnt = shards_cnt;
+		map->shards[i]->shard_num = i;
+	}
+
+	if (old_map) {
+		/* move the keys over, they're already strdup()'ed */
+		for (it = old_map->hash_map.begin(); it != old_map->hash_map.end(); it++) {
+			map->route(it->first)->hash_map[it->first] = it->second;
+		}
+		delete old_map;
+	}
+	return map;
+}
+/* }}} */
+
+size_t pinba_map_shards_count(void *map_report) /* {{{ */
+{
+	pinba_map *map = static_cast<pinba_map *>(map_report);
+
+	if (!map || !map->shards) {
+		return 1;
+	}
+	return map->shards_cnt;
+}
+/* }}} */
+
+void *pinba_map_shard(void *map_report, size_t shard_num) /* {{{ */
+{
+	pinba_map *map = static_cast<pinba_map *>(map_report);
+
+	if (!map || !map->shards) {
+		return map;
+	}
+	return map->shards[shard_num];
+}
+/* }}} */
+
+int pinba_map_owns(void *map_report, const char *index) /* {{{ */
+{
+	pinba_map *map = static_cast<pinba_map *>(map_report);
+
+	/* only a sub-map is limited to its own part of the indexes */
+	if (!map || map->shards || map->shards_cnt == 1) {
+		return 1;
+	}
+	return map->shard_of(index) == map->shard_num;
+}
+/* }}} */
@@ -10,4 +10,9 @@ void pinba_map_destroy(void *data);
 void *pinba_map_create();
 size_t pinba_map_count(void *map_report);
 
+void *pinba_map_reshard(void *map_report, size_t shards_cnt);
+size_t pinba_map_shards_count(void *map_report);
+void *pinba_map_shard(void *map_report, size_t shard_num);
+int pinba_map_owns(void *map_report, const char *index);
+
 #endif /* HAVE_PINBA_MAP_H */
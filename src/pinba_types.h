@@ -23,6 +23,7 @@ typedef enum {
 	PINBA_TABLE_UNKNOWN,
 	PINBA_TABLE_STATUS, /* internal status table */
 	PINBA_TABLE_ACTIVE_REPORTS, /* internal status table */
+	PINBA_TABLE_COLLECTORS, /* internal status table */
 	PINBA_TABLE_REQUEST,
 	PINBA_TABLE_TIMER,
 	PINBA_TABLE_TIMERTAG,
@@ -93,45 +94,62 @@ typedef struct _struct timeval { /* {{{ */
 #endif
 
 typedef struct _pinba_word { /* {{{ */
-	char *str;
+	char *str; /* in D->words_arena, moved by pinba_dictionary_compact() */
 	unsigned char len;
+	unsigned int refcount; /* records, timers and reports using the word */
 	uint64_t hash;
 } pinba_word;
 /* }}} */
 
+typedef struct _pinba_timer_tag { /* {{{ */
+	int id;
+	pinba_word *value;
+} pinba_timer_tag;
+/* }}} */
+
+/* 48 bytes on 64-bit systems, the times are in microseconds;
+   the tags are in the tag block of the cycle the timer was added in */
 typedef struct _pinba_timer_record { /* {{{ */
-	struct timeval value;
-	int *tag_ids;
-	pinba_word **tag_values;
-	unsigned short tag_num;
-	unsigned short tag_num_allocated;
+	int64_t value;
+	int64_t ru_utime;
+	int64_t ru_stime;
+	pinba_timer_tag *tags;
+	unsigned int request_id;
 	int hit_count;
-	int index;
-	size_t request_id;
+	unsigned short tag_num;
 	unsigned short num_in_request;
-	struct timeval ru_utime;
-	struct timeval ru_stime;
 } pinba_timer_record;
 /* }}} */
 
+typedef struct _pinba_timer_tag_block pinba_timer_tag_block;
+
+/* the tags of the timers added in one cycle, freed once all of the timers are deleted */
+struct _pinba_timer_tag_block { /* {{{ */
+	pinba_timer_tag_block *next;
+	size_t timers_end; /* the id after the last timer of the cycle */
+	size_t size;
+	pinba_timer_tag tags[1];
+};
+/* }}} */
+
+/* the request pool stays an array of records: one array per field only pays off for the
+   info report, the keyed reports are bound by the lookup (see "ingest_bench scan") */
 typedef struct _pinba_stats_record { /* {{{ */
 	struct {
-		char script_name[PINBA_SCRIPT_NAME_SIZE];
-		char server_name[PINBA_SERVER_NAME_SIZE];
-		char hostname[PINBA_HOSTNAME_SIZE];
+		/* the dimensions are interned in the dictionary, the sizes from pinba_limits.h apply */
+		pinba_word *script_name;
+		pinba_word *server_name;
+		pinba_word *hostname;
+		pinba_word *schema;
 		struct timeval req_time;
 		struct timeval ru_utime;
 		struct timeval ru_stime;
-		unsigned char script_name_len;
-		unsigned char server_name_len;
-		unsigned char hostname_len;
-		unsigned int req_count;
+		unsigned int weight; /* requests merged into this one by pinba_tmp_pool_coalesce(), 1 otherwise */
+		unsigned int req_count; /* request_count of the packet, the reports count the records by their weight */
 		float doc_size;
 		float mem_peak_usage;
-		unsigned short status;
 		float memory_footprint;
-		char schema[PINBA_SCHEMA_SIZE];
-		unsigned char schema_len;
+		unsigned short status;
 		pinba_word **tag_names; //PINBA_TAG_NAME_SIZE applies here
 		pinba_word **tag_values; //PINBA_TAG_VALUE_SIZE applies here
 		unsigned int tags_cnt;
@@ -144,14 +162,14 @@ typedef struct _pinba_stats_record { /* {{{ */
 } pinba_stats_record;
 /* }}} */
 
+/* a decoded request waiting to be added to the request pool */
 typedef struct _pinba_stats_record_ex { /* {{{ */
-	pinba_stats_record record;
 	Pinba__Request *request;
 	pinba_word **words;
 	unsigned words_alloc;
 	unsigned words_cnt;
+	unsigned weight;
 	size_t request_id;
-	char can_free;
 } pinba_stats_record_ex;
 /* }}} */
 
@@ -159,6 +177,9 @@ typedef void (*pool_dtor_func_t)(void *pool);
 
 #define PINBA_POOL_NAME_SIZE 256
 
+#define PINBA_NUMA_LOCAL -1 /* the pool data is wherever its pages were touched first */
+#define PINBA_NUMA_INTERLEAVE -2 /* the pool data is spread between the nodes */
+
 typedef struct _pinba_pool { /* {{{ */
 	size_t size;
 	size_t limit_size;
@@ -168,10 +189,130 @@ typedef struct _pinba_pool { /* {{{ */
 	size_t in;
 	size_t out;
 	char name[PINBA_POOL_NAME_SIZE];
+	int numa_node; /* PINBA_NUMA_LOCAL, PINBA_NUMA_INTERLEAVE or the node to keep the data on */
 	void **data;
 } pinba_pool;
 /* }}} */
 
+/* a ring of timer ids backed by fixed-size segments which never move once allocated,
+   so growing it touches neither the timers nor record->timers_start;
+   the timer with id N is in segments[(N >> PINBA_TIMER_SEGMENT_SHIFT) & segments_mask] */
+typedef struct _pinba_timer_pool { /* {{{ */
+	pinba_timer_record **segments; /* NULL until the ids reach the slot */
+	size_t segments_mask;
+	size_t segments_cnt; /* allocated segments */
+	size_t size; /* timers in the allocated segments */
+	size_t in; /* ids wrap at PINBA_TIMER_ID_MASK, not at the size */
+	size_t out;
+	int numa_node;
+	pinba_timer_tag_block *tag_blocks; /* the oldest first */
+	pinba_timer_tag_block *tag_blocks_tail;
+} pinba_timer_pool;
+/* }}} */
+
+typedef struct _pinba_arena_chunk pinba_arena_chunk;
+
+struct _pinba_arena_chunk { /* {{{ */
+	pinba_arena_chunk *next;
+	size_t size;
+	size_t used;
+	char *data;
+};
+/* }}} */
+
+typedef struct _pinba_arena { /* {{{ */
+	pinba_arena_chunk *head;
+	pinba_arena_chunk *current;
+	size_t chunk_size;
+	size_t allocated;
+	size_t used_high; /* decaying high-water of the bytes used per cycle, see pinba_arena_trim() */
+	ProtobufCAllocator allocator;
+} pinba_arena;
+/* }}} */
+
+typedef struct _pinba_spsc_ring { /* {{{ */
+	size_t head; /* written by the consumer only */
+	char pad1[PINBA_CACHE_LINE_SIZE - sizeof(size_t)];
+	size_t tail; /* written by the producer only */
+	char pad2[PINBA_CACHE_LINE_SIZE - sizeof(size_t)];
+	size_t mask;
+	void **data;
+} pinba_spsc_ring;
+/* }}} */
+
+typedef struct _pinba_data_block { /* {{{ */
+	size_t size; /* PINBA_DATA_BLOCK_SIZE, or more for a stream frame that doesn't fit */
+	size_t used;
+	size_t cnt;
+	unsigned int gen;
+	char *data;
+} pinba_data_block;
+/* }}} */
+
+typedef struct _pinba_collector_queue { /* {{{ */
+	pinba_spsc_ring full_ring; /* collector -> harvester */
+	pinba_spsc_ring free_ring; /* harvester -> collector */
+	/* collector side */
+	pinba_data_block *current;
+	size_t blocks_cnt;
+	size_t drops;
+	unsigned int kernel_drops; /* SO_RXQ_OVFL counter of the socket */
+	size_t rcvbuf_used; /* sampled once per harvester cycle */
+	size_t rcvbuf_size;
+	unsigned int sample_gen;
+	size_t busy_polls; /* batches received while busy polling */
+	size_t cpu_time; /* usec, sampled once per harvester cycle */
+	size_t recv_delay; /* usec the packets spent in the socket before recv*mmsg() returned them, summed */
+	size_t recv_delay_cnt; /* packets with a kernel timestamp */
+	/* harvester side */
+	size_t packets;
+	size_t ring_occupancy;
+	size_t invalid_packets;
+	size_t invalid_request_data;
+} pinba_collector_queue;
+/* }}} */
+
+typedef struct _pinba_harvest_block { /* {{{ */
+	pinba_data_block *block;
+	size_t queue; /* the collector queue it was taken from */
+} pinba_harvest_block;
+/* }}} */
+
+typedef struct _pinba_harvest_queue { /* {{{ */
+	pinba_data_block **blocks; /* taken from the collector queue's full ring */
+	size_t blocks_cnt;
+	size_t packets;
+} pinba_harvest_queue;
+/* }}} */
+
+/* the data of one harvester cycle, passed from the decoding stage to the reports stage */
+typedef struct _pinba_harvest_slot { /* {{{ */
+	pinba_harvest_queue *queues; /* one per collector queue */
+	pinba_harvest_block *blocks; /* the blocks of all queues, decoded by th_pool_parallel_for() */
+	size_t blocks_cnt;
+	pinba_pool *tmp_pools; /* one per thread pool job */
+	pinba_arena *arenas; /* one per thread pool job */
+	size_t records;
+	struct timeval time; /* harvest time, the time of all the records */
+	int ready; /* protected by harvest_mutex */
+} pinba_harvest_slot;
+/* }}} */
+
+typedef struct _pinba_stream_conn { /* {{{ */
+	int fd;
+	size_t len;
+	char *buf;
+} pinba_stream_conn;
+/* }}} */
+
+typedef struct _pinba_stream_listener { /* {{{ */
+	pinba_socket *tcp_socket;
+	pinba_socket *unix_socket;
+	pinba_stream_conn conns[PINBA_STREAM_MAX_CONNECTIONS];
+	size_t conns_cnt;
+} pinba_stream_listener;
+/* }}} */
+
 typedef struct _pinba_tag { /* {{{ */
 	size_t id;
 	char name[PINBA_TAG_NAME_SIZE];
@@ -277,6 +418,14 @@ typedef struct _pinba_daemon_settings { /* {{{ */
 	size_t data_job_size;
 	size_t histogram_size;
 	unsigned int log_level;
+	int reuseport;
+	int udp_gro;
+	int busy_poll;
+	int stream_port;
+	char *stream_socket;
+	int coalesce_requests;
+	int harvest_fill_threshold;
+	int numa;
 } pinba_daemon_settings;
 /* }}} */
 
@@ -289,8 +438,19 @@ typedef struct _pinba_data_bucket { /* {{{ */
 
 typedef struct _pinba_int_stats {
 	size_t lost_tmp_records;
+	size_t lost_timers; /* thrown away when the timer pool couldn't grow */
 	size_t invalid_packets;
 	size_t invalid_request_data;
+	size_t ring_occupancy;
+	size_t ring_drops;
+	size_t coalesced_requests;
+	size_t harvest_latency; /* usec between the last two harvests */
+	size_t tmp_pool_high_water; /* max records decoded by one thread in one harvest */
+	size_t early_harvests;
+	size_t arena_memory; /* bytes held by the decoding arenas */
+	size_t arena_memory_peak;
+	size_t arena_memory_freed; /* bytes given back by pinba_arena_trim() */
+	size_t dictionary_words_freed; /* by pinba_dictionary_compact() */
 } pinba_int_stats_t;
 
 typedef struct _pinba_array {
@@ -306,18 +466,26 @@ typedef struct _pinba_daemon { /* {{{ */
 	pthread_rwlock_t base_reports_lock;
 	pthread_rwlock_t timer_lock;
 	pthread_rwlock_t words_lock;
-	pinba_socket *collector_socket;
+	pinba_socket **collector_sockets;
+	size_t collector_sockets_cnt;
 	size_t request_pool_counter;
 	pinba_pool request_pool;
-	pinba_pool timer_pool;
+	pinba_timer_pool timer_pool;
 	pthread_mutex_t temp_mutex;
-	int pool_num;
-	pinba_pool *per_thread_request_pool[2];
-	pinba_pool *current_read_pool;
-	pinba_pool *current_write_pool;
-	pthread_rwlock_t per_thread_pools_lock;
-	pinba_pool *per_thread_tmp_pool;
+	pinba_collector_queue *collector_queues;
+	size_t collector_queues_cnt;
+	pinba_stream_listener *stream;
+	unsigned int collector_gen;
+	pinba_harvest_slot harvest_slots[PINBA_HARVEST_SLOTS];
+	pthread_mutex_t harvest_mutex;
+	pthread_cond_t harvest_cond;
+	pthread_cond_t harvest_trigger_cond; /* collector threads -> harvester, adaptive mode only */
+	int harvest_triggered; /* protected by harvest_mutex */
+	size_t harvest_trigger_blocks; /* full ring blocks to start a harvest early, 0 if disabled */
 	void *dictionary;
+	pinba_arena words_arena; /* the strings of the words, protected by words_lock */
+	size_t words_arena_used; /* bytes of the strings of the words in the dictionary */
+	size_t words_unreferenced; /* words added or released since the last pinba_dictionary_compact(), atomic */
 	size_t timertags_cnt;
 	struct {
 		void *table; /* ID -> NAME */
@@ -331,6 +499,9 @@ typedef struct _pinba_daemon { /* {{{ */
 	void *rtag_reports;
 	pinba_array_t rtag_reports_arr;
 	thread_pool_t *thread_pool;
+	unsigned long numa_nodemask; /* the nodes the pools are placed on, 0 if the NUMA-aware mode is off */
+	int *numa_cpus; /* the CPUs ordered by their nodes */
+	int *worker_nodes; /* the node of every thread pool worker */
 	pinba_int_stats_t stats;
 	pthread_rwlock_t stats_lock;
 	void *tables_to_reports;
@@ -350,15 +521,49 @@ struct reports_job_data {
 	int add;
 };
 
+/* a part of a base report updated by one thread, see pinba_update_base_reports() */
+struct report_shard_job {
+	pinba_report *report;
+	pinba_report shard; /* copy of the report with its own results sub-map and totals, merged into the report afterwards */
+	size_t results_cnt; /* results_cnt of the report before the update */
+	size_t shards_cnt;
+};
+
+/* a thread's own part of a tag report, see pinba_update_tag_reports() */
+struct tag_report_delta {
+	pinba_tag_report delta; /* copy of the report with its own results map, merged into the report afterwards */
+	char *index; /* scratch buffers of the copy, kept between the cycles */
+	size_t index_size;
+	pinba_word **words;
+	size_t words_cnt;
+};
+
+/* th_pool_parallel_for() argument: the range is either the reports or the records */
+struct reports_range_data {
+	unsigned int prefix;
+	unsigned int count;
+	pinba_array_t *reports;
+	int add;
+	size_t *timertag_cnt; /* one per thread */
+	struct report_shard_job *shard_jobs;
+	size_t shard_jobs_alloc;
+	struct tag_report_delta *tag_deltas; /* thread * reports count + report */
+	size_t tag_deltas_alloc;
+};
+
 struct pinba_report_data_header {
 	void *histogram_data;
 	size_t req_count;
 };
 
+/* the common beginning of all tag report data structs */
 struct pinba_tag_report_data_header {
 	void *histogram_data;
 	size_t req_count;
 	size_t hit_count;
+	struct timeval timer_value;
+	struct timeval ru_utime_value;
+	struct timeval ru_stime_value;
 };
 
 struct pinba_report1_data { /* {{{ */
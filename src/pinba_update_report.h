@@ -22,6 +22,17 @@ void pinba_update_report_info_add(size_t request_id, void *rep, const pinba_stat
 	struct pinba_report_info_data *data;
 	/*struct pinba_report1_data *data;*/
 	;
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !1
+	;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -30,15 +41,10 @@ void pinba_update_report_info_add(size_t request_id, void *rep, const pinba_stat
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 1
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		;
-
 		data = (struct pinba_report_info_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -52,13 +58,13 @@ void pinba_update_report_info_add(size_t request_id, void *rep, const pinba_stat
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -69,6 +75,7 @@ void pinba_update_report_info_delete(size_t request_id, void *rep, const pinba_s
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report_info_data *data;
 	;
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -76,6 +83,15 @@ void pinba_update_report_info_delete(size_t request_id, void *rep, const pinba_s
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !1
+	;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -83,34 +99,29 @@ void pinba_update_report_info_delete(size_t request_id, void *rep, const pinba_s
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 1
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		;
-
 		data = (struct pinba_report_info_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -124,6 +135,17 @@ void pinba_update_report1_add(size_t request_id, void *rep, const pinba_stats_re
 	struct pinba_report1_data *data;
 	/*struct pinba_report1_data *data;*/
 	const char *index;
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	index = (const char *)record->data.script_name->str;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -132,15 +154,10 @@ void pinba_update_report1_add(size_t request_id, void *rep, const pinba_stats_re
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		index = (const char *)record->data.script_name;
-
 		data = (struct pinba_report1_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -154,13 +171,13 @@ void pinba_update_report1_add(size_t request_id, void *rep, const pinba_stats_re
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -171,6 +188,7 @@ void pinba_update_report1_delete(size_t request_id, void *rep, const pinba_stats
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report1_data *data;
 	const char *index;
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -178,6 +196,15 @@ void pinba_update_report1_delete(size_t request_id, void *rep, const pinba_stats
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	index = (const char *)record->data.script_name->str;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -185,34 +212,29 @@ void pinba_update_report1_delete(size_t request_id, void *rep, const pinba_stats
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		index = (const char *)record->data.script_name;
-
 		data = (struct pinba_report1_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -226,6 +248,17 @@ void pinba_update_report2_add(size_t request_id, void *rep, const pinba_stats_re
 	struct pinba_report2_data *data;
 	/*struct pinba_report1_data *data;*/
 	const char *index;
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	index = (const char *)record->data.server_name->str;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -234,15 +267,10 @@ void pinba_update_report2_add(size_t request_id, void *rep, const pinba_stats_re
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		index = (const char *)record->data.server_name;
-
 		data = (struct pinba_report2_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -256,13 +284,13 @@ void pinba_update_report2_add(size_t request_id, void *rep, const pinba_stats_re
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -273,6 +301,7 @@ void pinba_update_report2_delete(size_t request_id, void *rep, const pinba_stats
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report2_data *data;
 	const char *index;
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -280,6 +309,15 @@ void pinba_update_report2_delete(size_t request_id, void *rep, const pinba_stats
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	index = (const char *)record->data.server_name->str;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -287,34 +325,29 @@ void pinba_update_report2_delete(size_t request_id, void *rep, const pinba_stats
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		index = (const char *)record->data.server_name;
-
 		data = (struct pinba_report2_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -328,6 +361,17 @@ void pinba_update_report3_add(size_t request_id, void *rep, const pinba_stats_re
 	struct pinba_report3_data *data;
 	/*struct pinba_report1_data *data;*/
 	const char *index;
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	index = (const char *)record->data.hostname->str;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -336,15 +380,10 @@ void pinba_update_report3_add(size_t request_id, void *rep, const pinba_stats_re
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		index = (const char *)record->data.hostname;
-
 		data = (struct pinba_report3_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -358,13 +397,13 @@ void pinba_update_report3_add(size_t request_id, void *rep, const pinba_stats_re
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -375,6 +414,7 @@ void pinba_update_report3_delete(size_t request_id, void *rep, const pinba_stats
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report3_data *data;
 	const char *index;
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -382,6 +422,15 @@ void pinba_update_report3_delete(size_t request_id, void *rep, const pinba_stats
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	index = (const char *)record->data.hostname->str;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -389,34 +438,29 @@ void pinba_update_report3_delete(size_t request_id, void *rep, const pinba_stats
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		index = (const char *)record->data.hostname;
-
 		data = (struct pinba_report3_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -430,6 +474,21 @@ void pinba_update_report4_add(size_t request_id, void *rep, const pinba_stats_re
 	struct pinba_report4_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_SERVER_NAME_SIZE + PINBA_SCRIPT_NAME_SIZE + 1] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	
+		memcpy_static(index, record->data.server_name->str, record->data.server_name->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -438,19 +497,10 @@ void pinba_update_report4_add(size_t request_id, void *rep, const pinba_stats_re
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.server_name, record->data.server_name_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
-		;
-
 		data = (struct pinba_report4_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -459,21 +509,21 @@ void pinba_update_report4_add(size_t request_id, void *rep, const pinba_stats_re
 
 			data->histogram_data = pinba_lmap_create();
 			
-		memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -484,6 +534,7 @@ void pinba_update_report4_delete(size_t request_id, void *rep, const pinba_stats
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report4_data *data;
 	char index[PINBA_SERVER_NAME_SIZE + PINBA_SCRIPT_NAME_SIZE + 1] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -491,6 +542,19 @@ void pinba_update_report4_delete(size_t request_id, void *rep, const pinba_stats
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	
+		memcpy_static(index, record->data.server_name->str, record->data.server_name->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -498,38 +562,29 @@ void pinba_update_report4_delete(size_t request_id, void *rep, const pinba_stats
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.server_name, record->data.server_name_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
-		;
-
 		data = (struct pinba_report4_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -543,6 +598,21 @@ void pinba_update_report5_add(size_t request_id, void *rep, const pinba_stats_re
 	struct pinba_report5_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_HOSTNAME_SIZE + PINBA_SCRIPT_NAME_SIZE + 1] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	
+		memcpy_static(index, record->data.hostname->str, record->data.hostname->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -551,19 +621,10 @@ void pinba_update_report5_add(size_t request_id, void *rep, const pinba_stats_re
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.hostname, record->data.hostname_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
-		;
-
 		data = (struct pinba_report5_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -572,21 +633,21 @@ void pinba_update_report5_add(size_t request_id, void *rep, const pinba_stats_re
 
 			data->histogram_data = pinba_lmap_create();
 			
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -597,6 +658,7 @@ void pinba_update_report5_delete(size_t request_id, void *rep, const pinba_stats
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report5_data *data;
 	char index[PINBA_HOSTNAME_SIZE + PINBA_SCRIPT_NAME_SIZE + 1] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -604,6 +666,19 @@ void pinba_update_report5_delete(size_t request_id, void *rep, const pinba_stats
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	
+		memcpy_static(index, record->data.hostname->str, record->data.hostname->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -611,38 +686,29 @@ void pinba_update_report5_delete(size_t request_id, void *rep, const pinba_stats
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.hostname, record->data.hostname_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
-		;
-
 		data = (struct pinba_report5_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -656,6 +722,21 @@ void pinba_update_report6_add(size_t request_id, void *rep, const pinba_stats_re
 	struct pinba_report6_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_HOSTNAME_SIZE + PINBA_SERVER_NAME_SIZE + 1] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	
+		memcpy_static(index, record->data.hostname->str, record->data.hostname->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.server_name->str, record->data.server_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -664,19 +745,10 @@ void pinba_update_report6_add(size_t request_id, void *rep, const pinba_stats_re
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.hostname, record->data.hostname_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.server_name, record->data.server_name_len, index_len);
-		;
-
 		data = (struct pinba_report6_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -685,21 +757,21 @@ void pinba_update_report6_add(size_t request_id, void *rep, const pinba_stats_re
 
 			data->histogram_data = pinba_lmap_create();
 			
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-		memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+		memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -710,6 +782,7 @@ void pinba_update_report6_delete(size_t request_id, void *rep, const pinba_stats
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report6_data *data;
 	char index[PINBA_HOSTNAME_SIZE + PINBA_SERVER_NAME_SIZE + 1] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -717,6 +790,19 @@ void pinba_update_report6_delete(size_t request_id, void *rep, const pinba_stats
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	
+		memcpy_static(index, record->data.hostname->str, record->data.hostname->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.server_name->str, record->data.server_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -724,38 +810,29 @@ void pinba_update_report6_delete(size_t request_id, void *rep, const pinba_stats
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.hostname, record->data.hostname_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.server_name, record->data.server_name_len, index_len);
-		;
-
 		data = (struct pinba_report6_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -769,6 +846,23 @@ void pinba_update_report7_add(size_t request_id, void *rep, const pinba_stats_re
 	struct pinba_report7_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_HOSTNAME_SIZE + 1 + PINBA_SERVER_NAME_SIZE + 1 + PINBA_SCRIPT_NAME_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	
+		memcpy_static(index, record->data.hostname->str, record->data.hostname->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
+		memcat_static(index, index_len, record->data.server_name->str, record->data.server_name->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -777,21 +871,10 @@ void pinba_update_report7_add(size_t request_id, void *rep, const pinba_stats_re
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.hostname, record->data.hostname_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
-		memcat_static(index, index_len, record->data.server_name, record->data.server_name_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
-		;
-
 		data = (struct pinba_report7_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -800,22 +883,22 @@ void pinba_update_report7_add(size_t request_id, void *rep, const pinba_stats_re
 
 			data->histogram_data = pinba_lmap_create();
 			
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-		memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+		memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -826,6 +909,7 @@ void pinba_update_report7_delete(size_t request_id, void *rep, const pinba_stats
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report7_data *data;
 	char index[PINBA_HOSTNAME_SIZE + 1 + PINBA_SERVER_NAME_SIZE + 1 + PINBA_SCRIPT_NAME_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -833,6 +917,21 @@ void pinba_update_report7_delete(size_t request_id, void *rep, const pinba_stats
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	
+		memcpy_static(index, record->data.hostname->str, record->data.hostname->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
+		memcat_static(index, index_len, record->data.server_name->str, record->data.server_name->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -840,40 +939,29 @@ void pinba_update_report7_delete(size_t request_id, void *rep, const pinba_stats
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.hostname, record->data.hostname_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
-		memcat_static(index, index_len, record->data.server_name, record->data.server_name_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
-		;
-
 		data = (struct pinba_report7_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -887,6 +975,19 @@ void pinba_update_report8_add(size_t request_id, void *rep, const pinba_stats_re
 	struct pinba_report8_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_STATUS_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	
+		sprintf((char *)index, "%u", record->data.status);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -895,17 +996,10 @@ void pinba_update_report8_add(size_t request_id, void *rep, const pinba_stats_re
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		sprintf((char *)index, "%u", record->data.status);
-		;
-
 		data = (struct pinba_report8_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -921,13 +1015,13 @@ void pinba_update_report8_add(size_t request_id, void *rep, const pinba_stats_re
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -938,6 +1032,7 @@ void pinba_update_report8_delete(size_t request_id, void *rep, const pinba_stats
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report8_data *data;
 	char index[PINBA_STATUS_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -945,6 +1040,17 @@ void pinba_update_report8_delete(size_t request_id, void *rep, const pinba_stats
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	
+		sprintf((char *)index, "%u", record->data.status);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -952,36 +1058,29 @@ void pinba_update_report8_delete(size_t request_id, void *rep, const pinba_stats
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		sprintf((char *)index, "%u", record->data.status);
-		;
-
 		data = (struct pinba_report8_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -995,6 +1094,20 @@ void pinba_update_report9_add(size_t request_id, void *rep, const pinba_stats_re
 	struct pinba_report9_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_STATUS_SIZE + 1 + PINBA_SCRIPT_NAME_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	
+        index_len = sprintf((char *)index, "%u:", record->data.status);
+        memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -1003,18 +1116,10 @@ void pinba_update_report9_add(size_t request_id, void *rep, const pinba_stats_re
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-        index_len = sprintf((char *)index, "%u:", record->data.status);
-        memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
-		;
-
 		data = (struct pinba_report9_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -1024,20 +1129,20 @@ void pinba_update_report9_add(size_t request_id, void *rep, const pinba_stats_re
 			data->histogram_data = pinba_lmap_create();
 			
 		data->status = record->data.status;
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -1048,6 +1153,7 @@ void pinba_update_report9_delete(size_t request_id, void *rep, const pinba_stats
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report9_data *data;
 	char index[PINBA_STATUS_SIZE + 1 + PINBA_SCRIPT_NAME_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -1055,6 +1161,18 @@ void pinba_update_report9_delete(size_t request_id, void *rep, const pinba_stats
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	
+        index_len = sprintf((char *)index, "%u:", record->data.status);
+        memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -1062,37 +1180,29 @@ void pinba_update_report9_delete(size_t request_id, void *rep, const pinba_stats
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-        index_len = sprintf((char *)index, "%u:", record->data.status);
-        memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
-		;
-
 		data = (struct pinba_report9_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -1106,6 +1216,20 @@ void pinba_update_report10_add(size_t request_id, void *rep, const pinba_stats_r
 	struct pinba_report10_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_STATUS_SIZE + 1 + PINBA_SERVER_NAME_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	
+		index_len = sprintf((char *)index, "%u", record->data.status);
+		memcat_static(index, index_len, record->data.server_name->str, record->data.server_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -1114,18 +1238,10 @@ void pinba_update_report10_add(size_t request_id, void *rep, const pinba_stats_r
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		index_len = sprintf((char *)index, "%u", record->data.status);
-		memcat_static(index, index_len, record->data.server_name, record->data.server_name_len, index_len);
-		;
-
 		data = (struct pinba_report10_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -1135,20 +1251,20 @@ void pinba_update_report10_add(size_t request_id, void *rep, const pinba_stats_r
 			data->histogram_data = pinba_lmap_create();
 			
 		data->status = record->data.status;
-		memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
+		memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -1159,6 +1275,7 @@ void pinba_update_report10_delete(size_t request_id, void *rep, const pinba_stat
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report10_data *data;
 	char index[PINBA_STATUS_SIZE + 1 + PINBA_SERVER_NAME_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -1166,6 +1283,18 @@ void pinba_update_report10_delete(size_t request_id, void *rep, const pinba_stat
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	
+		index_len = sprintf((char *)index, "%u", record->data.status);
+		memcat_static(index, index_len, record->data.server_name->str, record->data.server_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -1173,37 +1302,29 @@ void pinba_update_report10_delete(size_t request_id, void *rep, const pinba_stat
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		index_len = sprintf((char *)index, "%u", record->data.status);
-		memcat_static(index, index_len, record->data.server_name, record->data.server_name_len, index_len);
-		;
-
 		data = (struct pinba_report10_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -1217,6 +1338,20 @@ void pinba_update_report11_add(size_t request_id, void *rep, const pinba_stats_r
 	struct pinba_report11_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_HOSTNAME_SIZE + 1 + PINBA_STATUS_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	
+		index_len = sprintf((char *)index, "%u", record->data.status);
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -1225,18 +1360,10 @@ void pinba_update_report11_add(size_t request_id, void *rep, const pinba_stats_r
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		index_len = sprintf((char *)index, "%u", record->data.status);
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
-		;
-
 		data = (struct pinba_report11_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -1246,20 +1373,20 @@ void pinba_update_report11_add(size_t request_id, void *rep, const pinba_stats_r
 			data->histogram_data = pinba_lmap_create();
 			
 		data->status = record->data.status;
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -1270,6 +1397,7 @@ void pinba_update_report11_delete(size_t request_id, void *rep, const pinba_stat
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report11_data *data;
 	char index[PINBA_HOSTNAME_SIZE + 1 + PINBA_STATUS_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -1277,6 +1405,18 @@ void pinba_update_report11_delete(size_t request_id, void *rep, const pinba_stat
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	
+		index_len = sprintf((char *)index, "%u", record->data.status);
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -1284,37 +1424,29 @@ void pinba_update_report11_delete(size_t request_id, void *rep, const pinba_stat
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		index_len = sprintf((char *)index, "%u", record->data.status);
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
-		;
-
 		data = (struct pinba_report11_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -1328,6 +1460,20 @@ void pinba_update_report12_add(size_t request_id, void *rep, const pinba_stats_r
 	struct pinba_report12_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_STATUS_SIZE + 1 + PINBA_HOSTNAME_SIZE + 1 + PINBA_SCRIPT_NAME_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+			index_len = sprintf((char *)index, "%u", record->data.status);
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -1336,18 +1482,10 @@ void pinba_update_report12_add(size_t request_id, void *rep, const pinba_stats_r
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-				index_len = sprintf((char *)index, "%u", record->data.status);
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);;
-
 		data = (struct pinba_report12_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -1357,21 +1495,21 @@ void pinba_update_report12_add(size_t request_id, void *rep, const pinba_stats_r
 			data->histogram_data = pinba_lmap_create();
 			
 		data->status = record->data.status;
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -1382,6 +1520,7 @@ void pinba_update_report12_delete(size_t request_id, void *rep, const pinba_stat
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report12_data *data;
 	char index[PINBA_STATUS_SIZE + 1 + PINBA_HOSTNAME_SIZE + 1 + PINBA_SCRIPT_NAME_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -1389,6 +1528,18 @@ void pinba_update_report12_delete(size_t request_id, void *rep, const pinba_stat
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+			index_len = sprintf((char *)index, "%u", record->data.status);
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -1396,37 +1547,29 @@ void pinba_update_report12_delete(size_t request_id, void *rep, const pinba_stat
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-				index_len = sprintf((char *)index, "%u", record->data.status);
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);;
-
 		data = (struct pinba_report12_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -1440,6 +1583,17 @@ void pinba_update_report13_add(size_t request_id, void *rep, const pinba_stats_r
 	struct pinba_report13_data *data;
 	/*struct pinba_report1_data *data;*/
 	const char *index;
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	index = (const char *)record->data.schema->str;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -1448,15 +1602,10 @@ void pinba_update_report13_add(size_t request_id, void *rep, const pinba_stats_r
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		index = (const char *)record->data.schema;
-
 		data = (struct pinba_report13_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -1470,13 +1619,13 @@ void pinba_update_report13_add(size_t request_id, void *rep, const pinba_stats_r
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -1487,6 +1636,7 @@ void pinba_update_report13_delete(size_t request_id, void *rep, const pinba_stat
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report13_data *data;
 	const char *index;
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -1494,6 +1644,15 @@ void pinba_update_report13_delete(size_t request_id, void *rep, const pinba_stat
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	index = (const char *)record->data.schema->str;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -1501,34 +1660,29 @@ void pinba_update_report13_delete(size_t request_id, void *rep, const pinba_stat
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		index = (const char *)record->data.schema;
-
 		data = (struct pinba_report13_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -1542,6 +1696,21 @@ void pinba_update_report14_add(size_t request_id, void *rep, const pinba_stats_r
 	struct pinba_report14_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_SCHEMA_SIZE + PINBA_SCRIPT_NAME_SIZE + 1] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	
+		memcpy_static(index, record->data.schema->str, record->data.schema->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -1550,19 +1719,10 @@ void pinba_update_report14_add(size_t request_id, void *rep, const pinba_stats_r
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.schema, record->data.schema_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
-		;
-
 		data = (struct pinba_report14_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -1571,21 +1731,21 @@ void pinba_update_report14_add(size_t request_id, void *rep, const pinba_stats_r
 
 			data->histogram_data = pinba_lmap_create();
 			
-		memcpy_static(data->schema, record->data.schema, record->data.schema_len, dummy);
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->schema, record->data.schema->str, record->data.schema->len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -1596,6 +1756,7 @@ void pinba_update_report14_delete(size_t request_id, void *rep, const pinba_stat
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report14_data *data;
 	char index[PINBA_SCHEMA_SIZE + PINBA_SCRIPT_NAME_SIZE + 1] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -1603,6 +1764,19 @@ void pinba_update_report14_delete(size_t request_id, void *rep, const pinba_stat
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	
+		memcpy_static(index, record->data.schema->str, record->data.schema->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -1610,38 +1784,29 @@ void pinba_update_report14_delete(size_t request_id, void *rep, const pinba_stat
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.schema, record->data.schema_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
-		;
-
 		data = (struct pinba_report14_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -1655,6 +1820,21 @@ void pinba_update_report15_add(size_t request_id, void *rep, const pinba_stats_r
 	struct pinba_report15_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_SCHEMA_SIZE + PINBA_SERVER_NAME_SIZE + 1] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	
+		memcpy_static(index, record->data.schema->str, record->data.schema->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
+		memcat_static(index, index_len, record->data.server_name->str, record->data.server_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -1663,19 +1843,10 @@ void pinba_update_report15_add(size_t request_id, void *rep, const pinba_stats_r
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.schema, record->data.schema_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
-		memcat_static(index, index_len, record->data.server_name, record->data.server_name_len, index_len);
-		;
-
 		data = (struct pinba_report15_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -1684,21 +1855,21 @@ void pinba_update_report15_add(size_t request_id, void *rep, const pinba_stats_r
 
 			data->histogram_data = pinba_lmap_create();
 			
-		memcpy_static(data->schema, record->data.schema, record->data.schema_len, dummy);
-		memcpy_static(data->server_name, record->data.server_name, record->data.server_name_len, dummy);
+		memcpy_static(data->schema, record->data.schema->str, record->data.schema->len, dummy);
+		memcpy_static(data->server_name, record->data.server_name->str, record->data.server_name->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -1709,6 +1880,7 @@ void pinba_update_report15_delete(size_t request_id, void *rep, const pinba_stat
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report15_data *data;
 	char index[PINBA_SCHEMA_SIZE + PINBA_SERVER_NAME_SIZE + 1] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -1716,6 +1888,19 @@ void pinba_update_report15_delete(size_t request_id, void *rep, const pinba_stat
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	
+		memcpy_static(index, record->data.schema->str, record->data.schema->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
+		memcat_static(index, index_len, record->data.server_name->str, record->data.server_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -1723,38 +1908,29 @@ void pinba_update_report15_delete(size_t request_id, void *rep, const pinba_stat
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.schema, record->data.schema_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
-		memcat_static(index, index_len, record->data.server_name, record->data.server_name_len, index_len);
-		;
-
 		data = (struct pinba_report15_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -1768,6 +1944,21 @@ void pinba_update_report16_add(size_t request_id, void *rep, const pinba_stats_r
 	struct pinba_report16_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_SCHEMA_SIZE + PINBA_HOSTNAME_SIZE + 1] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	
+		memcpy_static(index, record->data.schema->str, record->data.schema->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -1776,19 +1967,10 @@ void pinba_update_report16_add(size_t request_id, void *rep, const pinba_stats_r
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.schema, record->data.schema_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
-		;
-
 		data = (struct pinba_report16_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -1797,21 +1979,21 @@ void pinba_update_report16_add(size_t request_id, void *rep, const pinba_stats_r
 
 			data->histogram_data = pinba_lmap_create();
 			
-		memcpy_static(data->schema, record->data.schema, record->data.schema_len, dummy);
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
+		memcpy_static(data->schema, record->data.schema->str, record->data.schema->len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -1822,6 +2004,7 @@ void pinba_update_report16_delete(size_t request_id, void *rep, const pinba_stat
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report16_data *data;
 	char index[PINBA_SCHEMA_SIZE + PINBA_HOSTNAME_SIZE + 1] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -1829,6 +2012,19 @@ void pinba_update_report16_delete(size_t request_id, void *rep, const pinba_stat
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	
+		memcpy_static(index, record->data.schema->str, record->data.schema->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -1836,38 +2032,29 @@ void pinba_update_report16_delete(size_t request_id, void *rep, const pinba_stat
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.schema, record->data.schema_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = ':' : 0;
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
-		;
-
 		data = (struct pinba_report16_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -1881,6 +2068,23 @@ void pinba_update_report17_add(size_t request_id, void *rep, const pinba_stats_r
 	struct pinba_report17_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_SCHEMA_SIZE + 1 + PINBA_HOSTNAME_SIZE + 1 + PINBA_SCRIPT_NAME_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+	
+		memcpy_static(index, record->data.schema->str, record->data.schema->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -1889,21 +2093,10 @@ void pinba_update_report17_add(size_t request_id, void *rep, const pinba_stats_r
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.schema, record->data.schema_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
-		;
-
 		data = (struct pinba_report17_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -1912,22 +2105,22 @@ void pinba_update_report17_add(size_t request_id, void *rep, const pinba_stats_r
 
 			data->histogram_data = pinba_lmap_create();
 			
-		memcpy_static(data->schema, record->data.schema, record->data.schema_len, dummy);
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
-		memcpy_static(data->script_name, record->data.script_name, record->data.script_name_len, dummy);
+		memcpy_static(data->schema, record->data.schema->str, record->data.schema->len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
+		memcpy_static(data->script_name, record->data.script_name->str, record->data.script_name->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -1938,6 +2131,7 @@ void pinba_update_report17_delete(size_t request_id, void *rep, const pinba_stat
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report17_data *data;
 	char index[PINBA_SCHEMA_SIZE + 1 + PINBA_HOSTNAME_SIZE + 1 + PINBA_SCRIPT_NAME_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -1945,6 +2139,21 @@ void pinba_update_report17_delete(size_t request_id, void *rep, const pinba_stat
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+	
+		memcpy_static(index, record->data.schema->str, record->data.schema->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.script_name->str, record->data.script_name->len, index_len);
+		;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -1952,40 +2161,29 @@ void pinba_update_report17_delete(size_t request_id, void *rep, const pinba_stat
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-		
-		memcpy_static(index, record->data.schema, record->data.schema_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.script_name, record->data.script_name_len, index_len);
-		;
-
 		data = (struct pinba_report17_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -1999,6 +2197,20 @@ void pinba_update_report18_add(size_t request_id, void *rep, const pinba_stats_r
 	struct pinba_report18_data *data;
 	/*struct pinba_report1_data *data;*/
 	char index[PINBA_SCHEMA_SIZE + 1 + PINBA_HOSTNAME_SIZE + 1 + PINBA_STATUS_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
+	/*int index_len, dummy;*/
+
+#if !0
+			index_len = sprintf((char *)index, "%u:", record->data.status);
+		memcat_static(index, index_len, record->data.schema->str, record->data.schema->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -2007,18 +2219,10 @@ void pinba_update_report18_add(size_t request_id, void *rep, const pinba_stats_r
 	report->memory_footprint += record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-				index_len = sprintf((char *)index, "%u:", record->data.status);
-		memcat_static(index, index_len, record->data.schema, record->data.schema_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);;
-
 		data = (struct pinba_report18_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -2028,21 +2232,21 @@ void pinba_update_report18_add(size_t request_id, void *rep, const pinba_stats_r
 			data->histogram_data = pinba_lmap_create();
 			
 		data->status = record->data.status;
-		memcpy_static(data->schema, record->data.schema, record->data.schema_len, dummy);
-		memcpy_static(data->hostname, record->data.hostname, record->data.hostname_len, dummy);
+		memcpy_static(data->schema, record->data.schema->str, record->data.schema->len, dummy);
+		memcpy_static(data->hostname, record->data.hostname->str, record->data.hostname->len, dummy);
 		;
 
 			report->results = pinba_map_add(report->results, index, data);
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -2053,6 +2257,7 @@ void pinba_update_report18_delete(size_t request_id, void *rep, const pinba_stat
 	pinba_report *report = (pinba_report *)rep;
 	struct pinba_report18_data *data;
 	char index[PINBA_SCHEMA_SIZE + 1 + PINBA_HOSTNAME_SIZE + 1 + PINBA_STATUS_SIZE] = {0};
+	size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -2060,6 +2265,18 @@ void pinba_update_report18_delete(size_t request_id, void *rep, const pinba_stat
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !0
+			index_len = sprintf((char *)index, "%u:", record->data.status);
+		memcat_static(index, index_len, record->data.schema->str, record->data.schema->len, index_len);
+		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
+		memcat_static(index, index_len, record->data.hostname->str, record->data.hostname->len, index_len);;
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -2067,37 +2284,29 @@ void pinba_update_report18_delete(size_t request_id, void *rep, const pinba_stat
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if 0
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		size_t __attribute__ ((unused)) index_len, __attribute__ ((unused)) dummy;
-		/*int index_len, dummy;*/
-
-				index_len = sprintf((char *)index, "%u:", record->data.status);
-		memcat_static(index, index_len, record->data.schema, record->data.schema_len, index_len);
-		(index_len < sizeof(index)-1) ? index[index_len++] = '/' : 0;
-		memcat_static(index, index_len, record->data.hostname, record->data.hostname_len, index_len);;
-
 		data = (struct pinba_report18_data *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -5,6 +5,17 @@ void PINBA_UPDATE_REPORT_ADD_FUNC_D() /*pinba_update_report1_add(pinba_report *r
 	PINBA_REPORT_DATA_STRUCT_D();
 	/*struct pinba_report1_data *data;*/
 	PINBA_REPORT_INDEX_D();
+	PINBA_INDEX_VARS_D();
+	/*int index_len, dummy;*/
+
+#if !PINBA_REPORT_NO_INDEX()
+	PINBA_CREATE_INDEX_VALUE();
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
 
 	timeradd(&report->time_total, &record->data.req_time, &report->time_total);
 	timeradd(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
@@ -13,15 +24,10 @@ void PINBA_UPDATE_REPORT_ADD_FUNC_D() /*pinba_update_report1_add(pinba_report *r
 	report->memory_footprint += record->data.memory_footprint;
 
 #if PINBA_REPORT_NO_INDEX()
-	report->std.results_cnt++;
-	PINBA_UPDATE_HISTOGRAM_ADD(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt += record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_ADD_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		PINBA_INDEX_VARS_D();
-		/*int index_len, dummy;*/
-
-		PINBA_CREATE_INDEX_VALUE();
-
 		data = (PINBA_REPORT_DATA_STRUCT() *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
@@ -35,13 +41,13 @@ void PINBA_UPDATE_REPORT_ADD_FUNC_D() /*pinba_update_report1_add(pinba_report *r
 			report->std.results_cnt++;
 		}
 
-		data->req_count++;
+		data->req_count += record->data.weight;
 		timeradd(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 		timeradd(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 		timeradd(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 		data->kbytes_total += record->data.doc_size;
 		data->memory_footprint += record->data.memory_footprint;
-		PINBA_UPDATE_HISTOGRAM_ADD(report, data->histogram_data, record->data.req_time);
+		PINBA_UPDATE_HISTOGRAM_ADD_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 	}
 #endif
 }
@@ -52,6 +58,7 @@ void PINBA_UPDATE_REPORT_DELETE_FUNC_D() /* pinba_update_report1_delete(pinba_re
 	pinba_report *report = (pinba_report *)rep;
 	PINBA_REPORT_DATA_STRUCT_D();
 	PINBA_REPORT_INDEX_D();
+	PINBA_INDEX_VARS_D();
 
 	if (report->std.results_cnt == 0) {
 		return;
@@ -59,6 +66,15 @@ void PINBA_UPDATE_REPORT_DELETE_FUNC_D() /* pinba_update_report1_delete(pinba_re
 
 	PINBA_REPORT_DELETE_CHECK(report, record);
 
+#if !PINBA_REPORT_NO_INDEX()
+	PINBA_CREATE_INDEX_VALUE();
+
+	if (UNLIKELY(!pinba_map_owns(report->results, index))) {
+		/* another thread is updating the shard of the report this index belongs to */
+		return;
+	}
+#endif
+
 	timersub(&report->time_total, &record->data.req_time, &report->time_total);
 	timersub(&report->ru_utime_total, &record->data.ru_utime, &report->ru_utime_total);
 	timersub(&report->ru_stime_total, &record->data.ru_stime, &report->ru_stime_total);
@@ -66,34 +82,29 @@ void PINBA_UPDATE_REPORT_DELETE_FUNC_D() /* pinba_update_report1_delete(pinba_re
 	report->memory_footprint -= record->data.memory_footprint;
 
 #if PINBA_REPORT_NO_INDEX()
-	report->std.results_cnt--;
-	PINBA_UPDATE_HISTOGRAM_DEL(report, report->std.histogram_data, record->data.req_time);
+	report->std.results_cnt -= record->data.weight;
+	PINBA_UPDATE_HISTOGRAM_DEL_EX(report, report->std.histogram_data, record->data.req_time, (int)record->data.weight);
 #else 
 	{
-		PINBA_INDEX_VARS_D();
-		/*int index_len, dummy;*/
-
-		PINBA_CREATE_INDEX_VALUE();
-
 		data = (PINBA_REPORT_DATA_STRUCT() *)pinba_map_get(report->results, index);
 
 		if (UNLIKELY(!data)) {
 			/* no such value, mmm?? */
 		} else {
 
-			if (UNLIKELY(data->req_count == 1)) {
+			if (UNLIKELY(data->req_count <= record->data.weight)) {
 				pinba_lmap_destroy(data->histogram_data);
 				free(data);
 				pinba_map_delete(report->results, index);
 				report->std.results_cnt--;
 			} else {
-				data->req_count--;
+				data->req_count -= record->data.weight;
 				timersub(&data->req_time_total, &record->data.req_time, &data->req_time_total);
 				timersub(&data->ru_utime_total, &record->data.ru_utime, &data->ru_utime_total);
 				timersub(&data->ru_stime_total, &record->data.ru_stime, &data->ru_stime_total);
 				data->kbytes_total -= record->data.doc_size;
 				data->memory_footprint -= record->data.memory_footprint;
-				PINBA_UPDATE_HISTOGRAM_DEL(report, data->histogram_data, record->data.req_time);
+				PINBA_UPDATE_HISTOGRAM_DEL_EX(report, data->histogram_data, record->data.req_time, (int)record->data.weight);
 			}
 		}
 	}
@@ -15,6 +15,11 @@
 */
 
 #include "pinba.h"
+#include "pinba_map.h"
+
+#ifdef PINBA_ENGINE_HAVE_LIBNUMA
+# include <numaif.h>
+#endif
 
 /* generic pool functions */
 
@@ -108,10 +113,23 @@ int pinba_pool_grow(pinba_pool *p, size_t more) /* {{{ */
 		memset((char *)p->data + old_size * p->element_size, 0, more * p->element_size);
 	}
 
+	if (p->numa_node != PINBA_NUMA_LOCAL) {
+		/* realloc() may have moved the data */
+		pinba_numa_bind(p->data, p->size * p->element_size, p->numa_node);
+	}
 	return P_SUCCESS;
 }
 /* }}} */
 
+void pinba_pool_set_numa_node(pinba_pool *p, int node) /* {{{ */
+{
+	p->numa_node = node;
+	if (p->data && node != PINBA_NUMA_LOCAL) {
+		pinba_numa_bind(p->data, p->size * p->element_size, node);
+	}
+}
+/* }}} */
+
 static inline int pinba_pool_shrink(pinba_pool *p, size_t less) /* {{{ */
 {
 	size_t old_size = p->size;
@@ -128,6 +146,10 @@ static inline int pinba_pool_shrink(pinba_pool *p, size_t less) /* {{{ */
 	if (!p->data) {
 		return P_FAILURE;
 	}
+
+	if (p->numa_node != PINBA_NUMA_LOCAL) {
+		pinba_numa_bind(p->data, p->size * p->element_size, p->numa_node);
+	}
 	return P_SUCCESS;
 }
 /* }}} */
@@ -135,6 +157,7 @@ static inline int pinba_pool_shrink(pinba_pool *p, size_t less) /* {{{ */
 int pinba_pool_init(pinba_pool *p, size_t size, size_t element_size, size_t limit_size, size_t grow_size, pool_dtor_func_t dtor, char *pool_name) /* {{{ */
 {
 	memset(p, 0, sizeof(pinba_pool));
+	p->numa_node = PINBA_NUMA_LOCAL;
 	p->element_size = element_size;
 	p->dtor = dtor;
 	p->limit_size = limit_size;
@@ -165,18 +188,286 @@ void pinba_pool_destroy(pinba_pool *p) /* {{{ */
 }
 /* }}} */
 
+/* NUMA functions */
+
+void pinba_numa_bind(void *ptr, size_t size, int node) /* {{{ */
+{
+#ifdef PINBA_ENGINE_HAVE_LIBNUMA
+	unsigned long nodemask;
+	uintptr_t start, end, page_mask;
+	int mode;
+
+	if (!D->numa_nodemask || node == PINBA_NUMA_LOCAL) {
+		return;
+	}
+
+	if (node == PINBA_NUMA_INTERLEAVE) {
+		mode = MPOL_INTERLEAVE;
+		nodemask = D->numa_nodemask;
+	} else {
+		/* preferred, not bound: better a remote page than a failed allocation */
+		mode = MPOL_PREFERRED;
+		nodemask = 1UL << node;
+	}
+
+	/* only the whole pages inside of the range */
+	page_mask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+	start = ((uintptr_t)ptr + page_mask) & ~page_mask;
+	end = ((uintptr_t)ptr + size) & ~page_mask;
+	if (end <= start) {
+		return;
+	}
+
+	/* the data has already been touched by the thread that allocated it, so the pages are moved */
+	if (mbind((void *)start, end - start, mode, &nodemask, sizeof(nodemask) * 8, MPOL_MF_MOVE) != 0) {
+		pinba_debug("mbind(%p, %zd, %d) failed: %s (%d)", (void *)start, end - start, node, strerror(errno), errno);
+	}
+#endif
+}
+/* }}} */
+
+/* arena functions */
+
+static void *pinba_arena_protobuf_alloc(void *allocator_data, size_t size) /* {{{ */
+{
+	return pinba_arena_alloc((pinba_arena *)allocator_data, size);
+}
+/* }}} */
+
+static void pinba_arena_protobuf_free(void *allocator_data, void *pointer) /* {{{ */
+{
+	/* arena memory is released all at once by pinba_arena_reset() */
+}
+/* }}} */
+
+static pinba_arena_chunk *pinba_arena_chunk_new(size_t size) /* {{{ */
+{
+	pinba_arena_chunk *chunk;
+
+	chunk = (pinba_arena_chunk *)malloc(sizeof(pinba_arena_chunk) + size);
+	if (!chunk) {
+		return NULL;
+	}
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->data = (char *)(chunk + 1);
+	return chunk;
+}
+/* }}} */
+
+int pinba_arena_init(pinba_arena *a, size_t chunk_size) /* {{{ */
+{
+	memset(a, 0, sizeof(pinba_arena));
+
+	a->chunk_size = chunk_size;
+	a->allocator.alloc = pinba_arena_protobuf_alloc;
+	a->allocator.free = pinba_arena_protobuf_free;
+	a->allocator.allocator_data = a;
+
+	a->head = pinba_arena_chunk_new(chunk_size);
+	if (!a->head) {
+		pinba_error(P_ERROR, "out of memory when allocating arena chunk of %zd bytes", chunk_size);
+		return P_FAILURE;
+	}
+	a->current = a->head;
+	a->allocated = chunk_size;
+	return P_SUCCESS;
+}
+/* }}} */
+
+void *pinba_arena_alloc(pinba_arena *a, size_t size) /* {{{ */
+{
+	pinba_arena_chunk *chunk = a->current;
+	void *ptr;
+
+	/* keep everything 8-byte aligned */
+	size = (size + 7) & ~((size_t)7);
+
+	while (UNLIKELY(chunk->used + size > chunk->size)) {
+		if (!chunk->next || chunk->next->size < size) {
+			pinba_arena_chunk *new_chunk;
+			size_t new_size = (size > a->chunk_size) ? size : a->chunk_size;
+
+			new_chunk = pinba_arena_chunk_new(new_size);
+			if (!new_chunk) {
+				pinba_error(P_ERROR, "out of memory when allocating arena chunk of %zd bytes", new_size);
+				return NULL;
+			}
+			new_chunk->next = chunk->next;
+			chunk->next = new_chunk;
+			a->allocated += new_size;
+		}
+		chunk = chunk->next;
+		a->current = chunk;
+	}
+
+	ptr = chunk->data + chunk->used;
+	chunk->used += size;
+	return ptr;
+}
+/* }}} */
+
+void pinba_arena_reset(pinba_arena *a) /* {{{ */
+{
+	pinba_arena_chunk *chunk;
+	size_t used = 0;
+
+	/* the chunks are kept allocated and reused in the next cycle */
+	for (chunk = a->head; chunk; chunk = chunk->next) {
+		if (chunk->used == 0) {
+			break;
+		}
+		used += chunk->used;
+		chunk->used = 0;
+	}
+	a->current = a->head;
+
+	/* halves with every quieter cycle, so that a burst is given back in a few cycles
+	   and a fluctuating load doesn't allocate the same chunks over and over again */
+	a->used_high /= 2;
+	if (a->used_high < used) {
+		a->used_high = used;
+	}
+}
+/* }}} */
+
+size_t pinba_arena_trim(pinba_arena *a) /* {{{ */
+{
+	pinba_arena_chunk *chunk, *next;
+	size_t kept, freed = 0;
+
+	/* must be called after pinba_arena_reset(): keeps the chunks needed for used_high bytes
+	   (at least the first one) and frees the rest */
+	chunk = a->head;
+	kept = chunk->size;
+	while (chunk->next && kept < a->used_high) {
+		chunk = chunk->next;
+		kept += chunk->size;
+	}
+
+	next = chunk->next;
+	chunk->next = NULL;
+	while (next) {
+		chunk = next;
+		next = chunk->next;
+		freed += chunk->size;
+		free(chunk);
+	}
+
+	a->allocated -= freed;
+	return freed;
+}
+/* }}} */
+
+void pinba_arena_destroy(pinba_arena *a) /* {{{ */
+{
+	pinba_arena_chunk *chunk, *next;
+
+	for (chunk = a->head; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	a->head = NULL;
+	a->current = NULL;
+	a->allocated = 0;
+}
+/* }}} */
+
+/* single producer/single consumer ring functions */
+
+int pinba_spsc_ring_init(pinba_spsc_ring *r, size_t size) /* {{{ */
+{
+	/* size must be a power of 2 */
+	r->data = (void **)calloc(size, sizeof(void *));
+	if (!r->data) {
+		return P_FAILURE;
+	}
+
+	r->head = 0;
+	r->tail = 0;
+	r->mask = size - 1;
+	return P_SUCCESS;
+}
+/* }}} */
+
+int pinba_spsc_ring_push(pinba_spsc_ring *r, void *data) /* {{{ */
+{
+	size_t tail = r->tail;
+
+	if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) > r->mask) {
+		return P_FAILURE;
+	}
+
+	r->data[tail & r->mask] = data;
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+	return P_SUCCESS;
+}
+/* }}} */
+
+void *pinba_spsc_ring_pop(pinba_spsc_ring *r) /* {{{ */
+{
+	size_t head = r->head;
+	void *data;
+
+	if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+
+	data = r->data[head & r->mask];
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	return data;
+}
+/* }}} */
+
+size_t pinba_spsc_ring_count(pinba_spsc_ring *r) /* {{{ */
+{
+	size_t head;
+
+	/* read the head first, so that the tail can't be behind it */
+	head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	return __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) - head;
+}
+/* }}} */
+
+void pinba_spsc_ring_destroy(pinba_spsc_ring *r) /* {{{ */
+{
+	free(r->data);
+	r->data = NULL;
+}
+/* }}} */
+
 /* stats pool functions */
 
+/* the words of a record are referenced while it's in the pool, see request_to_record() */
+static inline void pinba_stats_record_words_unref(pinba_stats_record *record) /* {{{ */
+{
+	unsigned int i;
+
+	pinba_word_unref(record->data.script_name);
+	pinba_word_unref(record->data.server_name);
+	pinba_word_unref(record->data.hostname);
+	pinba_word_unref(record->data.schema);
+
+	for (i = 0; i < record->data.tags_cnt; i++) {
+		pinba_word_unref(record->data.tag_names[i]);
+		pinba_word_unref(record->data.tag_values[i]);
+	}
+}
+/* }}} */
+
 static inline void pinba_stats_record_dtor(int request_id, pinba_stats_record *record) /* {{{ */
 {
 	int i;
-	pinba_pool *timer_pool = &D->timer_pool;
+	pinba_timer_pool *timer_pool = &D->timer_pool;
 
 	if (!record->time.tv_sec) {
 		return;
 	}
 
 	pinba_update_delete(&D->base_reports_arr, request_id, record);
+	pinba_stats_record_words_unref(record);
 
 	pthread_rwlock_rdlock(&D->tag_reports_lock);
 	pthread_rwlock_wrlock(&D->timer_lock);
@@ -188,10 +479,7 @@ static inline void pinba_stats_record_dtor(int request_id, pinba_stats_record *r
 
 		for (i = 0; i < record->timers_cnt; i++) {
 			timer = record_get_timer(&D->timer_pool, record, i);
-			timer_pool->out++;
-			if (UNLIKELY(timer_pool->out == timer_pool->size)) {
-				timer_pool->out = 0;
-			}
+			timer_pool->out = (timer_pool->out + 1) & PINBA_TIMER_ID_MASK;
 
 			tag_sum += timer->tag_num;
 			D->timertags_cnt -= timer->tag_num;
@@ -239,179 +527,415 @@ void pinba_request_pool_dtor(void *pool) /* {{{ */
 }
 /* }}} */
 
-void pinba_per_thread_request_pool_dtor(void *pool) /* {{{ */
+void pinba_per_thread_tmp_pool_dtor(void *pool) /* {{{ */
 {
 	pinba_pool *p = (pinba_pool *)pool;
-	size_t i;
-	Pinba__Request *request;
+	unsigned int i;
+	pinba_stats_record_ex *record_ex;
 
 	for (i = 0; i < p->size; i++) {
-		request = REQ_DATA_POOL(p)[i];
-		if (request) {
-			pinba__request__free_unpacked(request, NULL);
+		record_ex = REQ_POOL_EX(p) + i;
+		if (record_ex->words) {
+			free(record_ex->words);
 		}
 	}
 }
 /* }}} */
 
-void pinba_per_thread_tmp_pool_dtor(void *pool) /* {{{ */
+/* timer pool functions */
+
+static pinba_timer_record *pinba_timer_segment_alloc(pinba_timer_pool *p) /* {{{ */
 {
-	pinba_pool *p = (pinba_pool *)pool;
-	unsigned int i;
-	pinba_stats_record_ex *record_ex;
+	pinba_timer_record *segment;
 
-	for (i = 0; i < p->size; i++) {
-		record_ex = REQ_POOL_EX(p) + i;
-		pinba_stats_record_tags_dtor(&record_ex->record);
-		if (record_ex->request && record_ex->can_free) {
-			pinba__request__free_unpacked(record_ex->request, NULL);
-			record_ex->request = NULL;
-			record_ex->can_free = 0;
-		}
-		if (record_ex->words) {
-			free(record_ex->words);
+	segment = (pinba_timer_record *)calloc(PINBA_TIMER_SEGMENT_SIZE, sizeof(pinba_timer_record));
+	if (!segment) {
+		pinba_error(P_ERROR, "out of memory when allocating timer pool segment of %zd bytes", PINBA_TIMER_SEGMENT_SIZE * sizeof(pinba_timer_record));
+		return NULL;
+	}
+
+	if (p->numa_node != PINBA_NUMA_LOCAL) {
+		pinba_numa_bind(segment, PINBA_TIMER_SEGMENT_SIZE * sizeof(pinba_timer_record), p->numa_node);
+	}
+
+	p->segments_cnt++;
+	p->size += PINBA_TIMER_SEGMENT_SIZE;
+	return segment;
+}
+/* }}} */
+
+/* makes room for the segments number first .. first + cnt - 1 (wrapping with the ids), keeping their slots */
+static int pinba_timer_segments_resize(pinba_timer_pool *p, size_t first, size_t cnt) /* {{{ */
+{
+	pinba_timer_record **segments;
+	size_t i, n, slots = p->segments_mask + 1, new_slots = slots;
+
+	while (new_slots < cnt) {
+		new_slots <<= 1;
+	}
+
+	if (new_slots == slots) {
+		return P_SUCCESS;
+	}
+
+	if (new_slots > PINBA_TIMER_SEGMENT_NUM_MASK + 1) {
+		pinba_error(P_ERROR, "timer pool can't hold more than %d timers", PINBA_TIMER_ID_MASK);
+		return P_FAILURE;
+	}
+
+	segments = (pinba_timer_record **)calloc(new_slots, sizeof(pinba_timer_record *));
+	if (!segments) {
+		pinba_error(P_ERROR, "out of memory when allocating %zd timer pool segment slots", new_slots);
+		return P_FAILURE;
+	}
+
+	/* a run of the segment numbers as long as the old table covers each of its slots once,
+	   so the segments in use and the spare ones after them keep their order */
+	for (i = 0; i < slots; i++) {
+		n = first + i;
+		segments[n & (new_slots - 1)] = p->segments[n & p->segments_mask];
+	}
+
+	free(p->segments);
+	p->segments = segments;
+	p->segments_mask = new_slots - 1;
+	return P_SUCCESS;
+}
+/* }}} */
+
+int pinba_timer_pool_init(pinba_timer_pool *p, size_t size) /* {{{ */
+{
+	size_t i, cnt;
+
+	memset(p, 0, sizeof(pinba_timer_pool));
+	p->numa_node = PINBA_NUMA_LOCAL;
+
+	cnt = (size + PINBA_TIMER_SEGMENT_SIZE - 1) >> PINBA_TIMER_SEGMENT_SHIFT;
+	if (cnt == 0) {
+		cnt = 1;
+	}
+
+	p->segments = (pinba_timer_record **)calloc(1, sizeof(pinba_timer_record *));
+	if (!p->segments) {
+		return P_FAILURE;
+	}
+
+	if (pinba_timer_segments_resize(p, 0, cnt) != P_SUCCESS) {
+		return P_FAILURE;
+	}
+
+	pinba_error(P_NOTICE, "initializing timer pool (0x%x) with %zd segments of %d timers", p, cnt, PINBA_TIMER_SEGMENT_SIZE);
+
+	for (i = 0; i < cnt; i++) {
+		p->segments[i] = pinba_timer_segment_alloc(p);
+		if (!p->segments[i]) {
+			return P_FAILURE;
 		}
 	}
+	return P_SUCCESS;
 }
 /* }}} */
 
-void pinba_timer_pool_dtor(void *pool) /* {{{ */
+void pinba_timer_pool_set_numa_node(pinba_timer_pool *p, int node) /* {{{ */
 {
-	pinba_pool *p = (pinba_pool *)pool;
-	unsigned int i;
-	pinba_timer_record *timer;
+	size_t i;
 
-	for (i = 0; i < p->size; i++) {
-		timer = TIMER_POOL(p) + i;
-		if (timer->tag_ids) {
-			free(timer->tag_ids);
+	p->numa_node = node;
+	if (node == PINBA_NUMA_LOCAL) {
+		return;
+	}
+
+	for (i = 0; i <= p->segments_mask; i++) {
+		if (p->segments[i]) {
+			pinba_numa_bind(p->segments[i], PINBA_TIMER_SEGMENT_SIZE * sizeof(pinba_timer_record), node);
 		}
-		if (timer->tag_values) {
-			free(timer->tag_values);
+	}
+}
+/* }}} */
+
+static void pinba_timer_tag_block_free(pinba_timer_tag_block *block) /* {{{ */
+{
+	size_t i;
+
+	/* the slots of the dropped tags are left empty */
+	for (i = 0; i < block->size; i++) {
+		if (block->tags[i].value) {
+			pinba_word_unref(block->tags[i].value);
 		}
 	}
+	free(block);
 }
 /* }}} */
 
-int timer_pool_add(int timers_cnt) /* {{{ */
+void pinba_timer_pool_destroy(pinba_timer_pool *p) /* {{{ */
 {
-	int id;
-	pinba_pool *timer_pool = &D->timer_pool;
+	size_t i;
+	pinba_timer_tag_block *block, *next;
+
+	for (block = p->tag_blocks; block; block = next) {
+		next = block->next;
+		pinba_timer_tag_block_free(block);
+	}
+	p->tag_blocks = NULL;
+	p->tag_blocks_tail = NULL;
 
-	if ((pinba_pool_num_records(timer_pool) + timers_cnt) >= timer_pool->size) {
-		int more = PINBA_TIMER_POOL_GROW_SIZE;
+	if (!p->segments) {
+		return;
+	}
 
-		if (more < timers_cnt) {
-			more += timers_cnt;
+	for (i = 0; i <= p->segments_mask; i++) {
+		if (p->segments[i]) {
+			free(p->segments[i]);
 		}
+	}
 
-		pinba_error(P_WARNING, "growing timer_pool to %d", timer_pool->size + more);
+	free(p->segments);
+	p->segments = NULL;
+	p->segments_cnt = 0;
+	p->size = 0;
+}
+/* }}} */
 
-		pinba_pool_grow(timer_pool, more);
+/* the tags of the timers added by timer_pool_add() last, in the order of the timers */
+pinba_timer_tag *pinba_timer_tags_add(pinba_timer_pool *p, size_t tags_cnt) /* {{{ */
+{
+	pinba_timer_tag_block *block;
 
-		if (timer_pool->out > timer_pool->in) {
-			int prev_request_id = -1;
-			pinba_stats_record *record;
-			pinba_timer_record *timer;
-			pinba_pool *request_pool = &D->request_pool;
-			int min_id = -1;
-			size_t i, cnt = 0, rec_cnt = 0;
+	block = (pinba_timer_tag_block *)calloc(1, sizeof(pinba_timer_tag_block) + sizeof(pinba_timer_tag) * tags_cnt);
+	if (!block) {
+		pinba_error(P_ERROR, "out of memory when allocating %zd timer tags", tags_cnt);
+		return NULL;
+	}
 
-			for (i = timer_pool->out; i < timer_pool->size; i++) {
-				timer = TIMER_POOL(timer_pool) + i;
+	if (p->numa_node != PINBA_NUMA_LOCAL) {
+		pinba_numa_bind(block, sizeof(pinba_timer_tag_block) + sizeof(pinba_timer_tag) * tags_cnt, p->numa_node);
+	}
 
-				cnt++;
+	block->next = NULL;
+	block->timers_end = p->in;
+	block->size = tags_cnt;
 
-				if (timer->tag_num == 0) {
-					continue;
-				}
+	if (p->tag_blocks_tail) {
+		p->tag_blocks_tail->next = block;
+	} else {
+		p->tag_blocks = block;
+	}
+	p->tag_blocks_tail = block;
+	return block->tags;
+}
+/* }}} */
 
-				timer->index = i;
+/* the readers hold collector_lock, so the caller must hold it for writing */
+void pinba_timer_tags_release(pinba_timer_pool *p) /* {{{ */
+{
+	pinba_timer_tag_block *block;
 
-				if (timer->request_id == (unsigned int)prev_request_id) {
-					continue;
-				}
+	/* the timers are deleted in the order they were added in, and so are the blocks */
+	while ((block = p->tag_blocks) != NULL) {
+		if (pinba_timer_pool_has_id(p, (block->timers_end - 1) & PINBA_TIMER_ID_MASK)) {
+			break;
+		}
 
-				if (min_id == -1) {
-					min_id = timer->request_id;
-				}
+		p->tag_blocks = block->next;
+		if (!p->tag_blocks) {
+			p->tag_blocks_tail = NULL;
+		}
+		pinba_timer_tag_block_free(block);
+	}
+}
+/* }}} */
 
-				record = REQ_POOL(request_pool) + timer->request_id;
-				if (!record->timers_cnt) {
-					pinba_error(P_WARNING, "timer %d references record %d which doesn't have timers", i, timer->request_id);
-					continue;
-				}
-				record->timers_start += more;
+/* reserves timers_cnt timers starting at *first_id; on failure nothing is reserved */
+int timer_pool_add(size_t timers_cnt, size_t *first_id) /* {{{ */
+{
+	size_t id, first, last, span, n;
+	pinba_timer_pool *timer_pool = &D->timer_pool;
 
-				rec_cnt ++;
+	id = timer_pool->in;
+	*first_id = id;
 
-				prev_request_id = timer->request_id;
-			}
-			pinba_error(P_WARNING, "moved timers_start for %zd timers to timers_start + %d for %zd records from %d to %d", cnt, more, rec_cnt, min_id, prev_request_id);
+	if (timers_cnt == 0) {
+		return P_SUCCESS;
+	}
+
+	/* the segment numbers wrap together with the ids; a segment never holds both the oldest
+	   and the newest timers, so each segment in use needs a slot of its own */
+	first = timer_pool->out >> PINBA_TIMER_SEGMENT_SHIFT;
+	last = ((id + timers_cnt - 1) & PINBA_TIMER_ID_MASK) >> PINBA_TIMER_SEGMENT_SHIFT;
+	span = ((last - first) & PINBA_TIMER_SEGMENT_NUM_MASK) + 1;
+
+	if (span > timer_pool->segments_mask + 1) {
+		pinba_error(P_WARNING, "growing timer_pool to %zd segments", span);
+
+		/* only the table of the segment pointers is reallocated, the timers stay where they are */
+		if (pinba_timer_segments_resize(timer_pool, first, span) != P_SUCCESS) {
+			return P_FAILURE;
 		}
 	}
 
-	id = timer_pool->in;
+	/* the spare segments past the current one are reused, the missing ones are allocated */
+	for (n = id >> PINBA_TIMER_SEGMENT_SHIFT; ; n = (n + 1) & PINBA_TIMER_SEGMENT_NUM_MASK) {
+		pinba_timer_record **segment = timer_pool->segments + (n & timer_pool->segments_mask);
 
-	if (UNLIKELY((timer_pool->in + timers_cnt) >= timer_pool->size)) {
-		timer_pool->in = (timer_pool->in + timers_cnt) - timer_pool->size;
-	} else {
-		timer_pool->in += timers_cnt;
+		if (!*segment) {
+			*segment = pinba_timer_segment_alloc(timer_pool);
+			if (!*segment) {
+				/* the segments allocated so far are kept as spares */
+				return P_FAILURE;
+			}
+		}
+
+		if (n == last) {
+			break;
+		}
 	}
 
-	return id;
+	timer_pool->in = (id + timers_cnt) & PINBA_TIMER_ID_MASK;
+	return P_SUCCESS;
 }
 /* }}} */
 
-struct tag_reports_job_data {
-	unsigned int prefix;
-	unsigned int count;
-};
-
 struct packets_job_data {
 	unsigned int prefix;
 	unsigned int count;
 	unsigned int timertag_cnt;
 };
 
-void update_reports_func(void *job_data) /* {{{ */
+static void pinba_reports_add_rusage(pinba_std_report **reports, size_t reports_cnt, struct rusage *start_rusage) /* {{{ */
 {
-	struct reports_job_data *d = (struct reports_job_data *)job_data;
-	unsigned int i, tmp_id;
+	struct rusage final_data;
+	struct timeval diff;
+	long utime, stime;
+	size_t n;
+
+	if (reports_cnt == 1) {
+		pinba_report_add_rusage(reports[0], start_rusage);
+		return;
+	}
+
+	getrusage(RUSAGE_THREAD, &final_data);
+
+	/* the reports were updated interleaved, so the time is split between them evenly */
+	timersub(&final_data.ru_utime, &start_rusage->ru_utime, &diff);
+	utime = (diff.tv_sec * 1000000 + diff.tv_usec) / reports_cnt;
+	timersub(&final_data.ru_stime, &start_rusage->ru_stime, &diff);
+	stime = (diff.tv_sec * 1000000 + diff.tv_usec) / reports_cnt;
+
+	for (n = 0; n < reports_cnt; n++) {
+		diff.tv_sec = utime / 1000000;
+		diff.tv_usec = utime % 1000000;
+		timeradd(&reports[n]->ru_utime, &diff, &reports[n]->ru_utime);
+
+		diff.tv_sec = stime / 1000000;
+		diff.tv_usec = stime % 1000000;
+		timeradd(&reports[n]->ru_stime, &diff, &reports[n]->ru_stime);
+	}
+}
+/* }}} */
+
+static void pinba_reports_update_records(pinba_std_report **reports, size_t reports_cnt, unsigned int prefix, unsigned int count, int add) /* {{{ */
+{
+	unsigned int i, j, block, block_id, tmp_id;
+	size_t n;
 	pinba_pool *request_pool = &D->request_pool;
 	pinba_stats_record *record;
+	pinba_std_report *report;
 	pinba_report_update_function *func;
-	pinba_std_report *report = (pinba_std_report *)d->report;
 	struct rusage rusage_data;
 
-	tmp_id = d->prefix;
-	if (tmp_id >= request_pool->size) {
-		tmp_id = tmp_id - request_pool->size;
+	block_id = prefix;
+	if (block_id >= request_pool->size) {
+		block_id = block_id - request_pool->size;
 	}
 
-	pthread_rwlock_wrlock(&report->lock);
-	if (d->add) {
-		func = report->add_func;
-		if (report->start.tv_sec == 0) {
-			record = REQ_POOL(request_pool) + tmp_id;
-			report->start = record->time;
-			report->request_pool_start_id = record->counter;
+	pinba_get_rusage(&rusage_data);
+
+	/* record-major: a block of records is pulled into the cache once and then
+	   applied to all the reports, instead of walking all the records once per report */
+	for (i = 0; i < count; i += block) {
+		block = count - i;
+		if (block > PINBA_FUSED_RECORDS_BLOCK) {
+			block = PINBA_FUSED_RECORDS_BLOCK;
+		}
+
+		for (n = 0; n < reports_cnt; n++) {
+			report = reports[n];
+
+			if (add) {
+				func = report->add_func;
+			} else {
+				func = report->delete_func;
+			}
+
+			for (j = 0, tmp_id = block_id; j < block; j++, tmp_id = (tmp_id == request_pool->size - 1) ? 0 : tmp_id + 1) {
+				record = REQ_POOL(request_pool) + tmp_id;
+
+				CHECK_REPORT_CONDITIONS_CONTINUE(report, record);
+				func(tmp_id, report, record);
+			}
+		}
+
+		block_id += block;
+		if (block_id >= request_pool->size) {
+			block_id = block_id - request_pool->size;
 		}
-		report->packets_cnt += d->count;
-	} else {
-		func = report->delete_func;
 	}
 
-	pinba_get_rusage(&rusage_data);
+	pinba_reports_add_rusage(reports, reports_cnt, &rusage_data);
+}
+/* }}} */
 
-	for (i = 0; i < d->count; i++, tmp_id = (tmp_id == request_pool->size - 1) ? 0 : tmp_id + 1) {
-		record = REQ_POOL(request_pool) + tmp_id;
+static inline void pinba_report_update_records(pinba_std_report *report, unsigned int prefix, unsigned int count, int add) /* {{{ */
+{
+	pinba_reports_update_records(&report, 1, prefix, count, add);
+}
+/* }}} */
 
-		CHECK_REPORT_CONDITIONS_CONTINUE(report, record);
-		func(tmp_id, report, record);
+static inline size_t pinba_reports_grain(size_t reports_cnt) /* {{{ */
+{
+	size_t grain;
+
+	/* large enough groups of reports to share the records, small enough for the idle threads to steal some */
+	grain = reports_cnt / (D->thread_pool->size * 2);
+	if (grain == 0) {
+		grain = 1;
+	} else if (grain > PINBA_FUSED_REPORTS_MAX) {
+		grain = PINBA_FUSED_REPORTS_MAX;
 	}
+	return grain;
+}
+/* }}} */
+
+static inline void pinba_report_set_start(pinba_std_report *report, unsigned int prefix) /* {{{ */
+{
+	pinba_pool *request_pool = &D->request_pool;
+	pinba_stats_record *record;
+
+	if (prefix >= request_pool->size) {
+		prefix = prefix - request_pool->size;
+	}
+
+	if (report->start.tv_sec == 0) {
+		record = REQ_POOL(request_pool) + prefix;
+		report->start = record->time;
+		report->request_pool_start_id = record->counter;
+	}
+}
+/* }}} */
+
+void update_reports_func(void *job_data) /* {{{ */
+{
+	struct reports_job_data *d = (struct reports_job_data *)job_data;
+	pinba_std_report *report = (pinba_std_report *)d->report;
+
+	pthread_rwlock_wrlock(&report->lock);
+	if (d->add) {
+		pinba_report_set_start(report, d->prefix);
+		report->packets_cnt += d->count;
+	}
+
+	pinba_report_update_records(report, d->prefix, d->count, d->add);
 
-	pinba_report_add_rusage(report, &rusage_data);
 	report->time_interval = pinba_get_time_interval(report);
 	pthread_rwlock_unlock(&report->lock);
 }
@@ -424,7 +948,7 @@ void clear_record_timers_func(void *job_data) /* {{{ */
 	pinba_pool *request_pool = &D->request_pool;
 	pinba_stats_record *record;
 	pinba_timer_record *timer;
-	pinba_pool *timer_pool = &D->timer_pool;
+	pinba_timer_pool *timer_pool = &D->timer_pool;
 
 	tmp_id = d->prefix;
 	if (tmp_id >= request_pool->size) {
@@ -438,13 +962,12 @@ void clear_record_timers_func(void *job_data) /* {{{ */
 		for (j = 0; j < record->timers_cnt; j++) {
 			timer = record_get_timer(timer_pool, record, j);
 			if (timer->hit_count == 0 && !warn) {
-				pinba_error(P_WARNING, "already cleared timer! timer_id: %ld, tmp_id: %d, timers_cnt: %d, timers_start: %d, timer_pool->size: %d", record->timers_start + j, tmp_id, record->timers_cnt, record->timers_start, timer_pool->size);
+				pinba_error(P_WARNING, "already cleared timer! timer_id: %zd, tmp_id: %d, timers_cnt: %d, timers_start: %zd, timer_pool->size: %zd", record_get_timer_id(timer_pool, record, j), tmp_id, record->timers_cnt, record->timers_start, timer_pool->size);
 				warn = 1;
 			}
 			d->timertag_cnt += timer->tag_num;
 			timer->tag_num = 0;
-			timer->value.tv_sec = 0;
-			timer->value.tv_usec = 0;
+			timer->value = 0;
 			timer->hit_count = 0;
 		}
 		/* record->timers_cnt = 0; can't do that under read lock */
@@ -452,51 +975,433 @@ void clear_record_timers_func(void *job_data) /* {{{ */
 }
 /* }}} */
 
-void update_tag_reports_func(void *job_data) /* {{{ */
+static void pinba_tag_report_update_records(pinba_tag_report *report, unsigned int prefix, unsigned int count, int add) /* {{{ */
 {
-	struct reports_job_data *d = (struct reports_job_data *)job_data;
-	unsigned int i, n, tmp_id, saved_tmp_id;
+	unsigned int i, tmp_id;
 	pinba_pool *request_pool = &D->request_pool;
 	pinba_stats_record *record;
 	pinba_report_update_function *func;
-	pinba_std_report *report;
+	struct rusage rusage_data;
 
-	tmp_id = d->prefix;
+	tmp_id = prefix;
 	if (tmp_id >= request_pool->size) {
 		tmp_id = tmp_id - request_pool->size;
 	}
-	saved_tmp_id = tmp_id;
 
-	for (n = 0; n < D->tag_reports_arr.size; n++) {
-		struct rusage rusage_data;
+	if (add) {
+		func = report->std.add_func;
+	} else {
+		func = report->std.delete_func;
+	}
+
+	pinba_get_rusage(&rusage_data);
+	for (i = 0; i < count; i++, tmp_id = (tmp_id == request_pool->size - 1) ? 0 : tmp_id + 1) {
+		record = REQ_POOL(request_pool) + tmp_id;
+
+		if (record->timers_cnt > 0) {
+			CHECK_REPORT_CONDITIONS_CONTINUE((&report->std), record);
+			func(tmp_id, report, record);
+		}
+	}
+	pinba_report_add_rusage(&report->std, &rusage_data);
+}
+/* }}} */
+
+void update_reports_range_func(void *arg, size_t start, size_t end, size_t worker) /* {{{ */
+{
+	struct reports_range_data *r = (struct reports_range_data *)arg;
+	pinba_std_report *reports[PINBA_FUSED_REPORTS_MAX];
+	size_t i, n, cnt;
+
+	/* a group of reports at a time, a report is never shared between the threads */
+	for (i = start; i < end; i += cnt) {
+		cnt = end - i;
+		if (cnt > PINBA_FUSED_REPORTS_MAX) {
+			cnt = PINBA_FUSED_REPORTS_MAX;
+		}
+
+		for (n = 0; n < cnt; n++) {
+			reports[n] = (pinba_std_report *)r->reports->data[i + n];
+
+			pthread_rwlock_wrlock(&reports[n]->lock);
+			if (r->add) {
+				pinba_report_set_start(reports[n], r->prefix);
+				reports[n]->packets_cnt += r->count;
+			}
+		}
+
+		pinba_reports_update_records(reports, cnt, r->prefix, r->count, r->add);
+
+		for (n = 0; n < cnt; n++) {
+			reports[n]->time_interval = pinba_get_time_interval(reports[n]);
+			pthread_rwlock_unlock(&reports[n]->lock);
+		}
+	}
+}
+/* }}} */
+
+static void update_report_shards_range_func(void *arg, size_t start, size_t end, size_t worker) /* {{{ */
+{
+	struct reports_range_data *r = (struct reports_range_data *)arg;
+	pinba_std_report *reports[PINBA_FUSED_REPORTS_MAX];
+	struct report_shard_job *job;
+	size_t i, n, cnt;
+
+	/* the reports are locked by pinba_update_base_reports() */
+	for (i = start; i < end; i += cnt) {
+		cnt = end - i;
+		if (cnt > PINBA_FUSED_REPORTS_MAX) {
+			cnt = PINBA_FUSED_REPORTS_MAX;
+		}
+
+		for (n = 0; n < cnt; n++) {
+			job = r->shard_jobs + i + n;
+			if (job->shards_cnt == 1) {
+				reports[n] = &job->report->std;
+			} else {
+				reports[n] = &job->shard.std;
+			}
+		}
+
+		pinba_reports_update_records(reports, cnt, r->prefix, r->count, r->add);
+	}
+}
+/* }}} */
+
+void pinba_update_reports(struct reports_range_data *r) /* {{{ */
+{
+	th_pool_parallel_for(D->thread_pool, 0, r->reports->size, pinba_reports_grain(r->reports->size), update_reports_range_func, r);
+}
+/* }}} */
+
+void pinba_update_base_reports(struct reports_range_data *r) /* {{{ */
+{
+	pinba_report *report;
+	struct report_shard_job *job;
+	size_t i, n, shards_cnt, jobs_cnt = 0;
+
+	/* the reports stay locked until all of their shards are updated */
+	for (i = 0; i < r->reports->size; i++) {
+		report = (pinba_report *)r->reports->data[i];
+
+		pthread_rwlock_wrlock(&report->std.lock);
+		if (r->add) {
+			pinba_report_set_start(&report->std, r->prefix);
+			report->std.packets_cnt += r->count;
+		}
+
+		/* a large report would keep one thread busy long after the others are done,
+		   so its results are split into shards, one thread per shard */
+		if (report->std.type != PINBA_TABLE_REPORT_INFO && D->thread_pool->size > 1 && pinba_map_count(report->results) >= PINBA_REPORT_SHARD_MIN_RESULTS) {
+			report->results = pinba_map_reshard(report->results, D->thread_pool->size);
+		}
+		jobs_cnt += pinba_map_shards_count(report->results);
+	}
+
+	if (r->shard_jobs_alloc < jobs_cnt) {
+		r->shard_jobs_alloc = jobs_cnt * 2;
+		r->shard_jobs = (struct report_shard_job *)realloc(r->shard_jobs, sizeof(struct report_shard_job) * r->shard_jobs_alloc);
+	}
+
+	job = r->shard_jobs;
+	for (i = 0; i < r->reports->size; i++) {
+		report = (pinba_report *)r->reports->data[i];
+		shards_cnt = pinba_map_shards_count(report->results);
+
+		for (n = 0; n < shards_cnt; n++, job++) {
+			job->report = report;
+			job->shards_cnt = shards_cnt;
+			if (shards_cnt == 1) {
+				continue;
+			}
+
+			/* the update functions skip the indexes of the other shards */
+			job->shard = *report;
+			job->shard.results = pinba_map_shard(report->results, n);
+			job->results_cnt = report->std.results_cnt;
+			timerclear(&job->shard.time_total);
+			timerclear(&job->shard.ru_utime_total);
+			timerclear(&job->shard.ru_stime_total);
+			timerclear(&job->shard.std.ru_utime);
+			timerclear(&job->shard.std.ru_stime);
+			job->shard.kbytes_total = 0;
+			job->shard.memory_footprint = 0;
+		}
+	}
+
+	th_pool_parallel_for(D->thread_pool, 0, jobs_cnt, pinba_reports_grain(jobs_cnt), update_report_shards_range_func, r);
+
+	/* merge the totals of the shards */
+	for (i = 0; i < jobs_cnt; i++) {
+		job = r->shard_jobs + i;
+		if (job->shards_cnt == 1) {
+			continue;
+		}
+
+		report = job->report;
+		timeradd(&report->time_total, &job->shard.time_total, &report->time_total);
+		timeradd(&report->ru_utime_total, &job->shard.ru_utime_total, &report->ru_utime_total);
+		timeradd(&report->ru_stime_total, &job->shard.ru_stime_total, &report->ru_stime_total);
+		timeradd(&report->std.ru_utime, &job->shard.std.ru_utime, &report->std.ru_utime);
+		timeradd(&report->std.ru_stime, &job->shard.std.ru_stime, &report->std.ru_stime);
+		report->kbytes_total += job->shard.kbytes_total;
+		report->memory_footprint += job->shard.memory_footprint;
+		report->std.results_cnt += job->shard.std.results_cnt - job->results_cnt;
+	}
 
-		report = (pinba_std_report *)D->tag_reports_arr.data[n];
+	for (i = 0; i < r->reports->size; i++) {
+		report = (pinba_report *)r->reports->data[i];
 
-		pthread_rwlock_wrlock(&report->lock);
+		report->std.time_interval = pinba_get_time_interval(&report->std);
+		pthread_rwlock_unlock(&report->std.lock);
+	}
+}
+/* }}} */
 
-		if (d->add) {
-			func = report->add_func;
-			report->packets_cnt += d->count;
+void update_tag_reports_range_func(void *arg, size_t start, size_t end, size_t worker) /* {{{ */
+{
+	struct reports_range_data *r = (struct reports_range_data *)arg;
+	pinba_tag_report *report;
+	size_t i;
+
+	/* one report at a time, used for deletes: a delta can't be subtracted from an empty copy */
+	for (i = start; i < end; i++) {
+		report = (pinba_tag_report *)r->reports->data[i];
+
+		pthread_rwlock_wrlock(&report->std.lock);
+		if (r->add) {
+			report->std.packets_cnt += r->count;
+		}
+
+		pinba_tag_report_update_records(report, r->prefix, r->count, r->add);
+
+		report->std.time_interval = pinba_get_time_interval(&report->std);
+		pthread_rwlock_unlock(&report->std.lock);
+	}
+}
+/* }}} */
+
+static inline void pinba_tag_data_free(pinba_tag_report *report, struct pinba_tag_report_data_header *data) /* {{{ */
+{
+	pinba_lmap_destroy(data->histogram_data);
+
+	switch (report->std.type) {
+		case PINBA_TABLE_TAGN_INFO:
+			free(((struct pinba_tagN_info_data *)data)->tag_value);
+			break;
+		case PINBA_TABLE_TAGN_REPORT:
+			free(((struct pinba_tagN_report_data *)data)->tag_value);
+			break;
+		case PINBA_TABLE_TAGN_REPORT2:
+			free(((struct pinba_tagN_report2_data *)data)->tag_value);
+			break;
+		default:
+			break;
+	}
+	free(data);
+}
+/* }}} */
+
+static inline void pinba_tag_data_merge(struct pinba_tag_report_data_header *data, struct pinba_tag_report_data_header *delta) /* {{{ */
+{
+	uint64_t slot_num;
+	void *value;
+
+	/* a request is added by one thread only, so its tag values are never counted twice */
+	data->req_count += delta->req_count;
+	data->hit_count += delta->hit_count;
+	timeradd(&data->timer_value, &delta->timer_value, &data->timer_value);
+	timeradd(&data->ru_utime_value, &delta->ru_utime_value, &data->ru_utime_value);
+	timeradd(&data->ru_stime_value, &delta->ru_stime_value, &data->ru_stime_value);
+
+	for (value = pinba_lmap_first(delta->histogram_data, &slot_num); value != NULL; value = pinba_lmap_next(delta->histogram_data, &slot_num)) {
+		value = (void *)((size_t)pinba_lmap_get(data->histogram_data, slot_num) + (size_t)value);
+		data->histogram_data = pinba_lmap_add(data->histogram_data, slot_num, value);
+	}
+}
+/* }}} */
+
+static size_t pinba_tag_results_merge(pinba_tag_report *report, void **results, void *delta_results) /* {{{ */
+{
+	char index[PINBA_MAX_LINE_LEN] = {0};
+	struct pinba_tag_report_data_header *data, *delta;
+	size_t added = 0;
+
+	/* returns the number of the new results */
+	for (delta = (struct pinba_tag_report_data_header *)pinba_map_first(delta_results, index); delta != NULL; delta = (struct pinba_tag_report_data_header *)pinba_map_next(delta_results, index)) {
+		data = (struct pinba_tag_report_data_header *)pinba_map_get(*results, index);
+		if (!data) {
+			*results = pinba_map_add(*results, index, delta);
+			added++;
 		} else {
-			func = report->delete_func;
+			pinba_tag_data_merge(data, delta);
+			pinba_tag_data_free(report, delta);
 		}
+	}
+	pinba_map_destroy(delta_results);
+	return added;
+}
+/* }}} */
 
-		tmp_id = saved_tmp_id;
+static void pinba_tag_report_delta_merge(pinba_tag_report *report, pinba_tag_report *delta) /* {{{ */
+{
+	if (delta->results) {
+		if ((report->std.flags & PINBA_REPORT_INDEXED) != 0) {
+			char index[PINBA_MAX_LINE_LEN] = {0};
+			void *index_map, *delta_map;
+
+			for (delta_map = pinba_map_first(delta->results, index); delta_map != NULL; delta_map = pinba_map_next(delta->results, index)) {
+				index_map = pinba_map_get(report->results, index);
+				if (!index_map) {
+					report->results = pinba_map_add(report->results, index, delta_map);
+					report->std.results_cnt += pinba_map_count(delta_map);
+				} else {
+					report->std.results_cnt += pinba_tag_results_merge(report, &index_map, delta_map);
+				}
+			}
+			pinba_map_destroy(delta->results);
+		} else {
+			report->std.results_cnt += pinba_tag_results_merge(report, &report->results, delta->results);
+		}
+		delta->results = NULL;
+	}
 
-		pinba_get_rusage(&rusage_data);
-		for (i = 0; i < d->count; i++, tmp_id = (tmp_id == request_pool->size - 1) ? 0 : tmp_id + 1) {
-			record = REQ_POOL(request_pool) + tmp_id;
+	timeradd(&report->std.ru_utime, &delta->std.ru_utime, &report->std.ru_utime);
+	timeradd(&report->std.ru_stime, &delta->std.ru_stime, &report->std.ru_stime);
+}
+/* }}} */
 
-			if (record->timers_cnt > 0) {
-				CHECK_REPORT_CONDITIONS_CONTINUE(report, record);
-				func(tmp_id, report, record);
+static int pinba_tag_report_delta_init(struct tag_report_delta *d, pinba_tag_report *report) /* {{{ */
+{
+	size_t index_size = 0;
+
+	/* same as the report buffers, see ha_pinba.cc */
+	if (report->index) {
+		index_size = PINBA_TAG_VALUE_SIZE * report->tags_cnt + report->tags_cnt + 1;
+		if (d->index_size < index_size) {
+			char *tmp = (char *)realloc(d->index, index_size);
+			if (!tmp) {
+				return -1;
 			}
+			d->index = tmp;
+			d->index_size = index_size;
 		}
+	}
 
-		pinba_report_add_rusage(report, &rusage_data);
-		report->time_interval = pinba_get_time_interval(report);
-		pthread_rwlock_unlock(&report->lock);
+	if (report->words && d->words_cnt < (size_t)report->tags_cnt) {
+		pinba_word **tmp = (pinba_word **)realloc(d->words, report->tags_cnt * sizeof(pinba_word *));
+		if (!tmp) {
+			return -1;
+		}
+		d->words = tmp;
+		d->words_cnt = report->tags_cnt;
 	}
+
+	d->delta = *report;
+	d->delta.results = NULL;
+	d->delta.std.results_cnt = 0;
+	d->delta.index = report->index ? d->index : NULL;
+	d->delta.words = report->words ? d->words : NULL;
+	timerclear(&d->delta.std.ru_utime);
+	timerclear(&d->delta.std.ru_stime);
+	return 0;
+}
+/* }}} */
+
+static void update_tag_deltas_range_func(void *arg, size_t start, size_t end, size_t worker) /* {{{ */
+{
+	struct reports_range_data *r = (struct reports_range_data *)arg;
+	struct tag_report_delta *deltas = r->tag_deltas + worker * r->reports->size;
+	size_t n;
+
+	/* no locks here, the copies belong to this thread */
+	for (n = 0; n < r->reports->size; n++) {
+		pinba_tag_report_update_records(&deltas[n].delta, r->prefix + start, end - start, 1);
+	}
+}
+/* }}} */
+
+static void merge_tag_deltas_range_func(void *arg, size_t start, size_t end, size_t worker) /* {{{ */
+{
+	struct reports_range_data *r = (struct reports_range_data *)arg;
+	pinba_tag_report *report;
+	size_t i, n;
+
+	for (n = start; n < end; n++) {
+		report = (pinba_tag_report *)r->reports->data[n];
+
+		pthread_rwlock_wrlock(&report->std.lock);
+		report->std.packets_cnt += r->count;
+
+		for (i = 0; i < D->thread_pool->size; i++) {
+			pinba_tag_report_delta_merge(report, &r->tag_deltas[i * r->reports->size + n].delta);
+		}
+
+		report->std.time_interval = pinba_get_time_interval(&report->std);
+		pthread_rwlock_unlock(&report->std.lock);
+	}
+}
+/* }}} */
+
+void pinba_update_tag_reports(struct reports_range_data *r) /* {{{ */
+{
+	size_t i, n, reports_cnt = r->reports->size, deltas_cnt = reports_cnt * D->thread_pool->size;
+	pinba_tag_report *report;
+	int failed = 0;
+
+	if (reports_cnt == 0) {
+		return;
+	}
+
+	if (r->tag_deltas_alloc < deltas_cnt) {
+		struct tag_report_delta *tmp = (struct tag_report_delta *)realloc(r->tag_deltas, sizeof(struct tag_report_delta) * deltas_cnt * 2);
+		if (tmp) {
+			memset(tmp + r->tag_deltas_alloc, 0, sizeof(struct tag_report_delta) * (deltas_cnt * 2 - r->tag_deltas_alloc));
+			r->tag_deltas = tmp;
+			r->tag_deltas_alloc = deltas_cnt * 2;
+		} else {
+			failed = 1;
+		}
+	}
+
+	/* every thread gets an empty copy of every report */
+	for (n = 0; n < reports_cnt && !failed; n++) {
+		report = (pinba_tag_report *)r->reports->data[n];
+
+		pthread_rwlock_rdlock(&report->std.lock);
+		for (i = 0; i < D->thread_pool->size; i++) {
+			if (pinba_tag_report_delta_init(r->tag_deltas + i * reports_cnt + n, report) != 0) {
+				failed = 1;
+				break;
+			}
+		}
+		pthread_rwlock_unlock(&report->std.lock);
+	}
+
+	if (failed) {
+		pinba_error(P_WARNING, "failed to allocate thread-local tag reports, updating the reports in place");
+		th_pool_parallel_for(D->thread_pool, 0, reports_cnt, 1, update_tag_reports_range_func, r);
+		return;
+	}
+
+	/* the threads aggregate their parts of the records into their copies without locking,
+	   then every report is locked once to merge the copies into it */
+	th_pool_parallel_for(D->thread_pool, 0, r->count, PINBA_THREAD_POOL_RECORDS_GRAIN, update_tag_deltas_range_func, r);
+	th_pool_parallel_for(D->thread_pool, 0, reports_cnt, 1, merge_tag_deltas_range_func, r);
+}
+/* }}} */
+
+void clear_record_timers_range_func(void *arg, size_t start, size_t end, size_t worker) /* {{{ */
+{
+	struct reports_range_data *r = (struct reports_range_data *)arg;
+	struct packets_job_data d;
+
+	d.prefix = r->prefix + start;
+	d.count = end - start;
+	d.timertag_cnt = 0;
+	clear_record_timers_func(&d);
+
+	r->timertag_cnt[worker] += d.timertag_cnt;
 }
 /* }}} */
 
@@ -514,6 +1419,10 @@ inline void pinba_request_pool_delete_old(struct timeval from, size_t *deleted_t
 			(*deleted_timer_cnt) += record->timers_cnt;
 			(*rtags_cnt) += record->data.tags_cnt;
 
+			/* the words are freed by pinba_dictionary_compact() under this lock only,
+			   so they live until the reports forget the record */
+			pinba_stats_record_words_unref(record);
+
 			p->out++;
 			if (p->out == p->size) {
 				p->out = 0;
@@ -528,29 +1437,17 @@ inline void pinba_request_pool_delete_old(struct timeval from, size_t *deleted_t
 void *pinba_stats_main(void *arg) /* {{{ */
 {
 	struct timeval launch;
-	struct packets_job_data *packets_job_data_arr;
-	struct reports_job_data *rep_job_data_arr = NULL;
-	struct reports_job_data *tag_rep_job_data_arr = NULL;
-	struct reports_job_data *rtag_rep_job_data_arr = NULL;
+	struct reports_range_data range_data;
+	size_t *timertag_cnt_arr;
 	int prev_request_id, new_request_id;
-	unsigned int base_reports_alloc = 0, rtag_reports_alloc = 0;
 	pinba_pool *request_pool = &D->request_pool;
-	pinba_pool *timer_pool = &D->timer_pool;
-	thread_pool_barrier_t *barrier1, *barrier2, *barrier3, *barrier4;
+	pinba_timer_pool *timer_pool = &D->timer_pool;
 
 	pinba_debug("starting up stats thread");
 
 	/* yes, it's a minor memleak. once per process start. */
-	packets_job_data_arr = (struct packets_job_data *)malloc(sizeof(struct packets_job_data) * D->thread_pool->size);
-	tag_rep_job_data_arr = (struct reports_job_data *)malloc(sizeof(struct reports_job_data) * D->thread_pool->size);
-	barrier1 = (thread_pool_barrier_t *)malloc(sizeof(*barrier1));
-	barrier2 = (thread_pool_barrier_t *)malloc(sizeof(*barrier2));
-	barrier3 = (thread_pool_barrier_t *)malloc(sizeof(*barrier3));
-	barrier4 = (thread_pool_barrier_t *)malloc(sizeof(*barrier4));
-	th_pool_barrier_init(barrier1);
-	th_pool_barrier_init(barrier2);
-	th_pool_barrier_init(barrier3);
-	th_pool_barrier_init(barrier4);
+	timertag_cnt_arr = (size_t *)malloc(sizeof(size_t) * D->thread_pool->size);
+	memset(&range_data, 0, sizeof(range_data));
 
 	gettimeofday(&launch, 0);
 
@@ -563,11 +1460,16 @@ void *pinba_stats_main(void *arg) /* {{{ */
 		}
 
 		pthread_rwlock_wrlock(&D->collector_lock);
+		/* the tags of the timers deleted during the previous pass */
+		pinba_timer_tags_release(timer_pool);
+		/* the words released by the previous pass are not in use anymore */
+		pinba_dictionary_compact();
+
 		/* make sure we don't store any OLD data */
 		from.tv_sec = launch.tv_sec - D->settings.stats_history;
 		from.tv_usec = launch.tv_usec;
 
-		memset(packets_job_data_arr, 0, sizeof(struct packets_job_data) * D->thread_pool->size);
+		memset(timertag_cnt_arr, 0, sizeof(size_t) * D->thread_pool->size);
 		prev_request_id = request_pool->out;
 
 		pinba_request_pool_delete_old(from, &deleted_timer_cnt, &rtags_cnt);
@@ -579,7 +1481,7 @@ void *pinba_stats_main(void *arg) /* {{{ */
 		pthread_rwlock_rdlock(&D->collector_lock);
 
 		{
-			unsigned int i, accounted, job_size, num;
+			unsigned int i, num;
 
 			if (new_request_id == prev_request_id) {
 				num = 0;
@@ -591,110 +1493,40 @@ void *pinba_stats_main(void *arg) /* {{{ */
 
 			if (num > 0) { /* pass the work to the threads {{{ */
 
-				/* update base reports - one report per thread */
-				pthread_rwlock_rdlock(&D->base_reports_lock);
-				if (base_reports_alloc < D->base_reports_arr.size) {
-					base_reports_alloc = D->base_reports_arr.size * 2;
-					rep_job_data_arr = (struct reports_job_data *)realloc(rep_job_data_arr, sizeof(struct reports_job_data) * base_reports_alloc);
-				}
-				memset(rep_job_data_arr, 0, sizeof(struct reports_job_data) * base_reports_alloc);
-
-				th_pool_barrier_start(barrier1);
-
-				for (i= 0; i < D->base_reports_arr.size; i++) {
-					rep_job_data_arr[i].prefix = prev_request_id;
-					rep_job_data_arr[i].count = num;
-					rep_job_data_arr[i].report = D->base_reports_arr.data[i];
-					rep_job_data_arr[i].add = 0;
-					th_pool_dispatch(D->thread_pool, barrier1, update_reports_func, &(rep_job_data_arr[i]));
-				}
-				th_pool_barrier_wait(barrier1);
+				range_data.prefix = prev_request_id;
+				range_data.count = num;
+				range_data.add = 0;
+				range_data.timertag_cnt = timertag_cnt_arr;
 
+				/* update base reports - a group of reports or shards of the large ones per thread */
+				pthread_rwlock_rdlock(&D->base_reports_lock);
+				range_data.reports = &D->base_reports_arr;
+				pinba_update_base_reports(&range_data);
 				pthread_rwlock_unlock(&D->base_reports_lock);
 
 				if (rtags_cnt) {
-					/* update rtag reports - one report per thread */
+					/* update rtag reports - a group of reports per thread */
 					pthread_rwlock_rdlock(&D->rtag_reports_lock);
-					if (rtag_reports_alloc < D->rtag_reports_arr.size) {
-						rtag_reports_alloc = D->rtag_reports_arr.size * 2;
-						rtag_rep_job_data_arr = (struct reports_job_data *)realloc(rtag_rep_job_data_arr, sizeof(struct reports_job_data) * rtag_reports_alloc);
-					}
-
-					memset(rtag_rep_job_data_arr, 0, sizeof(struct reports_job_data) * rtag_reports_alloc);
-
-					th_pool_barrier_start(barrier4);
-					for (i= 0; i < D->rtag_reports_arr.size; i++) {
-						rtag_rep_job_data_arr[i].prefix = prev_request_id;
-						rtag_rep_job_data_arr[i].count = num;
-						rtag_rep_job_data_arr[i].report = D->rtag_reports_arr.data[i];
-						rtag_rep_job_data_arr[i].add = 0;
-						th_pool_dispatch(D->thread_pool, barrier4, update_reports_func, &(rtag_rep_job_data_arr[i]));
-					}
-					th_pool_barrier_wait(barrier4);
+					range_data.reports = &D->rtag_reports_arr;
+					pinba_update_reports(&range_data);
 					pthread_rwlock_unlock(&D->rtag_reports_lock);
 				}
 
 				if (deleted_timer_cnt > 0) {
-					if (num < (D->thread_pool->size * PINBA_THREAD_POOL_THRESHOLD_AMOUNT)) {
-						job_size = num;
-					} else {
-						job_size = num/D->thread_pool->size;
-					}
-
 					pthread_rwlock_wrlock(&D->timer_lock);
 					pthread_rwlock_rdlock(&D->tag_reports_lock);
 
-					/* update tag reports - all threads share the reports */
-					accounted = 0;
-					th_pool_barrier_start(barrier2);
-					for (i= 0; i < D->thread_pool->size; i++) {
-						unsigned l_job_size = job_size;
-
-						if (i == D->thread_pool->size - 1) {
-							l_job_size = num - accounted;
-						}
-
-						tag_rep_job_data_arr[i].prefix = prev_request_id + accounted;
-						tag_rep_job_data_arr[i].count = l_job_size;
-						tag_rep_job_data_arr[i].add = 0;
-						accounted += l_job_size;
-
-						th_pool_dispatch(D->thread_pool, barrier2, update_tag_reports_func, &(tag_rep_job_data_arr[i]));
-
-						if (accounted == num) {
-							break;
-						}
-					}
-					th_pool_barrier_wait(barrier2);
+					/* update tag reports - one report per thread */
+					range_data.reports = &D->tag_reports_arr;
+					th_pool_parallel_for(D->thread_pool, 0, D->tag_reports_arr.size, 1, update_tag_reports_range_func, &range_data);
 					pthread_rwlock_unlock(&D->tag_reports_lock);
 
-					accounted = 0;
-					th_pool_barrier_start(barrier3);
-					for (i= 0; i < D->thread_pool->size; i++) {
-						unsigned l_job_size = job_size;
-
-						if (i == D->thread_pool->size - 1) {
-							l_job_size = num - accounted;
-						}
-						packets_job_data_arr[i].prefix = prev_request_id + accounted;
-						packets_job_data_arr[i].count = l_job_size;
-						packets_job_data_arr[i].timertag_cnt = 0;
-						accounted += l_job_size;
-						th_pool_dispatch(D->thread_pool, barrier3, clear_record_timers_func, &(packets_job_data_arr[i]));
-						if (accounted == num) {
-							break;
-						}
-					}
-					th_pool_barrier_wait(barrier3);
+					th_pool_parallel_for(D->thread_pool, 0, num, PINBA_THREAD_POOL_RECORDS_GRAIN, clear_record_timers_range_func, &range_data);
 
-					if ((timer_pool->out + deleted_timer_cnt) >= timer_pool->size) {
-						timer_pool->out = (timer_pool->out + deleted_timer_cnt) - timer_pool->size;
-					} else {
-						timer_pool->out += deleted_timer_cnt;
-					}
+					timer_pool->out = (timer_pool->out + deleted_timer_cnt) & PINBA_TIMER_ID_MASK;
 
 					for (i = 0; i < D->thread_pool->size; i++) {
-						D->timertags_cnt -= packets_job_data_arr[i].timertag_cnt;
+						D->timertags_cnt -= timertag_cnt_arr[i];
 					}
 					pthread_rwlock_unlock(&D->timer_lock);
 				}
@@ -16,173 +16,102 @@
 #include "pinba.h"
 #include "threadpool.h"
 
-#define MAX_QUEUE_MEMORY_SIZE 65536
-
-static inline queue_head_t *queue_create(int initial_cap) /* {{{ */
+#define TH_POOL_DEQUE_INITIAL_SIZE 64
+
+struct _th_pool_range_t {
+	range_fn_t func;
+	void *arg;
+	size_t grain;
+	size_t remaining; /* items not processed yet, atomic */
+	int finished; /* protected by the mutex, the range is on the caller's stack */
+	pthread_mutex_t mutex;
+	pthread_cond_t done;
+};
+
+static inline int deque_init(th_pool_deque_t *deque) /* {{{ */
 {
-	queue_head_t *theQueue = (queue_head_t *) malloc (sizeof(queue_head_t));
-	int max_cap = MAX_QUEUE_MEMORY_SIZE / (sizeof(queue_node_t));
-	int i;
-	queue_node_t *temp;
-
-	if (theQueue == NULL) {
-		return NULL;
-	}
-
-	if (initial_cap > max_cap) {
-		initial_cap = max_cap;
+	deque->tasks = (th_pool_task_t *)malloc(sizeof(th_pool_task_t) * TH_POOL_DEQUE_INITIAL_SIZE);
+	if (deque->tasks == NULL) {
+		return -1;
 	}
-
-	if (initial_cap == 0) {
-		return NULL;
-	}
-
-	theQueue->capacity = initial_cap;
-	theQueue->posted = 0;
-	theQueue->max_capacity = max_cap;
-	theQueue->head = NULL;
-	theQueue->tail = NULL;
-	theQueue->freeHead = (queue_node_t *) malloc (sizeof(queue_node_t));
-
-	if (theQueue->freeHead == NULL) {
-		free(theQueue);
-		return NULL;
-	}
-	theQueue->freeTail = theQueue->freeHead;
-
-	//populate the free queue
-	for(i = 0; i< initial_cap; i++) {
-		temp = (queue_node_t *) malloc (sizeof(queue_node_t));
-		if (temp == NULL) {
-			return theQueue;
-		}
-		temp->next = theQueue->freeHead;
-		temp->prev = NULL;
-		theQueue->freeHead->prev = temp;
-		theQueue->freeHead = temp;
-	}
-
-	return theQueue;
+	deque->capacity = TH_POOL_DEQUE_INITIAL_SIZE;
+	deque->head = 0;
+	deque->tail = 0;
+	pthread_mutex_init(&deque->mutex, NULL);
+	return 0;
 }
 /* }}} */
 
-static inline void queue_destroy(queue_head_t *queue) /* {{{ */
+static inline void deque_destroy(th_pool_deque_t *deque) /* {{{ */
 {
-	queue_node_t *node, *temp;
-
-	temp = queue->head;
-	while (temp) {
-		node = temp;
-		temp = node->next;
-		free(node);
-	}
-	
-	temp = queue->freeHead;
-	while (temp) {
-		node = temp;
-		temp = node->next;
-		free(node);
-	}
-	free(queue);
+	pthread_mutex_destroy(&deque->mutex);
+	free(deque->tasks);
+	deque->tasks = NULL;
 }
 /* }}} */
 
-static inline void queue_post_job(queue_head_t * theQueue, thread_pool_barrier_t *barrier, dispatch_fn_t func1, void * arg1, dispatch_fn_t func2, void * arg2) /* {{{ */
+static inline int deque_push(th_pool_deque_t *deque, th_pool_task_t *task) /* {{{ */
 {
-	queue_node_t *temp;
-		
-	if (theQueue->freeTail == NULL) {
-	    temp = (queue_node_t *) malloc (sizeof(queue_node_t));
-		if (temp == NULL) {
-			return;
+	pthread_mutex_lock(&deque->mutex);
+	if (deque->tail - deque->head == deque->capacity) {
+		th_pool_task_t *tasks;
+		size_t i;
+
+		tasks = (th_pool_task_t *)malloc(sizeof(th_pool_task_t) * deque->capacity * 2);
+		if (tasks == NULL) {
+			pthread_mutex_unlock(&deque->mutex);
+			return -1;
 		}
-		temp->next = NULL;
-		temp->prev = NULL;
-		theQueue->freeHead = temp;
-		theQueue->freeTail = temp;
-		theQueue->capacity++;
-	}
-	
-	temp = theQueue->freeTail;
-	if (theQueue->freeTail->prev == NULL) {
-		theQueue->freeTail = NULL;
-		theQueue->freeHead = NULL;
-	} else {
-		theQueue->freeTail->prev->next= NULL;
-		theQueue->freeTail = theQueue->freeTail->prev;
-		theQueue->freeTail->next = NULL;
-	}
-
-	theQueue->posted++;
-	temp->func_to_dispatch = func1;
-	temp->func_arg = arg1;
-	temp->cleanup_func = func2;
-	temp->cleanup_arg = arg2;
-	temp->barrier = barrier;
-	if (barrier) {
-		barrier->posted_count++;
-	}
-
-	temp->prev = theQueue->tail;
-	temp->next = NULL;
 
-	if (theQueue->tail) {
-		theQueue->tail->next = temp;
-	} else {
-		theQueue->head = temp;
+		for (i = deque->head; i != deque->tail; i++) {
+			tasks[i & (deque->capacity * 2 - 1)] = deque->tasks[i & (deque->capacity - 1)];
+		}
+		free(deque->tasks);
+		deque->tasks = tasks;
+		deque->capacity *= 2;
 	}
-	theQueue->tail = temp;
+	deque->tasks[deque->tail & (deque->capacity - 1)] = *task;
+	__atomic_store_n(&deque->tail, deque->tail + 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&deque->mutex);
+	return 0;
 }
 /* }}} */
 
-static inline void queue_fetch_job(queue_head_t * theQueue, thread_pool_barrier_t **barrier, dispatch_fn_t * func1, void ** arg1, dispatch_fn_t * func2, void ** arg2) /* {{{ */
+static inline int deque_pop(th_pool_deque_t *deque, th_pool_task_t *task) /* {{{ */
 {
-	queue_node_t *temp;
-		
-	temp = theQueue->tail;
-	if (temp == NULL) {
-		return;
-	}
+	int res = 0;
 
-	if (temp->prev) {
-		temp->prev->next = NULL;
-	} else {
-		theQueue->head = NULL;
-	}
-	theQueue->tail = temp->prev;
-
-	*func1 = temp->func_to_dispatch;
-	*arg1  = temp->func_arg;
-	*func2 = temp->cleanup_func;
-	*arg2  = temp->cleanup_arg;
-	*barrier = temp->barrier;
-
-	temp->next = NULL;
-	temp->prev = NULL;
-	if (theQueue->freeHead == NULL) {
-		theQueue->freeTail = temp;
-		theQueue->freeHead = temp;
-	} else {
-		temp->next = theQueue->freeHead;
-		theQueue->freeHead->prev = temp;
-		theQueue->freeHead = temp;
+	pthread_mutex_lock(&deque->mutex);
+	if (deque->tail != deque->head) {
+		__atomic_store_n(&deque->tail, deque->tail - 1, __ATOMIC_RELAXED);
+		*task = deque->tasks[deque->tail & (deque->capacity - 1)];
+		res = 1;
 	}
+	pthread_mutex_unlock(&deque->mutex);
+	return res;
 }
 /* }}} */
 
-static inline int queue_can_accept_order(queue_head_t * theQueue) /* {{{ */
+static inline int deque_steal(th_pool_deque_t *deque, th_pool_task_t *task) /* {{{ */
 {
-	return (theQueue->freeTail != NULL || theQueue->capacity <= theQueue->max_capacity);
-}
-/* }}} */
+	int res = 0;
 
-static inline int queue_is_job_available(queue_head_t * theQueue) /* {{{ */
-{
-  return (theQueue->tail != NULL);
+	/* no need to lock the deque if there is nothing to steal */
+	if (__atomic_load_n(&deque->tail, __ATOMIC_RELAXED) == __atomic_load_n(&deque->head, __ATOMIC_RELAXED)) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&deque->mutex);
+	if (deque->tail != deque->head) {
+		*task = deque->tasks[deque->head & (deque->capacity - 1)];
+		__atomic_store_n(&deque->head, deque->head + 1, __ATOMIC_RELAXED);
+		res = 1;
+	}
+	pthread_mutex_unlock(&deque->mutex);
+	return res;
 }
 /* }}} */
 
-
 #if THREAD_POOL_DEBUG
 static inline void etfprintf(struct timeval then, ...) /* {{{ */
 {
@@ -213,89 +142,168 @@ static void th_pool_mutex_unlock_wrapper(void *data) /* {{{ */
 }
 /* }}} */
 
+static void th_pool_range_done(th_pool_range_t *range, size_t count) /* {{{ */
+{
+	if (__atomic_sub_fetch(&range->remaining, count, __ATOMIC_ACQ_REL) == 0) {
+		pthread_mutex_lock(&range->mutex);
+		range->finished = 1;
+		pthread_cond_signal(&range->done);
+		pthread_mutex_unlock(&range->mutex);
+	}
+}
+/* }}} */
+
+static int th_pool_push(thread_pool_t *pool, size_t id, th_pool_task_t *task) /* {{{ */
+{
+	/* counted before the push, so that a worker can't see the task without the counter
+	   and go to sleep; at worst a worker spins once more over the deques */
+	__atomic_add_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+	if (deque_push(&pool->workers[id].deque, task) != 0) {
+		__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+		return -1;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pthread_cond_signal(&pool->job_posted);
+	pthread_mutex_unlock(&pool->mutex);
+	return 0;
+}
+/* }}} */
+
+/* range tasks are only posted here by worker id itself, see th_pool_parallel_for() for the caller's ones */
+static void th_pool_post(thread_pool_t *pool, size_t id, th_pool_task_t *task) /* {{{ */
+{
+	if (th_pool_push(pool, id, task) == 0) {
+		return;
+	}
+
+	/* not enough memory to queue it, run it right here */
+	TP_DEBUG(pool, " --- failed to grow deque[%d], running the task in place\n", id);
+	if (task->range) {
+		task->range->func(task->range->arg, task->start, task->end, id);
+		th_pool_range_done(task->range, task->end - task->start);
+	} else {
+		task->func_to_dispatch(task->func_arg);
+		if (task->cleanup_func) {
+			task->cleanup_func(task->cleanup_arg);
+		}
+		if (task->barrier) {
+			th_pool_barrier_signal(task->barrier);
+		}
+	}
+}
+/* }}} */
+
+static int th_pool_take(thread_pool_t *pool, size_t id, th_pool_task_t *task) /* {{{ */
+{
+	size_t i;
+
+	if (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) == 0) {
+		return 0;
+	}
+
+	/* the newest task from our own deque is the most likely to be still in the cache */
+	if (deque_pop(&pool->workers[id].deque, task)) {
+		goto found;
+	}
+
+	/* steal the oldest (= the largest part of a range) task from the others */
+	for (i = 1; i < pool->size; i++) {
+		if (deque_steal(&pool->workers[(id + i) % pool->size].deque, task)) {
+			goto found;
+		}
+	}
+	return 0;
+
+found:
+	__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+	return 1;
+}
+/* }}} */
+
+static void th_pool_run_range(thread_pool_t *pool, size_t id, th_pool_task_t *task) /* {{{ */
+{
+	th_pool_range_t *range = task->range;
+	th_pool_task_t half;
+
+	/* leave the upper halves for the thieves, keep splitting the lower one */
+	while (task->end - task->start > range->grain) {
+		half = *task;
+		half.start = task->start + (task->end - task->start) / 2;
+		task->end = half.start;
+		th_pool_post(pool, id, &half);
+	}
+
+	range->func(range->arg, task->start, task->end, id);
+	th_pool_range_done(range, task->end - task->start);
+}
+/* }}} */
+
 /* The Worker function */
 static void *th_do_work(void *data) /* {{{ */
 {
-	thread_pool_t *pool = (thread_pool_t *)data; 
-	thread_pool_barrier_t *barrier;
-#if THREAD_POOL_DEBUG
-	int myid = pool->live; /* this is wrong, but we need it only for debugging */
-#endif
-	
-	/* When we get a posted job, we copy it into these local vars */
-	dispatch_fn_t  myjob;
-	void        *myarg;  
-	dispatch_fn_t  mycleaner;
-	void        *mycleanarg;
+	th_pool_worker_t *worker = (th_pool_worker_t *)data;
+	thread_pool_t *pool = worker->pool;
+	th_pool_task_t task;
 
-	TP_DEBUG(pool, " >>> Thread[%d] starting, grabbing mutex.\n", myid);
+	TP_DEBUG(pool, " >>> Thread[%d] starting.\n", worker->id);
 
 	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
-	pthread_cleanup_push(th_pool_mutex_unlock_wrapper, (void *)&pool->mutex);
-
-	/* Grab mutex so we can begin waiting for a job */
-	if (0 != pthread_mutex_lock(&pool->mutex)) {
-		return NULL;
-	}
 
-	/* Main loop: wait for job posting, do job(s) ... forever */
+	/* Main loop: find a job, do job(s) ... forever */
 	for( ; ; ) {
 
-		TP_DEBUG(pool, " <<< Thread[%d] waiting for signal.\n", myid);
+		if (!th_pool_take(pool, worker->id, &task)) {
+			int exiting;
 
-		/* only look for jobs if we're not in shutdown */
-		while(queue_is_job_available(pool->job_queue) == 0) {
-			pthread_cond_wait(&pool->job_posted, &pool->mutex);
-		}
+			TP_DEBUG(pool, " <<< Thread[%d] waiting for signal.\n", worker->id);
 
-		TP_DEBUG(pool, " >>> Thread[%d] received signal.\n", myid);
+			/* nothing to do or to steal, wait for the dispatcher */
+			pthread_cleanup_push(th_pool_mutex_unlock_wrapper, (void *)&pool->mutex);
+			pthread_mutex_lock(&pool->mutex);
+			while (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) == 0 && !pool->exiting) {
+				pthread_cond_wait(&pool->job_posted, &pool->mutex);
+			}
+			exiting = pool->exiting;
+			pthread_cleanup_pop(1);
 
-		/* else execute all the jobs first */
-		queue_fetch_job(pool->job_queue, &barrier, &myjob, &myarg, &mycleaner, &mycleanarg);
-		if (myjob == (void *)-1) {
-			break;
+			if (exiting) {
+				break;
+			}
+			continue;
 		}
-		pthread_cond_signal(&pool->job_taken);
 
-		TP_DEBUG(pool, " <<< Thread[%d] yielding mutex, taking job.\n", myid);
+		TP_DEBUG(pool, " >>> Thread[%d] took a task.\n", worker->id);
 
-		/* unlock mutex so other jobs can be posted */
-		if (0 != pthread_mutex_unlock(&pool->mutex)) {
-			return NULL;
+		if (task.range) {
+			th_pool_run_range(pool, worker->id, &task);
+			continue;
 		}
 
 		/* Run the job we've taken */
-		if(mycleaner != NULL) {
-			pthread_cleanup_push(mycleaner,mycleanarg);
-			myjob(myarg);
+		if(task.cleanup_func != NULL) {
+			pthread_cleanup_push(task.cleanup_func, task.cleanup_arg);
+			task.func_to_dispatch(task.func_arg);
 			pthread_cleanup_pop(1);
 		} else {
-			myjob(myarg);
+			task.func_to_dispatch(task.func_arg);
 		}
 
-		TP_DEBUG(pool, " >>> Thread[%d] JOB DONE!\n", myid);
-		if (barrier) {
+		TP_DEBUG(pool, " >>> Thread[%d] JOB DONE!\n", worker->id);
+		if (task.barrier) {
 			/* Job done! */
-			th_pool_barrier_signal(barrier);
-		}
-
-		/* Grab mutex so we can grab posted job, or (if no job is posted)
-		   begin waiting for next posting. */
-		if (0 != pthread_mutex_lock(&pool->mutex)) {
-			return NULL;
+			th_pool_barrier_signal(task.barrier);
 		}
 	}
 
-	/* If we get here, we broke from loop because state is ALL_EXIT */
+	/* If we get here, the pool is being destroyed */
+	pthread_mutex_lock(&pool->mutex);
 	--pool->live;
 
-	TP_DEBUG(pool, " <<< Thread[%d] exiting (signalling 'job_taken').\n", myid);
+	TP_DEBUG(pool, " <<< Thread[%d] exiting (signalling 'job_taken').\n", worker->id);
 
-	/* We're not really taking a job ... but this signals the destroyer
-	   that one thread has exited, so it can keep on destroying. */
+	/* this signals the destroyer that one thread has exited, so it can keep on destroying. */
 	pthread_cond_signal(&pool->job_taken);
-
-	pthread_cleanup_pop(0);
 	pthread_mutex_unlock(&pool->mutex);
 	return NULL;
 }  
@@ -311,7 +319,7 @@ thread_pool_t *th_pool_create(int num_threads_in_pool) /* {{{ */
 		return NULL;
 	}
 
-	pool = (thread_pool_t *) malloc(sizeof(thread_pool_t));
+	pool = (thread_pool_t *) calloc(1, sizeof(thread_pool_t));
 	if (pool == NULL) {
 		return NULL;
 	}
@@ -320,24 +328,37 @@ thread_pool_t *th_pool_create(int num_threads_in_pool) /* {{{ */
 	pthread_cond_init(&(pool->job_posted), NULL);
 	pthread_cond_init(&(pool->job_taken), NULL);
 	pool->size = num_threads_in_pool;
-	pool->job_queue = queue_create(num_threads_in_pool);
 #if THREAD_POOL_DEBUG
 	gettimeofday(&pool->created, NULL);
 #endif
 
 	pool->threads = (pthread_t *) malloc(pool->size * sizeof(pthread_t));
-	if (NULL == pool->threads) {
+	pool->workers = (th_pool_worker_t *) calloc(pool->size, sizeof(th_pool_worker_t));
+	if (NULL == pool->threads || NULL == pool->workers) {
+		free(pool->threads);
+		free(pool->workers);
 		free(pool);
 		return NULL;
 	}
 
-	pool->live = 0;
 	for (i = 0; i < pool->size; i++) {
-		if (0 != pthread_create(pool->threads + i, NULL, th_do_work, (void *) pool)) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].id = i;
+		if (deque_init(&pool->workers[i].deque) != 0) {
+			/* threads are not running yet, the deques are leaked on this path. once per process start. */
 			free(pool->threads);
+			free(pool->workers);
 			free(pool);
 			return NULL;
 		}
+	}
+
+	pool->live = 0;
+	for (i = 0; i < pool->size; i++) {
+		if (0 != pthread_create(pool->threads + i, NULL, th_do_work, (void *) (pool->workers + i))) {
+			/* the threads we've started are still using the pool, don't free it */
+			return NULL;
+		}
 		pool->live++;
 		pthread_detach(pool->threads[i]);
 	}
@@ -351,30 +372,81 @@ thread_pool_t *th_pool_create(int num_threads_in_pool) /* {{{ */
 void th_pool_dispatch_with_cleanup(thread_pool_t *from_me, thread_pool_barrier_t *barrier, dispatch_fn_t dispatch_to_here, void *arg, dispatch_fn_t cleaner_func, void * cleaner_arg) /* {{{ */
 {
 	thread_pool_t *pool = (thread_pool_t *) from_me;
-	
-	pthread_cleanup_push(th_pool_mutex_unlock_wrapper, (void *) &pool->mutex);
-	TP_DEBUG(pool, " >>> Dispatcher: grabbing mutex.\n");
+	th_pool_task_t task;
+	size_t id;
 
-	if (0 != pthread_mutex_lock(&pool->mutex)) {
-		TP_DEBUG(pool, " >>> Dispatcher: failed to lock mutex!\n");
+	task.func_to_dispatch = dispatch_to_here;
+	task.func_arg = arg;
+	task.cleanup_func = cleaner_func;
+	task.cleanup_arg = cleaner_arg;
+	task.barrier = barrier;
+	task.range = NULL;
+	task.start = task.end = 0;
+
+	if (barrier) {
+		pthread_mutex_lock(&barrier->mutex);
+		barrier->posted_count++;
+		pthread_mutex_unlock(&barrier->mutex);
+	}
+
+	id = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED) % pool->size;
+
+	TP_DEBUG(pool, " <<< Dispatcher: posting job to deque[%d]\n", id);
+	th_pool_post(pool, id, &task);
+}
+/* }}} */
+
+void th_pool_parallel_for(thread_pool_t *pool, size_t start, size_t end, size_t grain, range_fn_t func, void *arg) /* {{{ */
+{
+	th_pool_range_t range;
+	th_pool_task_t task;
+	size_t i, parts, part_size;
+
+	if (end <= start) {
 		return;
 	}
 
-	while(!queue_can_accept_order(pool->job_queue)) {
-		TP_DEBUG(pool, " <<< Dispatcher: job queue full, %s\n", "signaling 'posted', waiting on 'taken'.");
-		pthread_cond_signal(&pool->job_posted);
-		pthread_cond_wait(&pool->job_taken, &pool->mutex);
+	if (grain == 0) {
+		grain = 1;
 	}
 
-	/* Finally, there's room to post a job. Do so and signal workers */
-	TP_DEBUG(pool, " <<< Dispatcher: posting job, signaling 'posted', yielding mutex\n");
-	queue_post_job(pool->job_queue, barrier, dispatch_to_here, arg, cleaner_func, cleaner_arg);
+	range.func = func;
+	range.arg = arg;
+	range.grain = grain;
+	range.remaining = end - start;
+	range.finished = 0;
+	pthread_mutex_init(&range.mutex, NULL);
+	pthread_cond_init(&range.done, NULL);
+
+	/* one contiguous part per thread to begin with, the rest is balanced by stealing */
+	parts = (end - start + grain - 1) / grain;
+	if (parts > pool->size) {
+		parts = pool->size;
+	}
+	part_size = (end - start) / parts;
 
-	pthread_cond_signal(&pool->job_posted);
+	memset(&task, 0, sizeof(task));
+	task.range = &range;
 
-	pthread_cleanup_pop(0);
-	/* unlock mutex so a worker can pick up the job */
-	pthread_mutex_unlock(&pool->mutex);
+	for (i = 0; i < parts; i++) {
+		task.start = start + i * part_size;
+		task.end = (i == parts - 1) ? end : task.start + part_size;
+
+		/* the part can't be run right here as worker i: worker i may be running another
+		   part with the same id, so wait for its deque to drain and try again */
+		while (th_pool_push(pool, i, &task) != 0) {
+			usleep(1000);
+		}
+	}
+
+	pthread_mutex_lock(&range.mutex);
+	while (!range.finished) {
+		pthread_cond_wait(&range.done, &range.mutex);
+	}
+	pthread_mutex_unlock(&range.mutex);
+
+	pthread_mutex_destroy(&range.mutex);
+	pthread_cond_destroy(&range.done);
 }
 /* }}} */
 
@@ -382,24 +454,25 @@ void th_pool_destroy(thread_pool_t *destroyme) /* {{{ */
 {
 	thread_pool_t *pool = (thread_pool_t *) destroyme;
 	int oldtype;
+	size_t i;
 
 	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, &oldtype);
 	pthread_cleanup_push(th_pool_mutex_unlock_wrapper, (void *) &pool->mutex); 
 
 	/* Cause all threads to exit. Because they were detached when created,
 	   the underlying memory for each is automatically reclaimed. */
-	TP_DEBUG(pool, " >>> Destroyer: grabbing mutex, posting exit job. Live = %d\n", pool->live);
+	TP_DEBUG(pool, " >>> Destroyer: grabbing mutex, setting exit flag. Live = %d\n", pool->live);
 
 	if (0 != pthread_mutex_lock(&pool->mutex)) {
 		return;
 	}
 
+	pool->exiting = 1;
+	pthread_cond_broadcast(&pool->job_posted);
+
 	while (pool->live > 0) {
-		TP_DEBUG(pool, " <<< Destroyer: signalling 'job_posted', waiting on 'job_taken'.\n");
-		queue_post_job(pool->job_queue, NULL, (dispatch_fn_t) -1, NULL, NULL, NULL);
-		/* get workers to check in ... */
-		pthread_cond_signal(&pool->job_posted);
-		/* ... and wake up when they check out */
+		TP_DEBUG(pool, " <<< Destroyer: waiting on 'job_taken'.\n");
+		/* wake up when they check out */
 		pthread_cond_wait(&pool->job_taken, &pool->mutex);
 		TP_DEBUG(pool, " >>> Destroyer: received 'job_taken'. Live = %d\n", pool->live);
 	}
@@ -430,7 +503,10 @@ void th_pool_destroy(thread_pool_t *destroyme) /* {{{ */
 		return;
 	}
 
-	queue_destroy(pool->job_queue);
+	for (i = 0; i < pool->size; i++) {
+		deque_destroy(&pool->workers[i].deque);
+	}
+	free(pool->workers);
 	memset(pool, 0, sizeof(thread_pool_t));
 
 	free(pool);
@@ -37,69 +37,77 @@ typedef struct _thread_pool_barrier_t {
 
 typedef void (*dispatch_fn_t)(void *);
 
-typedef struct _queue_node_t queue_node_t;
+// "range_fn_t" is called by th_pool_parallel_for() for a part [start, end) of the range,
+// worker is the number of the thread running it (0 .. pool size - 1), so that the
+// function may use per-thread data without locking.
+typedef void (*range_fn_t)(void *arg, size_t start, size_t end, size_t worker);
 
-struct _queue_node_t
+typedef struct _th_pool_range_t th_pool_range_t;
+
+typedef struct _th_pool_task_t
 {
   dispatch_fn_t func_to_dispatch;
   void *func_arg;
   dispatch_fn_t cleanup_func;
   void *cleanup_arg;
   thread_pool_barrier_t *barrier;
-  queue_node_t *next;
-  queue_node_t *prev;
-};
+  th_pool_range_t *range; // set for th_pool_parallel_for() tasks, func_to_dispatch is not used then
+  size_t start;
+  size_t end;
+} th_pool_task_t;
+
+// a growing circular array of tasks,
+// the owner pushes and pops at the tail, the other workers steal from the head
+typedef struct _th_pool_deque_t
+{
+	pthread_mutex_t mutex;
+	th_pool_task_t *tasks;
+	size_t head;
+	size_t tail;
+	size_t capacity; // always a power of 2
+} th_pool_deque_t;
 
-typedef struct _queue_head_t
+typedef struct _th_pool_worker_t
 {
-	queue_node_t *head;
-	queue_node_t *tail;
-	queue_node_t *freeHead;
-	queue_node_t *freeTail;
-	int capacity;
-	int max_capacity;
-	int posted;
-} queue_head_t;
+	struct _thread_pool_t *pool;
+	size_t id;
+	th_pool_deque_t deque;
+} th_pool_worker_t;
 
 
 /*----------------------------------------------------------------------
   thread_pool_t is the internal threadpool structure that is cast to type 
   "threadpool" before it given out to callers.
-  All accesses to a thread_pool_t (both read and write) must be protected 
-  by that pool's mutex.  
-  Worker threads wait on a "job_posted" signal; when one is received the 
-  receiving thread (which has the mutex):
- * checks the pool state. If it is ALL_EXIT the thread decrements 
- the pool's 'live' count, yields the mutex and exits; otherwise 
-continues:
- * while the job queue is not empty:
- * copy the job and arg fields into the thread, 
- * NULL out the pool's job and arg fields
- * signal "job_taken" 
- * yield the mutex and run the job on the arg.
- * grab the mutex
- * when a null job field is found, wait on "job_posted"
- The dispatcher thread dispatches a job as follows:
- * grab the pool's mutex
- * while the job field is not NULL: 
- * signal "job_posted"
- * wait on "job_taken"
- * copy job and args to pool, signal "job_posted", yield the mutex
+  Every worker thread owns a deque of tasks.
+  The dispatcher puts the jobs to the deques round-robin, increments 
+  'pending' and signals "job_posted".
+  A worker thread:
+ * takes the newest task from its own deque, if it's empty
+ * steals the oldest task from the other deques, if they're all empty
+ * grabs the pool's mutex and waits on "job_posted" while 'pending' is 0.
+ * runs the task and signals the task's barrier, if any.
+ parallel_for tasks are split in halves until they're not larger than the grain,
+ the upper halves are pushed to the worker's own deque, so that the idle workers 
+ steal the largest parts of the range first.
+ When the pool is destroyed, 'exiting' is set and "job_posted" is broadcasted,
+ every exiting thread decrements 'live' and signals "job_taken".
  */
 typedef struct _thread_pool_t {
 #if THREAD_POOL_DEBUG
 	struct timeval  created;    // When the threadpool was created.
 #endif
 	pthread_t      *threads;       // The threads themselves.
+	th_pool_worker_t *workers;     // One per thread, with its deque.
+	size_t          pending;       // Number of tasks in all deques, atomic.
+	size_t          next;          // Next deque to dispatch to, atomic.
 	pthread_mutex_t mutex;      // protects all vars declared below.
 	size_t             size;       // Number of threads in the pool
 	size_t             live;       // Number of live threads in pool (when
 	//   pool is being destroyed, live<=arrsz)
+	int             exiting;
 
 	pthread_cond_t  job_posted; // dispatcher: "Hey guys, there's a job!"
-	pthread_cond_t  job_taken;  // a worker: "Got it!"
-
-	queue_head_t      *job_queue;      // queue of work orders
+	pthread_cond_t  job_taken;  // an exiting worker: "Bye!"
 } thread_pool_t;
 
 /**
@@ -110,10 +118,9 @@ typedef struct _thread_pool_t {
 thread_pool_t *th_pool_create(int num_threads_in_pool);
 
 /**
- * Sends a thread off to do some work.  If all threads in the pool are busy, dispatch will
- * block until a thread becomes free and is dispatched.
- * 
- * Once a thread is dispatched, this function returns immediately.
+ * Sends a thread off to do some work.  The job is put to one of the workers' deques
+ * (round-robin) and the function returns immediately, an idle worker will steal
+ * the job if its owner is busy.
  *
  * Also enables the user to define cleanup handlers in 
  * cases of immediate cancel.  The cleanup handler function (cleaner_func) is 
@@ -130,6 +137,15 @@ void th_pool_dispatch_with_cleanup(thread_pool_t *from_me, thread_pool_barrier_t
  */
 #define th_pool_dispatch(from, barrier, to, arg) th_pool_dispatch_with_cleanup((from), (barrier), (to), (arg), NULL, NULL)
 
+/**
+ * Calls func for all parts of [start, end) and returns when the whole range is done.
+ * The range is split between the threads in parts of at most grain items,
+ * the threads that are done with their parts steal the rest from the busy ones,
+ * so the caller doesn't have to balance the work by hand.
+ * Must not be called from a thread of the same pool.
+ */
+void th_pool_parallel_for(thread_pool_t *pool, size_t start, size_t end, size_t grain, range_fn_t func, void *arg);
+
 /**
  * Kills the threadpool, causing
  * all threads in it to commit suicide, and then
@@ -0,0 +1,313 @@
+/*
+   Standalone check of the compressed batch envelope decoder (src/pinba_envelope.h, src/lz4.c)
+   against valid, malformed and truncated input. Exits with 1 if any of the checks fails.
+   "envelope_test bench [iterations]" measures the decompression cost instead.
+
+   batch_block is the output of the reference LZ4 implementation (LZ4_compress_default())
+   for batch_request, a serialized Pinba.Request with three nested requests.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pinba_envelope.h"
+
+/* built in, so that the check doesn't depend on the objects of the engine library */
+#include "lz4.c"
+
+static const unsigned char batch_request[] = {
+	0x0a, 0x06, 0x72, 0x65, 0x6c, 0x61, 0x79, 0x31, 0x12, 0x0b, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c,
+	0x65, 0x2e, 0x63, 0x6f, 0x6d, 0x1a, 0x06, 0x2f, 0x62, 0x61, 0x74, 0x63, 0x68, 0x20, 0x03, 0x28,
+	0x00, 0x30, 0x00, 0x3d, 0x00, 0x00, 0x00, 0x00, 0x45, 0x00, 0x00, 0x00, 0x00, 0x4d, 0x00, 0x00,
+	0x00, 0x00, 0x92, 0x38, 0x0a, 0x04, 0x77, 0x65, 0x62, 0x31, 0x12, 0x0b, 0x65, 0x78, 0x61, 0x6d,
+	0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f, 0x6d, 0x1a, 0x0a, 0x2f, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2e,
+	0x70, 0x68, 0x70, 0x20, 0x01, 0x28, 0x80, 0x08, 0x30, 0x80, 0x80, 0x80, 0x01, 0x3d, 0x00, 0x00,
+	0x80, 0x3e, 0x45, 0x0a, 0xd7, 0x23, 0x3c, 0x4d, 0x0a, 0xd7, 0xa3, 0x3b, 0x92, 0x38, 0x0a, 0x04,
+	0x77, 0x65, 0x62, 0x31, 0x12, 0x0b, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f,
+	0x6d, 0x1a, 0x0a, 0x2f, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2e, 0x70, 0x68, 0x70, 0x20, 0x01, 0x28,
+	0x80, 0x08, 0x30, 0x80, 0x80, 0x80, 0x01, 0x3d, 0x00, 0x00, 0x80, 0x3e, 0x45, 0x0a, 0xd7, 0x23,
+	0x3c, 0x4d, 0x0a, 0xd7, 0xa3, 0x3b, 0x92, 0x38, 0x0a, 0x04, 0x77, 0x65, 0x62, 0x31, 0x12, 0x0b,
+	0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f, 0x6d, 0x1a, 0x0a, 0x2f, 0x69, 0x6e,
+	0x64, 0x65, 0x78, 0x2e, 0x70, 0x68, 0x70, 0x20, 0x01, 0x28, 0x80, 0x08, 0x30, 0x80, 0x80, 0x80,
+	0x01, 0x3d, 0x00, 0x00, 0x80, 0x3e, 0x45, 0x0a, 0xd7, 0x23, 0x3c, 0x4d, 0x0a, 0xd7, 0xa3, 0x3b,
+};
+
+static const unsigned char batch_block[] = {
+	0xfb, 0x2a, 0x0a, 0x06, 0x72, 0x65, 0x6c, 0x61, 0x79, 0x31, 0x12, 0x0b, 0x65, 0x78, 0x61, 0x6d,
+	0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f, 0x6d, 0x1a, 0x06, 0x2f, 0x62, 0x61, 0x74, 0x63, 0x68, 0x20,
+	0x03, 0x28, 0x00, 0x30, 0x00, 0x3d, 0x00, 0x00, 0x00, 0x00, 0x45, 0x00, 0x00, 0x00, 0x00, 0x4d,
+	0x00, 0x00, 0x00, 0x00, 0x92, 0x38, 0x0a, 0x04, 0x77, 0x65, 0x62, 0x32, 0x00, 0xff, 0x15, 0x0a,
+	0x2f, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2e, 0x70, 0x68, 0x70, 0x20, 0x01, 0x28, 0x80, 0x08, 0x30,
+	0x80, 0x80, 0x80, 0x01, 0x3d, 0x00, 0x00, 0x80, 0x3e, 0x45, 0x0a, 0xd7, 0x23, 0x3c, 0x4d, 0x0a,
+	0xd7, 0xa3, 0x3b, 0x3a, 0x00, 0x5c, 0x50, 0x4d, 0x0a, 0xd7, 0xa3, 0x3b,
+};
+
+static int failures = 0;
+
+#define CHECK(cond, what) do {							\
+	if (!(cond)) {										\
+		fprintf(stderr, "FAIL: %s (line %d)\n", what, __LINE__);	\
+		failures++;										\
+	}													\
+} while (0)
+
+/* header + block, the size is written as given */
+static unsigned char *envelope_build(const unsigned char *block, size_t block_len, unsigned int size, size_t *len) /* {{{ */
+{
+	unsigned char *buf;
+
+	buf = (unsigned char *)malloc(PINBA_ENVELOPE_HEADER_SIZE + block_len);
+	if (!buf) {
+		abort();
+	}
+
+	memcpy(buf, PINBA_ENVELOPE_MAGIC, PINBA_ENVELOPE_MAGIC_SIZE);
+	buf[4] = size >> 24;
+	buf[5] = size >> 16;
+	buf[6] = size >> 8;
+	buf[7] = size;
+	memcpy(buf + PINBA_ENVELOPE_HEADER_SIZE, block, block_len);
+
+	*len = PINBA_ENVELOPE_HEADER_SIZE + block_len;
+	return buf;
+}
+/* }}} */
+
+/* does everything pinba_envelope_unpack() does, dst is exactly as large as declared */
+static int envelope_unpack(const unsigned char *buf, size_t len, char **out, unsigned int *out_len) /* {{{ */
+{
+	unsigned int size;
+	char *dst;
+
+	if (!pinba_envelope_check(buf, len)) {
+		return -1;
+	}
+
+	size = pinba_envelope_size(buf, len);
+	if (size == 0) {
+		return -1;
+	}
+
+	dst = (char *)malloc(size);
+	if (!dst) {
+		abort();
+	}
+
+	if (pinba_envelope_decompress(buf, len, dst, size) < 0) {
+		free(dst);
+		return -1;
+	}
+
+	*out = dst;
+	*out_len = size;
+	return 0;
+}
+/* }}} */
+
+static int envelope_unpack_fails(const unsigned char *block, size_t block_len, unsigned int size) /* {{{ */
+{
+	unsigned char *buf;
+	char *out = NULL;
+	unsigned int out_len;
+	size_t len;
+	int ret;
+
+	buf = envelope_build(block, block_len, size, &len);
+	ret = envelope_unpack(buf, len, &out, &out_len);
+	free(out);
+	free(buf);
+	return ret < 0;
+}
+/* }}} */
+
+static void test_valid(void) /* {{{ */
+{
+	unsigned char *buf;
+	char *out = NULL;
+	unsigned int out_len = 0;
+	size_t len;
+
+	buf = envelope_build(batch_block, sizeof(batch_block), sizeof(batch_request), &len);
+	CHECK(envelope_unpack(buf, len, &out, &out_len) == 0, "valid envelope is decoded");
+	CHECK(out_len == sizeof(batch_request) && out && memcmp(out, batch_request, out_len) == 0, "valid envelope gives the original request");
+	free(out);
+	free(buf);
+}
+/* }}} */
+
+static void test_plain_request(void) /* {{{ */
+{
+	/* a plain Pinba.Request goes to the protobuf decoder as it is */
+	CHECK(!pinba_envelope_check(batch_request, sizeof(batch_request)), "plain request is not an envelope");
+}
+/* }}} */
+
+static void test_bad_header(void) /* {{{ */
+{
+	unsigned char *buf;
+	size_t len;
+
+	buf = envelope_build(batch_block, sizeof(batch_block), sizeof(batch_request), &len);
+
+	buf[3] = '5';
+	CHECK(!pinba_envelope_check(buf, len), "bad magic is not an envelope");
+	buf[3] = '4';
+
+	buf[0] = 'P';
+	CHECK(!pinba_envelope_check(buf, len), "magic without the zero byte is not an envelope");
+	buf[0] = '\0';
+
+	CHECK(!pinba_envelope_check(buf, PINBA_ENVELOPE_HEADER_SIZE), "header without a block is not an envelope");
+	CHECK(!pinba_envelope_check(buf, PINBA_ENVELOPE_MAGIC_SIZE), "magic alone is not an envelope");
+	CHECK(pinba_envelope_check(buf, len), "restored header is an envelope");
+	free(buf);
+
+	CHECK(envelope_unpack_fails(batch_block, sizeof(batch_block), 0), "zero size is rejected");
+	CHECK(envelope_unpack_fails(batch_block, sizeof(batch_block), PINBA_ENVELOPE_MAX_SIZE + 1), "size over PINBA_ENVELOPE_MAX_SIZE is rejected");
+	CHECK(envelope_unpack_fails(batch_block, sizeof(batch_block), 0xffffffff), "size of 4GB is rejected");
+}
+/* }}} */
+
+static void test_size_mismatch(void) /* {{{ */
+{
+	/* the block decodes into more data than declared */
+	CHECK(envelope_unpack_fails(batch_block, sizeof(batch_block), sizeof(batch_request) - 1), "overlong block is rejected");
+	CHECK(envelope_unpack_fails(batch_block, sizeof(batch_block), 1), "block much longer than declared is rejected");
+	/* and into less */
+	CHECK(envelope_unpack_fails(batch_block, sizeof(batch_block), sizeof(batch_request) + 1), "short block is rejected");
+}
+/* }}} */
+
+static void test_truncated(void) /* {{{ */
+{
+	size_t cut;
+
+	/* cut in the literals, in the offsets and in the length bytes */
+	for (cut = 1; cut < sizeof(batch_block); cut++) {
+		if (!envelope_unpack_fails(batch_block, cut, sizeof(batch_request))) {
+			fprintf(stderr, "FAIL: block truncated to %zu bytes is accepted\n", cut);
+			failures++;
+		}
+	}
+}
+/* }}} */
+
+static void test_trailing_garbage(void) /* {{{ */
+{
+	unsigned char block[sizeof(batch_block) + 4];
+
+	memcpy(block, batch_block, sizeof(batch_block));
+	memset(block + sizeof(batch_block), 0x11, 4);
+	CHECK(envelope_unpack_fails(block, sizeof(block), sizeof(batch_request)), "block with trailing bytes is rejected");
+}
+/* }}} */
+
+static void test_malformed(void) /* {{{ */
+{
+	/* 4 literals, then a match with offset 0 */
+	static const unsigned char zero_offset[] = { 0x40, 'a', 'b', 'c', 'd', 0x00, 0x00, 0x10, 'e' };
+	/* 4 literals, then a match reaching before the start of the output */
+	static const unsigned char far_offset[] = { 0x40, 'a', 'b', 'c', 'd', 0x05, 0x00, 0x10, 'e' };
+	/* literal length continuation byte is missing */
+	static const unsigned char no_length[] = { 0xf0 };
+	/* 15 + 255 literals announced, only 3 present */
+	static const unsigned char short_literals[] = { 0xf0, 0xff, 0x00, 'a', 'b', 'c' };
+	/* a block must end with literals, not with a match */
+	static const unsigned char match_last[] = { 0x40, 'a', 'b', 'c', 'd', 0x04, 0x00 };
+	/* overlapping match: "ab" and then 6 more bytes of the same pattern */
+	static const unsigned char overlap[] = { 0x22, 'a', 'b', 0x02, 0x00, 0x00 };
+	unsigned char *buf;
+	char *out = NULL;
+	unsigned int out_len = 0;
+	size_t len;
+
+	CHECK(envelope_unpack_fails(zero_offset, sizeof(zero_offset), 9), "zero match offset is rejected");
+	CHECK(envelope_unpack_fails(far_offset, sizeof(far_offset), 9), "match offset before the output is rejected");
+	CHECK(envelope_unpack_fails(no_length, sizeof(no_length), 15), "missing length byte is rejected");
+	CHECK(envelope_unpack_fails(short_literals, sizeof(short_literals), 270), "short literals are rejected");
+	CHECK(envelope_unpack_fails(match_last, sizeof(match_last), 8), "block ending with a match is rejected");
+
+	buf = envelope_build(overlap, sizeof(overlap), 8, &len);
+	CHECK(envelope_unpack(buf, len, &out, &out_len) == 0 && out_len == 8 && memcmp(out, "abababab", 8) == 0, "overlapping match repeats the pattern");
+	free(out);
+	free(buf);
+}
+/* }}} */
+
+static void test_random(void) /* {{{ */
+{
+	unsigned char block[64];
+	unsigned int seed = 12345, i, j;
+
+	/* random blocks must be rejected or decoded without touching anything past the buffers,
+	   which is what the sanitizers and valgrind look at */
+	for (i = 0; i < 100000; i++) {
+		size_t block_len = 1 + (i % sizeof(block));
+
+		for (j = 0; j < block_len; j++) {
+			seed = seed * 1103515245 + 12345;
+			block[j] = seed >> 16;
+		}
+		envelope_unpack_fails(block, block_len, 1 + (seed >> 8) % 512);
+	}
+}
+/* }}} */
+
+/* the decoding stage cost of an envelope, without the protobuf decoding that follows it */
+static void bench(unsigned long iterations) /* {{{ */
+{
+	unsigned char *buf;
+	char *dst;
+	size_t len;
+	unsigned long i;
+	struct timespec start, end;
+	double ns;
+
+	buf = envelope_build(batch_block, sizeof(batch_block), sizeof(batch_request), &len);
+	dst = (char *)malloc(sizeof(batch_request));
+	if (!dst) {
+		abort();
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++) {
+		if (!pinba_envelope_check(buf, len) || pinba_envelope_decompress(buf, len, dst, pinba_envelope_size(buf, len)) < 0) {
+			abort();
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+	printf("%zu bytes on the wire -> %zu bytes, 3 requests: %.1f ns per envelope, %.1f ns per request, %.0f MB/s of output\n",
+			len, sizeof(batch_request), ns / iterations, ns / iterations / 3, sizeof(batch_request) * iterations / ns * 1e3);
+
+	free(dst);
+	free(buf);
+}
+/* }}} */
+
+int main(int argc, char **argv) /* {{{ */
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		bench(argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000);
+		return 0;
+	}
+
+	test_valid();
+	test_plain_request();
+	test_bad_header();
+	test_size_mismatch();
+	test_truncated();
+	test_trailing_garbage();
+	test_malformed();
+	test_random();
+
+	if (failures) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all envelope checks passed\n");
+	return 0;
+}
+/* }}} */
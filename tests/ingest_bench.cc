@@ -0,0 +1,654 @@
+/*
+   Load generator and benchmark of the collector: starts the engine without MySQL
+   (everything but ha_pinba.cc), creates base reports the same way pinba_regenerate_report.h
+   does, sends generated requests to the UDP port over the loopback and waits until they
+   reach the request pool.
+
+   usage: ingest_bench [-n packets] [-r pps] [-R reports] [-t timers] [-s setting=value ...]
+          ingest_bench [-t timers] decode [iterations]
+          ingest_bench scan [records]
+
+   -r 0 sends as fast as possible, the settings are the fields of pinba_daemon_settings
+   (stats_history, reuseport, udp_gro, busy_poll, coalesce_requests, harvest_fill_threshold, numa).
+   With a stats_history shorter than the run the records expire during the run, so the
+   reports are updated by the delete pass as well.
+
+   Prints the packets received and lost, the throughput and the CPU time of the engine threads
+   per packet (the sender thread excluded) and of the collector threads alone, the time
+   spent updating the reports and the average receive delay: the time from the kernel
+   timestamp of a packet to the return of the recvmmsg() call that picked it up.
+   "decode" compares pinba__request__unpack() into malloc()ed memory with the decoding arena
+   the collector uses, on the same requests.
+   "scan" runs the arithmetic of the info and the by-script report add and delete passes
+   over a pool of pinba_stats_record and over the same records kept as one array per field
+   the passes read, 10M records by default.
+*/
+
+#include "pinba.h"
+#include "pinba_map.h"
+
+#include <getopt.h>
+
+pinba_daemon *D;
+
+#define BENCH_VARIANTS 1024 /* distinct requests sent round-robin */
+#define BENCH_BATCH 32 /* packets per sendmmsg() */
+#define BENCH_SOURCES 16 /* sender sockets used round-robin, as if the requests came from several hosts */
+
+static struct {
+	size_t packets;
+	size_t pps;
+	size_t reports;
+	size_t timers;
+} bench = {1000000, 100000, 16, 4};
+
+struct bench_packet {
+	uint8_t *data;
+	size_t len;
+};
+
+static struct bench_packet packets[BENCH_VARIANTS];
+static struct rusage sender_rusage;
+static struct timeval send_start, send_end;
+
+static double tv_usec(struct timeval *tv) /* {{{ */
+{
+	return tv->tv_sec * 1e6 + tv->tv_usec;
+}
+/* }}} */
+
+static void bench_packets_init(void) /* {{{ */
+{
+	Pinba__Request request = PINBA__REQUEST__INIT;
+	char dictionary[PINBA_DICTIONARY_ENTRY_SIZE * 9];
+	uint32_t hit_count[64], tag_count[64], tag_name[64], tag_value[64];
+	float value[64];
+	size_t i, j;
+
+	memset(dictionary, 0, sizeof(dictionary));
+	strcpy(dictionary, "group");
+	for (j = 1; j < 9; j++) {
+		sprintf(dictionary + PINBA_DICTIONARY_ENTRY_SIZE * j, "value%d", (int)j);
+	}
+
+	for (i = 0; i < BENCH_VARIANTS; i++) {
+		/* 16 hosts, 4 virtual hosts and 256 scripts */
+		snprintf(request.hostname, sizeof(request.hostname), "web%d", (int)(i % 16));
+		snprintf(request.server_name, sizeof(request.server_name), "www%d.example.com", (int)(i % 4));
+		snprintf(request.script_name, sizeof(request.script_name), "/script%d.php", (int)(i % 256));
+		request.request_count = 1;
+		request.document_size = 1000 + i;
+		request.memory_peak = 2000000 + i;
+		request.request_time = 0.001f * (i % 100);
+		request.ru_utime = 0.0005f * (i % 10);
+		request.ru_stime = 0.0001f * (i % 10);
+		request.has_status = 1;
+		request.status = (i % 8) ? 200 : 404;
+
+		for (j = 0; j < bench.timers; j++) {
+			hit_count[j] = 1;
+			value[j] = 0.0001f * (j + 1);
+			tag_count[j] = 1;
+			tag_name[j] = 0;
+			tag_value[j] = 1 + (i + j) % 8;
+		}
+		request.n_timer_hit_count = request.n_timer_value = request.n_timer_tag_count = bench.timers;
+		request.timer_hit_count = hit_count;
+		request.timer_value = value;
+		request.timer_tag_count = tag_count;
+		request.n_timer_tag_name = request.n_timer_tag_value = bench.timers;
+		request.timer_tag_name = tag_name;
+		request.timer_tag_value = tag_value;
+		request.n_dictionary = bench.timers ? 9 : 0;
+		request.dictionary = dictionary;
+
+		packets[i].data = (uint8_t *)malloc(pinba__request__get_packed_size(&request));
+		packets[i].len = pinba__request__pack(&request, packets[i].data);
+	}
+}
+/* }}} */
+
+static size_t bench_packets_size(void) /* {{{ */
+{
+	size_t i, size = 0;
+
+	for (i = 0; i < BENCH_VARIANTS; i++) {
+		size += packets[i].len;
+	}
+	return size;
+}
+/* }}} */
+
+static void bench_reports_init(void) /* {{{ */
+{
+	static pinba_report_update_function *add_funcs[] = {
+		pinba_update_report1_add, pinba_update_report2_add, pinba_update_report3_add, pinba_update_report4_add,
+		pinba_update_report5_add, pinba_update_report6_add, pinba_update_report7_add, pinba_update_report9_add
+	};
+	static pinba_report_update_function *delete_funcs[] = {
+		pinba_update_report1_delete, pinba_update_report2_delete, pinba_update_report3_delete, pinba_update_report4_delete,
+		pinba_update_report5_delete, pinba_update_report6_delete, pinba_update_report7_delete, pinba_update_report9_delete
+	};
+	static pinba_report_type types[] = {
+		PINBA_TABLE_REPORT1, PINBA_TABLE_REPORT2, PINBA_TABLE_REPORT3, PINBA_TABLE_REPORT4,
+		PINBA_TABLE_REPORT5, PINBA_TABLE_REPORT6, PINBA_TABLE_REPORT7, PINBA_TABLE_REPORT9
+	};
+	pinba_report *report;
+	char index[64];
+	size_t i;
+
+	pthread_rwlock_wrlock(&D->base_reports_lock);
+	for (i = 0; i < bench.reports; i++) {
+		report = (pinba_report *)calloc(1, sizeof(pinba_report));
+
+		snprintf(index, sizeof(index), "bench_report_%d", (int)i);
+		report->std.index = strdup(index);
+		report->std.type = types[i % 8];
+		report->std.time_interval = 1;
+		report->std.histogram_max_time = 10;
+		report->std.histogram_segment = 10.0f / (float)D->settings.histogram_size;
+		report->std.add_func = add_funcs[i % 8];
+		report->std.delete_func = delete_funcs[i % 8];
+		pthread_rwlock_init(&report->std.lock, 0);
+
+		D->base_reports = pinba_map_add(D->base_reports, index, report);
+		pinba_array_add(&D->base_reports_arr, report);
+	}
+	pthread_rwlock_unlock(&D->base_reports_lock);
+}
+/* }}} */
+
+static void *bench_sender_main(void *arg) /* {{{ */
+{
+	struct sockaddr_in addr;
+	struct mmsghdr msgs[BENCH_BATCH];
+	struct iovec iovs[BENCH_BATCH];
+	struct timespec next;
+	size_t sent, i, cnt;
+	int socks[BENCH_SOURCES];
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(D->settings.port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	/* SO_REUSEPORT spreads the packets between the sockets by the source address and port */
+	for (i = 0; i < BENCH_SOURCES; i++) {
+		socks[i] = socket(AF_INET, SOCK_DGRAM, 0);
+		connect(socks[i], (struct sockaddr *)&addr, sizeof(addr));
+	}
+
+	memset(msgs, 0, sizeof(msgs));
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	gettimeofday(&send_start, 0);
+
+	for (sent = 0; sent < bench.packets; sent += cnt) {
+		cnt = bench.packets - sent;
+		if (cnt > BENCH_BATCH) {
+			cnt = BENCH_BATCH;
+		}
+
+		for (i = 0; i < cnt; i++) {
+			iovs[i].iov_base = packets[(sent + i) % BENCH_VARIANTS].data;
+			iovs[i].iov_len = packets[(sent + i) % BENCH_VARIANTS].len;
+			msgs[i].msg_hdr.msg_iov = iovs + i;
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		/* the packets dropped by the kernel are counted as lost */
+		sendmmsg(socks[(sent / BENCH_BATCH) % BENCH_SOURCES], msgs, cnt, 0);
+
+		if (bench.pps) {
+			next.tv_nsec += (long)(1e9 * cnt / bench.pps);
+			while (next.tv_nsec >= 1000000000) {
+				next.tv_nsec -= 1000000000;
+				next.tv_sec++;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		}
+	}
+
+	gettimeofday(&send_end, 0);
+	getrusage(RUSAGE_THREAD, &sender_rusage);
+	for (i = 0; i < BENCH_SOURCES; i++) {
+		close(socks[i]);
+	}
+	return NULL;
+}
+/* }}} */
+
+static double bench_decode_run(pinba_arena *arena, unsigned long iterations) /* {{{ */
+{
+	Pinba__Request *request;
+	struct timespec start, end;
+	unsigned long i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++) {
+		request = pinba__request__unpack(arena ? &arena->allocator : NULL, packets[i % BENCH_VARIANTS].len, packets[i % BENCH_VARIANTS].data);
+		if (!request) {
+			abort();
+		}
+
+		if (!arena) {
+			pinba__request__free_unpacked(request, NULL);
+		} else if (i % BENCH_VARIANTS == BENCH_VARIANTS - 1) {
+			/* once per harvester cycle in the collector */
+			pinba_arena_reset(arena);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / iterations;
+}
+/* }}} */
+
+static void bench_decode(unsigned long iterations) /* {{{ */
+{
+	pinba_arena arena;
+	double malloc_ns, arena_ns;
+
+	if (pinba_arena_init(&arena, PINBA_ARENA_CHUNK_SIZE) != P_SUCCESS) {
+		abort();
+	}
+
+	bench_packets_init();
+
+	/* warm up both, then measure */
+	bench_decode_run(NULL, BENCH_VARIANTS);
+	bench_decode_run(&arena, BENCH_VARIANTS);
+	malloc_ns = bench_decode_run(NULL, iterations);
+	arena_ns = bench_decode_run(&arena, iterations);
+
+	printf("%zu timers per request, %zu bytes on average: malloc %.1f ns per request, arena %.1f ns per request\n",
+			bench.timers, bench_packets_size() / BENCH_VARIANTS, malloc_ns, arena_ns);
+
+	pinba_arena_destroy(&arena);
+}
+/* }}} */
+
+#define BENCH_SCAN_SCRIPTS 1024
+#define BENCH_SCAN_HISTOGRAM 64
+
+/* the columns of the request pool the report passes read */
+struct bench_columns {
+	pinba_word **script_name;
+	struct timeval *req_time;
+	struct timeval *ru_utime;
+	struct timeval *ru_stime;
+	float *doc_size;
+	float *memory_footprint;
+	unsigned int *weight;
+	struct timeval *time;
+	size_t *counter;
+};
+
+struct bench_scan_data {
+	size_t req_count;
+	struct timeval req_time_total;
+	struct timeval ru_utime_total;
+	struct timeval ru_stime_total;
+	double kbytes_total;
+	double memory_footprint;
+	int histogram[BENCH_SCAN_HISTOGRAM];
+};
+
+static inline void bench_scan_add(struct bench_scan_data *data, const struct timeval *req_time, const struct timeval *ru_utime, const struct timeval *ru_stime, float doc_size, float memory_footprint, unsigned int weight) /* {{{ */
+{
+	data->req_count += weight;
+	timeradd(&data->req_time_total, req_time, &data->req_time_total);
+	timeradd(&data->ru_utime_total, ru_utime, &data->ru_utime_total);
+	timeradd(&data->ru_stime_total, ru_stime, &data->ru_stime_total);
+	data->kbytes_total += doc_size;
+	data->memory_footprint += memory_footprint;
+	data->histogram[(req_time->tv_usec >> 14) & (BENCH_SCAN_HISTOGRAM - 1)] += weight;
+}
+/* }}} */
+
+static inline void bench_scan_delete(struct bench_scan_data *data, const struct timeval *req_time, const struct timeval *ru_utime, const struct timeval *ru_stime, float doc_size, float memory_footprint, unsigned int weight) /* {{{ */
+{
+	data->req_count -= weight;
+	timersub(&data->req_time_total, req_time, &data->req_time_total);
+	timersub(&data->ru_utime_total, ru_utime, &data->ru_utime_total);
+	timersub(&data->ru_stime_total, ru_stime, &data->ru_stime_total);
+	data->kbytes_total -= doc_size;
+	data->memory_footprint -= memory_footprint;
+	data->histogram[(req_time->tv_usec >> 14) & (BENCH_SCAN_HISTOGRAM - 1)] -= weight;
+}
+/* }}} */
+
+/* one pass over the records, as the reports see them: add, or delete with PINBA_REPORT_DELETE_CHECK()
+   for a report started at the record start_id; keyed passes look the data up by the script name,
+   like pinba_update_report1_add() */
+static double bench_scan_run(const pinba_stats_record *records, const struct bench_columns *columns, size_t records_cnt, size_t start_id, int keyed, int del, void *map, struct bench_scan_data *total) /* {{{ */
+{
+	struct bench_scan_data *data = total;
+	struct timespec start, end;
+	struct timeval report_start = records ? records[start_id].time : columns->time[start_id];
+	size_t i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (records) {
+		for (i = 0; i < records_cnt; i++) {
+			const pinba_stats_record *record = records + i;
+
+			if (del && (timercmp(&report_start, &record->time, >) || (timercmp(&report_start, &record->time, ==) && start_id > record->counter))) {
+				continue;
+			}
+			if (keyed) {
+				data = (struct bench_scan_data *)pinba_map_get(map, record->data.script_name->str);
+			}
+			if (del) {
+				bench_scan_delete(data, &record->data.req_time, &record->data.ru_utime, &record->data.ru_stime, record->data.doc_size, record->data.memory_footprint, record->data.weight);
+			} else {
+				bench_scan_add(data, &record->data.req_time, &record->data.ru_utime, &record->data.ru_stime, record->data.doc_size, record->data.memory_footprint, record->data.weight);
+			}
+		}
+	} else {
+		for (i = 0; i < records_cnt; i++) {
+			if (del && (timercmp(&report_start, &columns->time[i], >) || (timercmp(&report_start, &columns->time[i], ==) && start_id > columns->counter[i]))) {
+				continue;
+			}
+			if (keyed) {
+				data = (struct bench_scan_data *)pinba_map_get(map, columns->script_name[i]->str);
+			}
+			if (del) {
+				bench_scan_delete(data, &columns->req_time[i], &columns->ru_utime[i], &columns->ru_stime[i], columns->doc_size[i], columns->memory_footprint[i], columns->weight[i]);
+			} else {
+				bench_scan_add(data, &columns->req_time[i], &columns->ru_utime[i], &columns->ru_stime[i], columns->doc_size[i], columns->memory_footprint[i], columns->weight[i]);
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / records_cnt;
+}
+/* }}} */
+
+static void bench_scan(size_t records_cnt) /* {{{ */
+{
+	static const char *pass_names[] = {"info add", "info delete", "by script add", "by script delete"};
+	pinba_stats_record *records;
+	struct bench_columns columns;
+	struct bench_scan_data total, *script_data;
+	pinba_word *scripts;
+	char (*script_strs)[32];
+	void *map = pinba_map_create();
+	double ns[2];
+	size_t i, j, req_count[2];
+	int pass, layout;
+
+	records = (pinba_stats_record *)calloc(records_cnt, sizeof(pinba_stats_record));
+	columns.script_name = (pinba_word **)calloc(records_cnt, sizeof(pinba_word *));
+	columns.req_time = (struct timeval *)calloc(records_cnt, sizeof(struct timeval));
+	columns.ru_utime = (struct timeval *)calloc(records_cnt, sizeof(struct timeval));
+	columns.ru_stime = (struct timeval *)calloc(records_cnt, sizeof(struct timeval));
+	columns.doc_size = (float *)calloc(records_cnt, sizeof(float));
+	columns.memory_footprint = (float *)calloc(records_cnt, sizeof(float));
+	columns.weight = (unsigned int *)calloc(records_cnt, sizeof(unsigned int));
+	columns.time = (struct timeval *)calloc(records_cnt, sizeof(struct timeval));
+	columns.counter = (size_t *)calloc(records_cnt, sizeof(size_t));
+	scripts = (pinba_word *)calloc(BENCH_SCAN_SCRIPTS, sizeof(pinba_word));
+	script_strs = (char (*)[32])calloc(BENCH_SCAN_SCRIPTS, 32);
+	script_data = (struct bench_scan_data *)calloc(BENCH_SCAN_SCRIPTS, sizeof(struct bench_scan_data));
+
+	if (!records || !columns.script_name || !columns.req_time || !columns.ru_utime || !columns.ru_stime || !columns.doc_size
+			|| !columns.memory_footprint || !columns.weight || !columns.time || !columns.counter || !scripts || !script_strs || !script_data) {
+		fprintf(stderr, "failed to allocate %zu records\n", records_cnt);
+		exit(1);
+	}
+
+	for (i = 0; i < BENCH_SCAN_SCRIPTS; i++) {
+		scripts[i].len = snprintf(script_strs[i], sizeof(script_strs[i]), "/script%zu.php", i);
+		scripts[i].str = script_strs[i];
+		map = pinba_map_add(map, scripts[i].str, &script_data[i]);
+	}
+
+	for (i = 0; i < records_cnt; i++) {
+		pinba_stats_record *record = records + i;
+
+		record->data.script_name = columns.script_name[i] = &scripts[(i * 7919) % BENCH_SCAN_SCRIPTS];
+		record->data.req_time.tv_usec = columns.req_time[i].tv_usec = (i * 2654435761u) % 1000000;
+		record->data.ru_utime.tv_usec = columns.ru_utime[i].tv_usec = (i * 40503u) % 1000000;
+		record->data.ru_stime.tv_usec = columns.ru_stime[i].tv_usec = (i * 9973u) % 1000000;
+		record->data.doc_size = columns.doc_size[i] = (float)(i % 100);
+		record->data.memory_footprint = columns.memory_footprint[i] = (float)(i % 1000);
+		record->data.weight = columns.weight[i] = 1;
+		record->time.tv_sec = columns.time[i].tv_sec = 1000000 + i / 100000;
+		record->counter = columns.counter[i] = i;
+	}
+
+	printf("%zu records, %zu bytes per record, %zu in the columns\n", records_cnt, sizeof(pinba_stats_record),
+			sizeof(pinba_word *) + 4 * sizeof(struct timeval) + 2 * sizeof(float) + sizeof(unsigned int) + sizeof(size_t));
+
+	for (pass = 0; pass < 4; pass++) {
+		for (layout = 0; layout < 2; layout++) {
+			memset(&total, 0, sizeof(total));
+			memset(script_data, 0, BENCH_SCAN_SCRIPTS * sizeof(struct bench_scan_data));
+			ns[layout] = bench_scan_run(layout ? NULL : records, &columns, records_cnt, records_cnt / 1000, pass >= 2, pass & 1, map, &total);
+
+			/* both layouts must come to the same results */
+			req_count[layout] = total.req_count;
+			for (j = 0; j < BENCH_SCAN_SCRIPTS; j++) {
+				req_count[layout] += script_data[j].req_count;
+			}
+		}
+		if (req_count[0] != req_count[1]) {
+			fprintf(stderr, "%s: the layouts differ\n", pass_names[pass]);
+			exit(1);
+		}
+		printf("%-17s records %.2f ns per record, columns %.2f ns per record\n", pass_names[pass], ns[0], ns[1]);
+	}
+}
+/* }}} */
+
+static size_t bench_received(void) /* {{{ */
+{
+	size_t received;
+
+	pthread_rwlock_rdlock(&D->collector_lock);
+	received = D->request_pool_counter;
+	pthread_rwlock_unlock(&D->collector_lock);
+	return received;
+}
+/* }}} */
+
+/* RcvbufErrors of /proc/net/snmp, the packets dropped by the kernel on all the UDP sockets */
+static size_t bench_kernel_drops(void) /* {{{ */
+{
+	char names[1024], values[1024], *name, *value, *name_save, *value_save;
+	size_t drops = 0;
+	FILE *f;
+
+	f = fopen("/proc/net/snmp", "r");
+	if (!f) {
+		return 0;
+	}
+
+	while (fgets(names, sizeof(names), f) && fgets(values, sizeof(values), f)) {
+		if (strncmp(names, "Udp:", 4) != 0) {
+			continue;
+		}
+		name = strtok_r(names, " ", &name_save);
+		value = strtok_r(values, " ", &value_save);
+		while (name && value) {
+			if (strcmp(name, "RcvbufErrors") == 0) {
+				drops = strtoul(value, NULL, 10);
+				break;
+			}
+			name = strtok_r(NULL, " ", &name_save);
+			value = strtok_r(NULL, " ", &value_save);
+		}
+		break;
+	}
+	fclose(f);
+	return drops;
+}
+/* }}} */
+
+static int bench_setting(pinba_daemon_settings *settings, char *arg) /* {{{ */
+{
+	char *value;
+	int val;
+
+	value = strchr(arg, '=');
+	if (!value) {
+		return -1;
+	}
+	*value++ = '\0';
+	val = atoi(value);
+
+	if (strcmp(arg, "port") == 0) {
+		settings->port = val;
+	} else if (strcmp(arg, "stats_history") == 0) {
+		settings->stats_history = val;
+	} else if (strcmp(arg, "reuseport") == 0) {
+		settings->reuseport = val;
+	} else if (strcmp(arg, "udp_gro") == 0) {
+		settings->udp_gro = val;
+	} else if (strcmp(arg, "busy_poll") == 0) {
+		settings->busy_poll = val;
+	} else if (strcmp(arg, "coalesce_requests") == 0) {
+		settings->coalesce_requests = val;
+	} else if (strcmp(arg, "harvest_fill_threshold") == 0) {
+		settings->harvest_fill_threshold = val;
+	} else if (strcmp(arg, "numa") == 0) {
+		settings->numa = val;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+/* }}} */
+
+int main(int argc, char **argv) /* {{{ */
+{
+	pinba_daemon_settings settings;
+	pthread_t sender;
+	struct rusage start_rusage, end_rusage;
+	struct timeval end, reports_time;
+	size_t received, last, i, kernel_drops, ring_drops, collectors_usec, recv_delay, recv_delay_cnt;
+	double engine_usec, wall_usec;
+	int c;
+
+	/* the defaults of the sysvars */
+	memset(&settings, 0, sizeof(settings));
+	settings.port = 30002;
+	settings.stats_history = 900;
+	settings.stats_gathering_period = 10000;
+	settings.request_pool_size = 1000000;
+	settings.data_pool_size = 10000;
+	settings.temp_pool_size = 10000;
+	settings.temp_pool_size_limit = 10000 * 10;
+	settings.timer_pool_size = PINBA_TIMER_POOL_GROW_SIZE;
+	settings.data_job_size = 1024;
+	settings.histogram_size = 2048;
+	settings.log_level = P_ERROR | P_WARNING;
+
+	while ((c = getopt(argc, argv, "n:r:R:t:s:")) != -1) {
+		switch (c) {
+			case 'n':
+				bench.packets = strtoul(optarg, NULL, 10);
+				break;
+			case 'r':
+				bench.pps = strtoul(optarg, NULL, 10);
+				break;
+			case 'R':
+				bench.reports = strtoul(optarg, NULL, 10);
+				break;
+			case 't':
+				bench.timers = strtoul(optarg, NULL, 10);
+				if (bench.timers > 64) {
+					bench.timers = 64;
+				}
+				break;
+			case 's':
+				if (bench_setting(&settings, optarg) == 0) {
+					break;
+				}
+				/* fall through */
+			default:
+				fprintf(stderr, "usage: %s [-n packets] [-r pps] [-R reports] [-t timers] [-s setting=value ...]\n       %s [-t timers] decode [iterations]\n       %s scan [records]\n", argv[0], argv[0], argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind < argc && strcmp(argv[optind], "decode") == 0) {
+		bench_decode(optind + 1 < argc ? strtoul(argv[optind + 1], NULL, 10) : 10000000);
+		return 0;
+	}
+
+	if (optind < argc && strcmp(argv[optind], "scan") == 0) {
+		bench_scan(optind + 1 < argc ? strtoul(argv[optind + 1], NULL, 10) : 10000000);
+		return 0;
+	}
+
+	if (bench.packets > settings.request_pool_size) {
+		/* the pool never wraps, the records are deleted only when they expire */
+		settings.request_pool_size = bench.packets + 1;
+	}
+
+	if (pinba_collector_init(settings) != P_SUCCESS) {
+		fprintf(stderr, "failed to start the collector\n");
+		return 1;
+	}
+
+	bench_packets_init();
+	bench_reports_init();
+
+	kernel_drops = bench_kernel_drops();
+	getrusage(RUSAGE_SELF, &start_rusage);
+	pthread_create(&sender, NULL, bench_sender_main, NULL);
+	pthread_join(sender, NULL);
+	end = send_end;
+
+	/* the last packets are harvested within a couple of gathering periods */
+	for (last = 0;;) {
+		usleep(200000);
+		received = bench_received();
+		if (received == last) {
+			break;
+		}
+		last = received;
+		gettimeofday(&end, 0);
+	}
+	getrusage(RUSAGE_SELF, &end_rusage);
+	kernel_drops = bench_kernel_drops() - kernel_drops;
+
+	/* the CPU time of a collector thread is sampled once per harvester cycle, so it's a cycle late at most */
+	ring_drops = collectors_usec = recv_delay = recv_delay_cnt = 0;
+	for (i = 0; i < D->collector_queues_cnt; i++) {
+		ring_drops += __atomic_load_n(&D->collector_queues[i].drops, __ATOMIC_RELAXED);
+		collectors_usec += __atomic_load_n(&D->collector_queues[i].cpu_time, __ATOMIC_RELAXED);
+		recv_delay += __atomic_load_n(&D->collector_queues[i].recv_delay, __ATOMIC_RELAXED);
+		recv_delay_cnt += __atomic_load_n(&D->collector_queues[i].recv_delay_cnt, __ATOMIC_RELAXED);
+	}
+
+	timerclear(&reports_time);
+	pthread_rwlock_rdlock(&D->base_reports_lock);
+	for (i = 0; i < D->base_reports_arr.size; i++) {
+		pinba_std_report *report = (pinba_std_report *)D->base_reports_arr.data[i];
+
+		pthread_rwlock_rdlock(&report->lock);
+		timeradd(&reports_time, &report->ru_utime, &reports_time);
+		timeradd(&reports_time, &report->ru_stime, &reports_time);
+		pthread_rwlock_unlock(&report->lock);
+	}
+	pthread_rwlock_unlock(&D->base_reports_lock);
+
+	engine_usec = tv_usec(&end_rusage.ru_utime) + tv_usec(&end_rusage.ru_stime) - tv_usec(&start_rusage.ru_utime) - tv_usec(&start_rusage.ru_stime);
+	engine_usec -= tv_usec(&sender_rusage.ru_utime) + tv_usec(&sender_rusage.ru_stime);
+	wall_usec = tv_usec(&end) - tv_usec(&send_start);
+
+	printf("sent %zu in %.2fs, received %zu (%.2f%% lost: %zu by the kernel, %zu by the rings) in %.2fs: %.0f packets/s, engine %.2f usec/packet (collectors %.2f), reports %.2f usec/packet, receive delay %.1f usec\n",
+			bench.packets, (tv_usec(&send_end) - tv_usec(&send_start)) / 1e6,
+			received, 100.0 * (bench.packets - received) / bench.packets, kernel_drops, ring_drops, wall_usec / 1e6,
+			received / wall_usec * 1e6,
+			received ? engine_usec / received : 0.0,
+			received ? (double)collectors_usec / received : 0.0,
+			received ? tv_usec(&reports_time) / received : 0.0,
+			recv_delay_cnt ? (double)recv_delay / recv_delay_cnt : 0.0);
+
+	/* the threads of the engine are not stopped, pinba_collector_shutdown() is for the MySQL plugin */
+	return 0;
+}
+/* }}} */